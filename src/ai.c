@@ -1,8 +1,30 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdarg.h>
 #include <math.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <string.h>
+#include <strings.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#ifndef __EMSCRIPTEN__
+#include "threads.h"
+#endif
 
 #include "chess.h"
+#include "chessfrontend.h"
 #include "util.h"
 
 float piecety_value(piece_ty ty) {
@@ -20,21 +42,245 @@ float piecety_value(piece_ty ty) {
 	}
 }
 
-#define AI_RANGEVAL 0.0f
 #define AI_DIMINISH 1.1f //diminish returns by this, otherwise ai thinks an easily evaded checkmate is inevitable
 
-#define AI_DEPTH 2 //minimum search
+#define AI_DEPTH 2 //full width plies per extension of a superbranch, captures are resolved past it by ai_quiesce
 #define AI_MAXDEPTH 30 //eventual depth
-#define AI_BRANCHDEPTH 4 //depth+exchangedepth
+#define AI_QDEPTH 8 //most plies of quiescence
+#define AI_DELTA 2.0f //delta pruning margin, captures that cannot raise alpha even by this much are skipped
 #define AI_EXPECTEDLEN 12800 //more than this number of moves, otherwise extend by log2(expected/len)
-#define AI_LEN 10
+#define AI_LEN 10 //widest beam of superbranches
+#define AI_MINLEN 2 //narrowest beam a latency can ask for
 #define AI_MAXPLAYER 4
+#define AI_SYMS 7 //symmetries of a board besides the identity, at most the square's other seven
 #define AI_MAXLOSS 11
+#define AI_MAXTHREADS 64
+#define AI_PLIES (AI_MAXDEPTH+AI_DEPTH+AI_QDEPTH+2) //helpers search one ply past AI_MAXDEPTH
+#define AI_ROUNDS (AI_MAXDEPTH+2) //superbranches grow every round, so the beam ends before this
+#define AI_CLOCK_NODES 1024 //nodes between reading the clock for movetime
+#define AI_CALIBRATIONS 16 //variants remembered
+#define AI_CALIBRATION_TIME 0.25 //of the latency, spent measuring a variant not seen yet
+#define AI_CALIBRATION_MINNODES 2000 //searches smaller than this are too noisy to measure
+#define AI_CALIBRATION_WEIGHT 0.5 //of the last search, against the ones before it
+#define AI_LATENCY_LIMIT 2.0 //times the latency a search may overrun its estimate before it is stopped
+#define AI_BOOK_MAGIC 0x4b424354 //"TCBK"
+#define AI_BOOK_VERSION 2 //keys and moves of the canonical image
+#define AI_BOOKS 64
+#define AI_TB_MAGIC 0x42544354 //"TCTB"
+#define AI_TB_VERSION 1
+#define AI_TBS 256
+#define AI_TB_MAXPIECES 6
+#define AI_TB_PLY 0.01f //a mate is worth this much less per ply until it
+#define AI_DIFFICULTIES 5
+#define AI_DIFFICULTY_DEFAULT 2
+#define AI_NN_MAGIC 0x4e4e4354 //"TCNN"
+#define AI_NN_VERSION 1
+#define AI_NNS 64
+#define AI_EVALS 64
+#define AI_NN_HIDDEN 32 //accumulator width, a multiple of 16 for the avx2 kernels
+#define AI_NN_QA 127 //accumulator value of 1, the top of the clipped relu
+#define AI_NN_QB 64 //output weight of 1
+#define AI_MCTS_EXPLORE 0.7f //uct exploration constant, rewards are win chances from the score
+#define AI_MCTS_SCALE 3.0f //score at which a playout counts as about three quarters of a win
+#define AI_MCTS_PLAYOUT 4 //plies of a playout, captures first, before its captures are resolved by ai_quiesce
+#define AI_MCTS_MAXDEPTH (AI_PLIES-AI_MCTS_PLAYOUT-AI_QDEPTH-1) //of the tree, the playout continues in the same line of branches
+#define AI_MCTS_ITERATIONS 20000 //per thread when no limit is given
+#define AI_MCTS_INFO 4096 //iterations between info calls
+
+#ifdef __EMSCRIPTEN__
+#define AI_TT_BITS 16
+#define AI_MCTS_NODES (1<<16)
+#else
+#define AI_TT_BITS 20 //16 bytes per entry
+#define AI_MCTS_NODES (1<<19) //per thread, 32 bytes each and as much again to move to a new root
+#endif
+
+typedef struct {
+	unsigned long nodes;
+	unsigned long ply_nodes[AI_PLIES]; //nodes by ply from the root, quiescence included
+	unsigned long regens; //cached move lists regenerated by branch_init
+	unsigned long tt_probes;
+	unsigned long tt_hits; //probes finding the position, whether or not they cut off
+	unsigned long tt_shared_hits; //of those, entries stored by a search with another tt_tag
+	unsigned long tb_hits; //positions found in an endgame tablebase
+	int threads;
+	int depth; //maxdepth of the search the move came from
+	unsigned rounds; //of the beam, in the search the move came from
+	unsigned round_sbranches[AI_ROUNDS]; //superbranches in the beam each round
+	unsigned beam; //width of the beam, AI_LEN unless picked for a latency
+	float branching; //effective, from the nodes per superbranch extension of AI_DEPTH plies
+	double time; //seconds
+	double nodes_per_sec;
+	double depth_time[AI_MAXDEPTH+1]; //seconds until a line of length i was first searched, 0 if never
+
+	char aborted; //stopped by a limit or the caller, the move may come from an unfinished beam
+	char book; //the move came from an opening book, nothing was searched
+	char tablebase; //the move came from an endgame tablebase, value is exact
+	float value; //of the principal line, for the ai's team
+	unsigned pv_len;
+	move_t pv[AI_PLIES];
+} ai_stats_t;
+
+//lockless hashing; an entry is valid only if key^data is the hash, so torn writes from other threads are discarded
+typedef struct {
+	_Atomic uint64_t key;
+	_Atomic uint64_t data;
+} ai_tt_entry_t;
+
+typedef struct {
+	ai_tt_entry_t* entries;
+	uint64_t mask;
+	size_t mapped; //bytes of the entries from ai_tt_shared, 0 if they are on the heap
+} ai_tt_t;
+
+typedef struct {
+	float piece[p_blocked+1]; //material
+	float ally; //added to pieces of the ai's team, losing them is worse than taking others
+	float center[p_blocked+1]; //per square closer to the center
+	float advance; //per square a promoting piece has moved towards promotion
+	float mobility; //per move in the cached move lists, 0 leaves it out
+	char net; //a network loaded for the variant replaces material, center, advance and ally, 0 leaves it out
+
+	//selectivity of the search, kept with the evaluation so each variant can set its own
+	float null; //1 tries a null move before the moves of a node that has a beta, 0 leaves it out
+	float null_material; //least material besides pawns and kings for a null move, below it zugzwang is likely
+	float lmr; //moves of a node searched in full before the later quiet ones are reduced, 0 leaves it out
+} ai_eval_params_t;
+
+ai_eval_params_t g_ai_eval = {
+	.piece={[p_pawn]=1, [p_queen]=10, [p_bishop]=4, [p_rook]=6, [p_knight]=3,
+		[p_chancellor]=9, [p_archibishop]=7, [p_heir]=2, [p_king]=2},
+	.ally=1,
+	.center={[p_pawn]=0.05f, [p_knight]=0.1f, [p_bishop]=0.05f, [p_archibishop]=0.08f,
+		[p_chancellor]=0.05f, [p_queen]=0.02f},
+	.advance=0.05f,
+	.mobility=0,
+	.net=1,
+	.null=1,
+	.null_material=6,
+	.lmr=3
+};
+
+typedef struct {
+	uint64_t hash; //of the position after the move, 0 until it is entered
+	uint32_t visits;
+	float value; //rewards summed for the team that made the move
+	int children; //first in the arena, -1 until expanded
+	uint16_t len; //children, 0 once expanded means no moves
+	uint16_t from;
+	uint16_t to;
+	uint16_t castle; //AI_NOSQUARE if not castling
+	char ally; //made by the ai's team
+} ai_mcts_node_t;
+
+//children of a node are contiguous in the arena, the root is always the first node
+typedef struct {
+	ai_mcts_node_t* nodes;
+	ai_mcts_node_t* spare; //the subtree of a new root is copied here
+	unsigned len;
+	char ai_player; //whose team the values are for
+	float base; //score of the ai's team the rewards are relative to, at the first root
+} ai_mcts_tree_t;
+
+//trees of a game kept between its moves, one per thread
+typedef struct ai_mcts {
+	ai_mcts_tree_t trees[AI_MAXTHREADS];
+} ai_mcts_t;
+
+typedef struct {
+	int threads; //lazy smp; <=1 searches only on the calling thread
+	ai_tt_t* tt; //shared between all threads of the search, NULL uses g_ai_tt
+	unsigned tt_tag; //of the caller, e.g. a game on the server sharing tt with others; its low bits are kept with the entries
+	ai_stats_t* stats; //optional, filled after the search
+	ai_eval_params_t* eval; //NULL uses the variant's from ai_evals_open, or g_ai_eval without one
+	int verbosity; //0 is silent, 1 prints the depth and value, 2 also the principal line
+
+	//limits, 0 for none; a stopped search returns the best line it has
+	atomic_int* stop; //set from another thread
+	unsigned long nodes; //per thread
+	double movetime; //seconds
+	_Atomic double* deadline; //ai_time to stop at, 0 for none; may be moved by another thread while searching
+	int depth; //instead of the depth picked from the number of moves
+	double latency; //seconds the search should take, depth and beam width are picked from the variant's calibration
+	move_t* exclude; //root moves left out of the search
+	unsigned exclude_len;
+	char nobook; //search positions the opening books have, which are otherwise played from them
+	char mcts; //monte carlo tree search instead of the beam, as games flagged game_mcts do
+	ai_mcts_t* mcts_trees; //reused by the next search with mcts if it is in a position below them, NULL for new trees
+
+	//the same position and settings always give the same move, value and nodes: the clock, threads and
+	//mcts_trees are ignored and a new table the size of tt is used instead; book moves and playouts are drawn from seed
+	char deterministic;
+	uint64_t seed;
+
+	void (*info)(void* arg, ai_stats_t* stats); //called on the main thread after each round of the beam, with the best line so far
+	void* info_arg;
+} ai_settings_t;
+
+typedef struct {
+	move_t m;
+	float value; //for the player to move
+	int depth;
+	char aborted;
+	unsigned pv_len;
+	move_t pv[AI_PLIES];
+} ai_analysis_t;
 
 int maxdepth(unsigned len) {
-	return (char)min(max((int)roundf((log2f(AI_EXPECTEDLEN/(float)len)+1)*AI_DEPTH), AI_BRANCHDEPTH), AI_MAXDEPTH);
+	return (char)min(max((int)roundf((log2f(AI_EXPECTEDLEN/(float)len)+1)*AI_DEPTH), 2*AI_DEPTH), AI_MAXDEPTH);
 }
 
+//a symmetry of a variant, a rotation or reflection of the board with a relabelling of the players
+//that maps the initial board to itself and keeps the order of turns and the alliances
+typedef struct {
+	int* square; //[squares] image of each square
+	int* inverse; //[squares]
+	char player[AI_MAXPLAYER];
+	char swap; //of the axes, before the flips
+	char flip[2];
+} ai_sym_t;
+
+//a network evaluating a variant, written by termchess_nntrain
+//inputs are one per piece type of each player on each square, summed into an accumulator of AI_NN_HIDDEN
+//which is clipped to [0, 1] and read by one output per player, the score of its team in pawns
+//followed by int16_t bias[hidden], int16_t input[players][types][squares][hidden],
+//int16_t output[players][hidden] and int32_t output_bias[players], quantized by AI_NN_QA and AI_NN_QB
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t variant;
+	uint32_t squares;
+	uint32_t players;
+	uint32_t types;
+	uint32_t hidden;
+} ai_nn_header_t;
+
+typedef struct {
+	void* data;
+	size_t size;
+	ai_nn_header_t* header;
+	int16_t* bias;
+	int16_t* input;
+	int16_t* output;
+	int32_t* output_bias;
+} ai_nn_t;
+
+//scores are from the perspective of the ai's team, all other teams counting as one
+typedef struct {
+	ai_eval_params_t* params;
+	float* pst; //[piece_ty][square] center terms for this board
+	char team[AI_MAXPLAYER];
+
+	float score;
+	float material[AI_MAXPLAYER]; //of pieces besides pawns and kings, without the ally bonus
+	int mobility[AI_MAXPLAYER];
+
+	ai_nn_t* nn; //NULL evaluates with the parameters
+	char player; //whose output of the network is the score
+	int16_t* acc; //[AI_PLIES+1][AI_NN_HIDDEN] by ply of the line, of the position before its move
+	float* nn_score; //[AI_PLIES+1] output for each accumulator
+} ai_eval_t;
+
 typedef struct {
 	unsigned num;
 	move_t m;
@@ -43,495 +289,3321 @@ typedef struct {
 	char checks[AI_MAXPLAYER];
 	char player;
 	char ally;
+	uint64_t hash_prev;
+	float eval; //change of the score by the move
 } branch_t;
 
+#define AI_NOSQUARE 0xffff
+
+//lines in the pool, every live superbranch holds at most AI_PLIES
+#define AI_LINES ((2*AI_LEN+2)*AI_PLIES)
+
+typedef struct {
+	uint16_t to;
+	uint16_t castle; //AI_NOSQUARE if not castling
+} ai_cmove_t;
+
+//cached moves of every piece in slots, which follow pieces as they move between squares
+//a slot holds at most piece_depends_max moves and squares its moves depend on
+typedef struct {
+	int cap;
+	int slots; //pieces at the root, and two for the squares a castle fills before those it empties
+
+	ai_cmove_t* moves; //[slot][cap]
+	uint16_t* depends; //[slot][cap]
+	int* len;
+	int* depends_len;
+	int* square; //of each slot, -1 when free
+	char* player; //owner when the moves were generated, for mobility
+
+	int* slot; //[square], -1 without a piece
+	int* free; //stack of free slots
+	int nfree;
+
+	vector_t scratch; //move_t from piece_moves
+	int* scratch_depends;
+} ai_moves_t;
+
+//squares regenerated by the branch at a depth, to be regenerated again when it exits
 typedef struct {
-	piece_t* p;
-	int pos[2];
-	vector_cap_t moves;
-	char modified[AI_MAXDEPTH];
-} piece_moves_t;
+	uint16_t depth;
+	uint16_t square;
+} ai_log_t;
 
 typedef struct {
-	vector_t branches;
+	move_t m;
+	int score;
+} ai_move_t;
+
+//ordering scores, from the table move down to quiet moves ranked by history
+#define AI_ORDER_TT (1<<30)
+#define AI_ORDER_CAPTURE (1<<24)
+#define AI_ORDER_KILLER (1<<20)
+#define AI_ORDER_MVV 64 //victim value weight over attacker value
+
+//moves wanted for each ply, capacity is bounded by the pieces of the largest army
+typedef struct {
+	ai_move_t* moves;
+	unsigned length;
+} ai_order_t;
+
+//superbranches are chains through a pool of lines, extending one only adds the new plies
+typedef struct {
+	branch_t b;
+	int parent; //-1 for a move from the root
+	int refs; //lines and superbranches continuing from this one
+} ai_line_t;
+
+typedef struct {
+	int line; //last move, -1 for the root
 	char keep; //1 is either stale or completed
 	float v;
 	unsigned depth;
 } superbranch_t;
 
 typedef struct move_vecs {
-	vector_t moves; //piece_moves_t
+	ai_moves_t moves;
+	//per square, a bitset of the squares whose moves depend on it
+	uint64_t* dependents;
+	unsigned words;
+	uint64_t* collect;
+	ai_log_t* log; //at most AI_PLIES*squares
+	unsigned log_len;
 	char ally;
 
-	vector_t sbranches; //at most AI_LEN
-	vector_t sbranches_new;
+	ai_line_t* lines; //AI_LINES, enough for both beams and the best line kept
+	int lines_cap;
+	int* lines_free;
+	int nlines_free;
+	branch_t line[AI_PLIES]; //current superbranch followed by the plies searched below it
+
+	superbranch_t beam[2][AI_LEN];
+	superbranch_t* sbranches;
+	unsigned sbranches_len;
+	superbranch_t* sbranches_new;
+	unsigned sbranches_new_len;
 	superbranch_t first;
 	superbranch_t* sbranch; //current
 
 	char ai_player;
 	player_t* ai_p;
 
-	int finddepth;
+	ai_eval_t eval;
+
 	int maxdepth;
-	int init;
+	unsigned beam_len; //most superbranches kept per round, at most AI_LEN
+
+	uint64_t hash;
+	ai_tt_t* tt;
+	unsigned char tt_tag;
+	ai_sym_t* syms; //of the variant, the table is keyed by the least hash of a position's images
+	unsigned nsyms;
+	uint64_t sym_hash[AI_PLIES+1][AI_SYMS]; //by ply of the line, of the position before its move
+
+	uint64_t variant;
+	int tb_pieces; //most pieces in a tablebase of the variant, 0 to not probe
+
+	ai_order_t order[AI_DEPTH+AI_QDEPTH+1]; //per recursion depth, quiescence after AI_DEPTH
+	unsigned killers[AI_PLIES][2]; //move_num of quiet moves that cut off, per ply of the line
+	int* history; //[piece_ty][square] quiet cut-off counts
+
+	int thread; //0 is the calling thread
+	int threads;
+	atomic_int* stop; //set when the main thread completes, helpers abandon their search
+	atomic_int* cancel; //from the caller
+	unsigned long max_nodes;
+	double deadline;
+	_Atomic double* deadline_ref; //from the caller
+	move_t* exclude;
+	unsigned exclude_len;
+	unsigned long next_check;
+	char aborted;
+	char decided; //the value ai_find_move or ai_quiesce last returned is a mate or tablebase score, the same from any path
+
+	void (*info)(void* arg, ai_stats_t* stats);
+	void* info_arg;
+
+	unsigned long nodes;
+	unsigned long ply_nodes[AI_PLIES];
+	unsigned long regens;
+	unsigned long tt_probes;
+	unsigned long tt_hits;
+	unsigned long tt_shared_hits;
+	unsigned long tb_hits;
+	unsigned rounds;
+	unsigned round_sbranches[AI_ROUNDS];
+	unsigned long extensions; //superbranches extended, the search of the first plies not included
+	double start;
+	double depth_time[AI_MAXDEPTH+1];
 } move_vecs_t;
 
-float piece_value(game_t* g, move_vecs_t* vecs, piece_t* p) {
-	vector_iterator p_search = vector_iterate(&vecs->moves);
-	float range = 0;
-	while (vector_next(&p_search)) {
-		piece_moves_t* pmoves = p_search.x;
-		if (pmoves->p == p) {
-			range = (float) pmoves->moves.vec.length;
-			break;
-		}
-	}
+ai_tt_t g_ai_tt = {.entries=NULL};
+#ifndef __EMSCRIPTEN__
+once_flag g_ai_tt_once = ONCE_FLAG_INIT; //searches without a table of their own may start on several threads at once
+#endif
 
-	range /= ((float) (g->board_w * g->board_h));
-	return range * AI_RANGEVAL + (is_ally(vecs->ai_player, vecs->ai_p, p->player) ? 1.0f : 0) + piecety_value(p->ty);
+double ai_time() {
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	return (double)ts.tv_sec + (double)ts.tv_nsec/1e9;
 }
 
-#define CHECKMATE_VAL 15.0f
+uint64_t ai_mix(uint64_t x) { //splitmix64 finalizer
+	x += 0x9e3779b97f4a7c15ULL;
+	x = (x ^ (x>>30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x>>27)) * 0x94d049bb133111ebULL;
+	return x ^ (x>>31);
+}
 
-float checkmate_value(game_t* g, move_vecs_t* vecs) {
-	//stalemate, indesirable to either player, EXCEPT when win by pieces
-	if (!((player_t*)vector_get(&g->players, g->player))->check && ~g->flags&game_win_by_pieces)
-		return (vecs->ally ? 1.0f : -1.0f) * CHECKMATE_VAL;
-	else return CHECKMATE_VAL;
+_Atomic uint64_t g_ai_random = 0;
+
+//differs between calls and runs, for choices among equally good moves
+uint64_t ai_random() {
+	return ai_mix(atomic_fetch_add(&g_ai_random, 1) ^ (uint64_t)(ai_time()*1e9));
 }
 
-void branch_push(move_vecs_t* vecs) {
-	vector_populate(&vecs->sbranch->branches, AI_BRANCHDEPTH, &(branch_t){.checks={0}, .m={.from={-1}}});
+//the i-th random number of a search, from its seed when it is deterministic
+uint64_t ai_search_random(ai_settings_t* settings, unsigned i) {
+	return settings->deterministic ? ai_mix(settings->seed + i*0x9e3779b97f4a7c15ULL) : ai_random();
 }
 
-void branch_pop(move_vecs_t* vecs) {
-	vector_truncate(&vecs->sbranch->branches, vecs->sbranch->depth);
+//zobrist keys are derived instead of tabulated since boards can be any size
+uint64_t ai_piece_key(int i, piece_t* p) {
+	if (p->ty==p_empty) return 0;
+	return ai_mix(((uint64_t)i<<32) | ((uint64_t)p->ty<<16) | ((uint64_t)(p->flags&0xff)<<8) | (unsigned char)p->player);
 }
 
-unsigned move_num(game_t* g, move_t* m) {
-	unsigned i = m->from[0] + m->from[1]*g->board_w + ((m->to[0] + m->to[1]*g->board_w)<<8);
-	if (m->castle[0]!=-1) {
-		i += (m->castle[0] + m->castle[1]*g->board_w)<<16;
+uint64_t ai_player_key(char player) {
+	return ai_mix(0xff00000000000000ULL | (unsigned char)player);
+}
+
+//image of a piece under s, pawns keep moving the same way relative to the board
+piece_t ai_sym_piece(ai_sym_t* s, piece_t* p) {
+	int dir[2];
+	pawn_dir(dir, p->flags);
+	if (s->swap) {
+		int x = dir[0];
+		dir[0] = dir[1];
+		dir[1] = x;
 	}
 
-	return i;
+	if (s->flip[0]) dir[0] = -dir[0];
+	if (s->flip[1]) dir[1] = -dir[1];
+
+	piece_t out = *p;
+	out.flags = (piece_flags_t)((p->flags & ~(piece_x|piece_nx|piece_y|piece_ny))
+			| (dir[0] ? piece_x : 0) | (dir[0]<0 ? piece_nx : 0) | (dir[1] ? piece_y : 0) | (dir[1]<0 ? piece_ny : 0));
+	if (p->ty<p_empty) out.player = s->player[(int)p->player];
+
+	return out;
 }
 
-int branch_init(game_t* g, move_vecs_t* vecs, branch_t* b, unsigned depth, move_t m, char make, char enter) {
-	if (make) b->m = m;
+//of square i under s, NULL for the identity
+uint64_t ai_sym_key(ai_sym_t* s, int i, piece_t* p) {
+	if (!s) return ai_piece_key(i, p);
+	if (p->ty==p_empty) return 0;
 
-	piece_t* from = board_get(g, b->m.from);
-	piece_t* to = board_get(g, b->m.to);
+	piece_t image = ai_sym_piece(s, p);
+	return ai_piece_key(s->square[i], &image);
+}
 
-	if (make) {
-		b->player = g->player;
-		b->ally = vecs->ally;
+char ai_sym_player(ai_sym_t* s, char player) {
+	return s ? s->player[(int)player] : player;
+}
 
-		b->piece_from = *from;
-		b->piece_to = *to;
-	} else if (enter) { //toggle checks
-		vector_iterator p_iter = vector_iterate(&g->players);
-		while (vector_next(&p_iter)) {
-			((player_t*)p_iter.x)->check ^= b->checks[p_iter.i];
-		}
+//hash of the image of the position under s, NULL for the identity
+uint64_t ai_hash_board_sym(game_t* g, char ai_player, ai_sym_t* s) {
+	uint64_t h = ai_player_key(ai_sym_player(s, g->player)) ^ ai_mix(ai_player_key(ai_sym_player(s, ai_player)));
+
+	vector_iterator board_iter = vector_iterate(&g->board);
+	while (vector_next(&board_iter)) {
+		h ^= ai_sym_key(s, (int)board_iter.i, board_iter.x);
 	}
 
-	move_noswap(g, &b->m, from, to);
+	return h;
+}
 
-	if (make) {
-		vector_iterator p_iter = vector_iterate(&g->players);
-		while (vector_next(&p_iter)) {
-			player_t* p = p_iter.x;
-			char check = (char)player_check(g, p_iter.i, p);
+uint64_t ai_hash_board(game_t* g, char ai_player) {
+	return ai_hash_board_sym(g, ai_player, NULL);
+}
 
-			if (check && p_iter.i==b->player) {
-				unmove_noswap(g, &b->m, from, to, b->piece_from, b->piece_to);
-				return 0;
+//squares touched by a move; xored in before and after it is made
+uint64_t ai_hash_move(game_t* g, move_t* m, ai_sym_t* s) {
+	uint64_t h = ai_sym_key(s, pos_i(g, m->from), board_get(g, m->from))
+			^ ai_sym_key(s, pos_i(g, m->to), board_get(g, m->to));
+
+	if (m->castle[0]!=-1) {
+		int castle_pos[2];
+		castle_to_pos(m, castle_pos);
+		h ^= ai_sym_key(s, pos_i(g, castle_pos), board_get(g, castle_pos));
+		//the king can land on the square the rook left
+		if (!i2eq(m->castle, m->to)) h ^= ai_sym_key(s, pos_i(g, m->castle), board_get(g, m->castle));
+	}
+
+	return h;
+}
+
+//symmetries of g's variant other than the identity into out, returns how many; free them with ai_syms_free
+//positions that are images of each other have the same value for the images of the ai's team,
+//so caches keyed by ai_hash_canonical share their entries
+unsigned ai_syms(game_t* g, ai_sym_t* out) {
+	unsigned players = g->players.length;
+	if (players>AI_MAXPLAYER) return 0;
+
+	int squares = g->board_w*g->board_h;
+	unsigned n=0;
+
+	for (int t=1; t<8 && n<AI_SYMS; t++) {
+		ai_sym_t s = {.swap=(char)(t>>2), .flip={(char)(t&1), (char)((t>>1)&1)}};
+		if (s.swap && g->board_w!=g->board_h) continue;
+
+		s.square = heap(sizeof(int)*squares);
+		s.inverse = heap(sizeof(int)*squares);
+		for (int i=0; i<squares; i++) {
+			int x = i%g->board_w, y = i/g->board_w;
+			if (s.swap) {
+				int tmp = x;
+				x = y;
+				y = tmp;
 			}
 
-			b->checks[p_iter.i] = check!=p->check;
-			if (enter) p->check = check;
+			if (s.flip[0]) x = g->board_w-1-x;
+			if (s.flip[1]) y = g->board_h-1-y;
+
+			s.square[i] = x + y*g->board_w;
+			s.inverse[s.square[i]] = i;
 		}
 
-		b->num = move_num(g, &b->m);
-	}
+		memset(s.player, -1, sizeof(s.player));
+		int ok = 1;
 
-	if (enter) {
-		int castle_pos[2];
-		if (b->m.castle[0]!=-1) castle_to_pos(&b->m, castle_pos);
-		int castle_mod = 0;
+		for (int i=0; ok && i<squares; i++) {
+			piece_t* p = vector_get(&g->init_board, i);
+			piece_t* q = vector_get(&g->init_board, s.square[i]);
 
-		vector_iterator pmoves_iter = vector_iterate(&vecs->moves);
-		while (vector_next(&pmoves_iter)) {
-			piece_moves_t* pmoves = pmoves_iter.x;
+			if (p->ty!=q->ty) ok = 0;
+			if (!ok || p->ty>=p_empty) continue;
 
-			if (!piece_edible(pmoves->p)) continue;
+			if (s.player[(int)p->player]==-1) s.player[(int)p->player] = q->player;
+			piece_t image = ai_sym_piece(&s, p);
+			if (image.player!=q->player || image.flags!=q->flags) ok = 0;
+		}
 
-			if (b->m.castle[0]!=-1) {
-				castle_mod = piece_moves_modified(g, pmoves->p, pmoves->pos, b->m.castle)
-						|| piece_moves_modified(g, pmoves->p, pmoves->pos, castle_pos)
-						|| i2eq(pmoves->pos, castle_pos);
-			}
+		//a relabelling of every player, which plays in the same order and has the same allies
+		char used[AI_MAXPLAYER] = {0};
+		for (unsigned i=0; ok && i<players; i++) {
+			int to = s.player[i];
+			if (to<0 || used[to]) ok = 0;
+			else used[to] = 1;
+		}
 
-			//when having >2 players, update moves if check is still ongoing
-			if (pmoves->p==to || piece_moves_modified(g, pmoves->p, pmoves->pos, b->m.to)
-					|| piece_moves_modified(g, pmoves->p, pmoves->pos, b->m.from)
-					|| castle_mod) {
-				vector_clear(&pmoves->moves.vec);
-				piece_moves(g, pmoves->p, &pmoves->moves.vec, 0);
+		for (unsigned i=0; ok && i<players; i++) {
+			if (s.player[(i+1)%players]!=(s.player[i]+1)%(int)players) ok = 0;
 
-				pmoves->modified[depth] = 1;
+			player_t* p = vector_get(&g->players, i);
+			player_t* image = vector_get(&g->players, s.player[i]);
+			for (unsigned j=0; ok && j<players; j++) {
+				if (is_ally((char)i, p, (char)j)!=is_ally(s.player[i], image, s.player[j])) ok = 0;
 			}
 		}
 
-		next_player(g);
-		vecs->ally = (char)is_ally(vecs->ai_player, vecs->ai_p, g->player);
-	} else {
-		unmove_noswap(g, &b->m, from, to, b->piece_from, b->piece_to);
+		if (ok) {
+			out[n++] = s;
+		} else {
+			drop(s.square);
+			drop(s.inverse);
+		}
 	}
 
-	return 1;
+	return n;
 }
 
-void branch_reenter(game_t* g, move_vecs_t* vecs, branch_t* b, unsigned depth) {
-	branch_init(g, vecs, b, depth, (move_t) {0}, 0, 1);
+void ai_syms_free(ai_sym_t* syms, unsigned n) {
+	for (unsigned i=0; i<n; i++) {
+		drop(syms[i].square);
+		drop(syms[i].inverse);
+	}
 }
 
-void branch_exit(game_t* g, move_vecs_t* vecs, branch_t* b, unsigned depth) {
-	piece_t* from = board_get(g, b->m.from);
-	piece_t* to = board_get(g, b->m.to);
-
-	unmove_noswap(g, &b->m, from, to, b->piece_from, b->piece_to);
-
-	vector_iterator pmoves_iter = vector_iterate(&vecs->moves);
-	while (vector_next(&pmoves_iter)) {
-		piece_moves_t* pmoves = pmoves_iter.x;
-		if (pmoves->p==from || pmoves->modified[depth]
-				|| (b->m.castle[0]!=-1 && i2eq(pmoves->pos, b->m.castle))) {
-			vector_clear(&pmoves->moves.vec);
-			piece_moves(g, pmoves->p, &pmoves->moves.vec, 0);
-			pmoves->modified[depth] = 0;
+//the least hash of the images of the position, which is the same for every image;
+//sym is set to the symmetry it came from, -1 for the identity
+uint64_t ai_hash_canonical(game_t* g, char ai_player, ai_sym_t* syms, unsigned n, int* sym) {
+	uint64_t h = ai_hash_board(g, ai_player);
+	*sym = -1;
+
+	for (unsigned i=0; i<n; i++) {
+		uint64_t image = ai_hash_board_sym(g, ai_player, &syms[i]);
+		if (image<h) {
+			h = image;
+			*sym = (int)i;
 		}
 	}
 
-	vector_iterator p_iter = vector_iterate(&g->players);
-	while (vector_next(&p_iter)) {
-		((player_t*)p_iter.x)->check ^= b->checks[p_iter.i];
-	}
-
-	g->player = b->player;
-	vecs->ally = b->ally;
+	return h;
 }
 
-move_vecs_t g_move_vecs = {.init=0};
+//maps a square to its image, or back with inverse
+void ai_sym_pos(game_t* g, ai_sym_t* s, int pos[2], char inverse) {
+	int i = (inverse ? s->inverse : s->square)[pos_i(g, pos)];
+	pos[0] = i%g->board_w;
+	pos[1] = i/g->board_w;
+}
 
-unsigned ai_hash_branches(branch_t* branches, unsigned l) {
-	unsigned x=1;
-	for (unsigned i = 0; i<l; i++) {
-		if (branches[i].m.from[0] == -1) break;
-		x *= branches[i].m.from[0]+branches[i].m.from[1] + 1;
-		x *= branches[i].m.to[0]+branches[i].m.to[1] + 1;
-	}
+void ai_sym_move(game_t* g, ai_sym_t* s, move_t* m, char inverse) {
+	ai_sym_pos(g, s, m->from, inverse);
+	ai_sym_pos(g, s, m->to, inverse);
+	if (m->castle[0]!=-1) ai_sym_pos(g, s, m->castle, inverse);
+}
 
-	return x;
+//move_num of the image of a move, a castle square of 0 is no castle as in move_num
+unsigned ai_sym_num(ai_sym_t* s, unsigned num, char inverse) {
+	int* map = inverse ? s->inverse : s->square;
+	unsigned castle = (num>>16)&0xff;
+	return (unsigned)map[num&0xff] | ((unsigned)map[(num>>8)&0xff]<<8) | (castle ? (unsigned)map[castle]<<16 : 0);
 }
 
-void sbranch_push(move_vecs_t* vecs, branch_t* branches, float v, char keep) {
-	unsigned char len_branches = AI_BRANCHDEPTH-1;
-	for (unsigned char i = 0; i < AI_BRANCHDEPTH-1; i++) {
-		if (branches[i].m.from[0] == -1) {
-			len_branches = i;
-			break;
-		}
+//not safe while a search is using the table
+void ai_tt_clear(ai_tt_t* tt) {
+	for (uint64_t i=0; i<=tt->mask; i++) {
+		atomic_init(&tt->entries[i].key, 0);
+		atomic_init(&tt->entries[i].data, 0);
 	}
+}
 
-	vector_iterator sbranch_iter = vector_iterate(&vecs->sbranches_new);
+ai_tt_t ai_tt_new(unsigned bits) {
+	ai_tt_t tt = {.mask=((uint64_t)1<<bits)-1};
+	tt.entries = heap(sizeof(ai_tt_entry_t)<<bits);
+	ai_tt_clear(&tt);
+	return tt;
+}
 
-	//do not insert multiple enemy branches
-	char cdexists=0;
-	superbranch_t* min=NULL;
-	int replace=0;
+void ai_tt_global() {
+	g_ai_tt = ai_tt_new(AI_TT_BITS);
+}
 
-	unsigned l = vecs->sbranch->depth+1+len_branches;
+//at most mb megabytes, for one table between many searches; huge pages are used when asked and the system has them
+ai_tt_t ai_tt_shared(size_t mb, char huge) {
+	unsigned bits = 10;
+	while ((sizeof(ai_tt_entry_t)<<(bits+1)) <= mb<<20) bits++;
+	size_t size = sizeof(ai_tt_entry_t)<<bits;
+
+	void* data = MAP_FAILED;
+#ifdef MAP_HUGETLB
+	if (huge) data = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+	if (data!=MAP_FAILED) huge = 0;
+#endif
+	if (data==MAP_FAILED) data = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (data==MAP_FAILED) return ai_tt_new(bits);
+
+#ifdef MADV_HUGEPAGE
+	if (huge) madvise(data, size, MADV_HUGEPAGE); //none reserved, transparent ones instead
+#endif
+
+	//anonymous pages are zeroed, as ai_tt_clear would leave them
+	return (ai_tt_t){.entries=data, .mask=((uint64_t)1<<bits)-1, .mapped=size};
+}
 
-	while (vector_next(&sbranch_iter)) {
-		superbranch_t* sb = sbranch_iter.x;
+void ai_tt_free(ai_tt_t* tt) {
+	if (tt->mapped) munmap(tt->entries, tt->mapped);
+	else drop(tt->entries);
+	tt->entries = NULL;
+	tt->mapped = 0;
+}
 
-		char ally=1;
+#define AI_TT_ABSOLUTE 1 //mate and tablebase values do not depend on the score before the node
+#define AI_TT_LOWER 2 //failed high
+#define AI_TT_UPPER 4 //failed low
+#define AI_TT_SCALE 256.0f //values are stored as 8.8 fixed point
 
-		unsigned most = sb->branches.length<l?sb->branches.length:l;
+typedef struct {
+	float v;
+	unsigned char draft; //full width plies left in the branch, quiescence below is the same everywhere
+	char flags;
+	unsigned move; //move_num of the best move, for ordering
+	unsigned char tag; //tt_tag of the search that stored it
+} ai_tt_hit_t;
+
+int ai_tt_probe(ai_tt_t* tt, uint64_t hash, ai_tt_hit_t* hit) {
+	ai_tt_entry_t* e = &tt->entries[hash&tt->mask];
+	uint64_t key = atomic_load_explicit(&e->key, memory_order_relaxed);
+	uint64_t data = atomic_load_explicit(&e->data, memory_order_relaxed);
+
+	if ((key^data)!=hash) return 0;
+
+	hit->v = (float)(int16_t)(uint16_t)data / AI_TT_SCALE;
+	hit->draft = (unsigned char)(data>>16);
+	hit->flags = (char)(data>>24);
+	hit->move = (unsigned)(data>>32)&0xffffff;
+	hit->tag = (unsigned char)(data>>56);
+	return 1;
+}
 
-		for (unsigned cd=0; cd<most; cd++) {
-			branch_t* b1 = vector_get(&sb->branches, cd);
-			branch_t* b2 = vector_get(&vecs->sbranch->branches, cd);
-			ally=b1->ally;
-			if (b1->num!=b2->num) break;
-		}
+void ai_tt_store(ai_tt_t* tt, uint64_t hash, ai_tt_hit_t* hit) {
+	ai_tt_entry_t* e = &tt->entries[hash&tt->mask];
 
-		if (ally ? v>sb->v : v<sb->v) {
-			min = sb;
-			replace = !ally;
-		} else if (!ally) {
-			cdexists=1;
-			break;
-		}
-	}
+	int16_t v = (int16_t)clamp((int)roundf(hit->v*AI_TT_SCALE), INT16_MIN, INT16_MAX);
+	uint64_t data = (uint64_t)(uint16_t)v | ((uint64_t)hit->draft<<16)
+			| ((uint64_t)(unsigned char)hit->flags<<24) | ((uint64_t)(hit->move&0xffffff)<<32) | ((uint64_t)hit->tag<<56);
 
-	if (cdexists) return;
+	atomic_store_explicit(&e->key, hash^data, memory_order_relaxed);
+	atomic_store_explicit(&e->data, data, memory_order_relaxed);
+}
 
-	superbranch_t* new_sb;
-	if (replace || vecs->sbranches_new.length==AI_LEN) {
-		if (!min) { //retain ordering
-			return;
-		}
+//key of the position at ply bdepth of the line, the least of its images' hashes; sym as ai_hash_canonical
+//salted with the variant, a table shared between games can hold the same pieces on different rules
+uint64_t ai_tt_key(move_vecs_t* vecs, unsigned bdepth, int* sym) {
+	uint64_t key = vecs->hash;
+	*sym = -1;
 
-		vector_free(&min->branches);
-		new_sb = min;
-	} else {
-		new_sb = vector_pushcpy(&vecs->sbranches_new, vecs->sbranch);
+	for (unsigned i=0; i<vecs->nsyms; i++) {
+		if (vecs->sym_hash[bdepth][i]<key) {
+			key = vecs->sym_hash[bdepth][i];
+			*sym = (int)i;
+		}
 	}
 
-	new_sb->v = v;
-	new_sb->keep=keep;
-
-	new_sb->branches = vector_new(sizeof(branch_t));
-	vector_stockcpy(&new_sb->branches, vecs->sbranch->depth+1, vecs->sbranch->branches.data);
-	if (branches) vector_stockcpy(&new_sb->branches, len_branches, branches);
-
-	new_sb->depth = new_sb->branches.length;
+	return key^vecs->variant;
 }
 
-float ai_find_move(move_vecs_t* vecs, game_t* g, float v, int depth, branch_t* best) {
-	float gain = -INFINITY;
+//stores the value of a node searched from score v, relative to v unless flagged AI_TT_ABSOLUTE
+//as the mates and tablebase values that vecs->decided marks
+void ai_tt_store_value(move_vecs_t* vecs, uint64_t key, float value, float v, unsigned char draft, char flags, unsigned move) {
+	if (~flags&AI_TT_ABSOLUTE) value -= v;
 
-	int exchange = depth >= vecs->finddepth;
-	char ally = vecs->ally;
+	ai_tt_store(vecs->tt, key, &(ai_tt_hit_t){.v=value, .draft=draft, .flags=flags, .move=move, .tag=vecs->tt_tag});
+}
 
-	int moves = 0;
+//shares the symmetries of the variant with the search, its root is the position on g
+void ai_vecs_syms(move_vecs_t* vecs, game_t* g, ai_sym_t* syms, unsigned n) {
+	vecs->syms = syms;
+	vecs->nsyms = n;
+	for (unsigned i=0; i<n; i++) vecs->sym_hash[0][i] = ai_hash_board_sym(g, vecs->ai_player, &syms[i]);
+}
 
-	unsigned bdepth = vecs->sbranch->depth + depth;
+int ai_promotes(game_t* g, piece_t* p, int to[2]) {
+	return promoteable(g, p, to) && memchr(g->promote_from.data, p->ty, g->promote_from.length)!=NULL;
+}
 
-	//space to find another move / another branch *after this one*
-	int space = bdepth+1 < vecs->maxdepth && depth+1 < AI_BRANCHDEPTH;
+float ai_eval_piece(ai_eval_t* e, piece_t* p) {
+	return e->params->piece[p->ty] + (e->team[(int)p->player] ? e->params->ally : 0);
+}
 
-	vector_iterator pmoves_iter = vector_iterate(&vecs->moves);
-	while (vector_next(&pmoves_iter)) {
-		piece_moves_t* pmoves = pmoves_iter.x;
-		if (!piece_owned(pmoves->p, g->player)) continue;
+//manhattan distance from the edge through the center
+float ai_center(game_t* g, int pos[2]) {
+	return (float)(g->board_w+g->board_h-2)/2.0f
+			- fabsf((float)pos[0]-(float)(g->board_w-1)/2.0f) - fabsf((float)pos[1]-(float)(g->board_h-1)/2.0f);
+}
 
-		vector_iterator move_iter = vector_iterate(&pmoves->moves.vec);
-		while (vector_next(&move_iter)) {
-			move_t* m = move_iter.x;
-			piece_t* target = board_get(g, m->to);
+//squares a promoting piece has moved towards promotion, 0 for others
+int ai_progress(game_t* g, piece_t* p, int pos[2]) {
+	if (memchr(g->promote_from.data, p->ty, g->promote_from.length)==NULL) return 0;
 
-			branch_t* b = vector_get(&vecs->sbranch->branches, bdepth);
-			int e = piece_edible(target);
-			if (exchange && !e) {
-				if (!moves && branch_init(g, vecs, b, bdepth, *m, 1, 0))
-					moves=1;
+	int dir[2];
+	pawn_dir(dir, p->flags);
+	return (dir[0]==1 ? pos[0] : (dir[0]==-1 ? g->board_w-1-pos[0] : 0))
+			+ (dir[1]==1 ? pos[1] : (dir[1]==-1 ? g->board_h-1-pos[1] : 0));
+}
 
-				continue;
-			}
+//signed value of whatever is on a square
+float ai_eval_square(game_t* g, ai_eval_t* e, int pos[2]) {
+	piece_t* p = board_get(g, pos);
+	if (!piece_edible(p)) return 0;
 
-			float v2 = v;
-			if (e) v2 += piece_value(g, vecs, target);
+	float v = ai_eval_piece(e, p) + e->pst[p->ty*g->board_w*g->board_h + pos_i(g, pos)]
+			+ (float)ai_progress(g, p, pos)*e->params->advance;
 
-			//make the unrealistic assumption that all enemy teams are allied, benefits are shared
-			int enter = space && fabsf(v2)<AI_MAXLOSS;
+	return e->team[(int)p->player] ? v : -v;
+}
 
-			if (!branch_init(g, vecs, b, bdepth, *m, 1, (char)enter))
-				continue;
+//squares touched by a move, the difference before and after it is made is its effect on the score
+float ai_eval_move(game_t* g, ai_eval_t* e, move_t* m) {
+	if (e->nn) return 0; //the network's output is added by branch_init
 
-			if (enter) {
-				branch_t subbest[AI_BRANCHDEPTH-depth-1];
-
-				int inv = ally != vecs->ally;
-				v2 = ai_find_move(vecs, g, inv ? -v2 : v2, depth+1, subbest);
-				if (inv) v2 *= -1;
-
-				branch_exit(g, vecs, b, bdepth);
-
-				if (depth == 0) {
-					sbranch_push(vecs, subbest, ally ? v2 : -v2, 0);
-				} else if (v2 > gain) {
-					best[0] = *b;
-					//if the same exchange is possible now (or it isnt), discard
-					if (subbest[0].m.from[0]==-1
-							|| (depth+1>=vecs->finddepth
-									&& subbest->piece_to.ty == board_get(g, subbest->m.to)->ty
-									&& valid_move(g, &subbest[0].m, 1))) {
-
-						best[1].m.from[0] = -1;
-					} else {
-						memcpy(&best[1], subbest, (AI_BRANCHDEPTH-depth-1)*sizeof(branch_t));
-					}
-				}
-			} else if (v2 > gain) {
-				if (depth == 0) {
-					//keep if there is space but abs>maxloss
-					sbranch_push(vecs, NULL, ally ? v2 : -v2, space);
-				} else if (depth+1<AI_BRANCHDEPTH) {
-					best[0] = *b;
-					best[1].m.from[0] = -1;
-				} else {
-					best[0] = *b;
-				}
-			}
+	float v = ai_eval_square(g, e, m->from) + ai_eval_square(g, e, m->to);
 
-			if (v2>gain) gain=v2;
-		}
+	if (m->castle[0]!=-1) {
+		int castle_pos[2];
+		castle_to_pos(m, castle_pos);
+		v += ai_eval_square(g, e, castle_pos);
+		if (!i2eq(m->castle, m->to)) v += ai_eval_square(g, e, m->castle);
 	}
 
-	if (exchange && (gain!=-INFINITY || moves) && gain<v) {
-		best[0].m.from[0] = -1;
-		return v;
-	} else if (gain == -INFINITY) {
-		if (depth>0) {
-			best[0].m.from[0] = -1;
-			return -checkmate_value(g, vecs);
-		} else {
-			vecs->sbranch->keep=1;
-			vecs->sbranch->v = ally ? -checkmate_value(g, vecs) : checkmate_value(g, vecs);
-			return 0;
-		}
-	} else {
-		return gain;
-	}
+	return v;
 }
 
-void ai_make_move(game_t* g, move_t* out_m) {
-	if (!g_move_vecs.init) {
-		g_move_vecs.first.branches = vector_new(sizeof(branch_t));
-		g_move_vecs.sbranches_new = vector_new(sizeof(superbranch_t));
-		g_move_vecs.moves = vector_new(sizeof(piece_moves_t));
-		g_move_vecs.init = 1;
-	}
+//material won by the player to move, known without making the move
+float ai_eval_capture(game_t* g, ai_eval_t* e, move_t* m) {
+	piece_t* from = board_get(g, m->from);
+	piece_t* to = board_get(g, m->to);
 
-	vector_clear(&g_move_vecs.first.branches);
+	float v = piece_edible(to) && m->castle[0]==-1 ? ai_eval_piece(e, to) : 0;
+	if (ai_promotes(g, from, m->to)) v += e->params->piece[g->promote_to] - e->params->piece[from->ty];
 
-	g_move_vecs.ai_player = g->player;
-	g_move_vecs.ai_p = vector_get(&g->players, g->player);
-	g_move_vecs.ally = 1;
+	return v;
+}
 
-	unsigned len = 0;
+float ai_eval_mobility(game_t* g, ai_eval_t* e) {
+	if (e->params->mobility==0) return 0;
 
-	vector_iterator pm_iter = vector_iterate(&g_move_vecs.moves);
-	while (vector_next(&pm_iter)) {
-		piece_moves_t* pmoves = pm_iter.x;
-		vector_free(&pmoves->moves.vec);
+	float v = 0;
+	for (unsigned i=0; i<g->players.length; i++) {
+		v += (float)(e->team[i] ? e->mobility[i] : -e->mobility[i]);
 	}
 
-	vector_clear(&g_move_vecs.moves);
+	return v*e->params->mobility;
+}
 
-	int pos[2] = {-1, 0};
-	while (board_pos_next(g, pos)) {
-		piece_t* p = board_get(g, pos);
-		piece_moves_t pmoves = {.p=p, .pos={pos[0], pos[1]}};
-		memset(pmoves.modified, 0, AI_MAXDEPTH);
-		pmoves.moves = vector_alloc(vector_new(sizeof(move_t)), 0);
-		piece_moves(g, p, &pmoves.moves.vec, 0);
+//value of a piece that keeps its side out of zugzwang
+float ai_eval_officer(ai_eval_t* e, piece_ty ty) {
+	return ty==p_pawn || ty==p_king ? 0 : e->params->piece[ty];
+}
 
-		len += pmoves.moves.vec.length;
+//captures and promotions, sign is 1 to make and -1 to unmake with the moved piece still on to
+void ai_eval_material(game_t* g, ai_eval_t* e, branch_t* b, piece_t* to, float sign) {
+	if (piece_edible(&b->piece_to) && b->m.castle[0]==-1)
+		e->material[(int)b->piece_to.player] -= sign*ai_eval_officer(e, b->piece_to.ty);
 
-		vector_pushcpy(&g_move_vecs.moves, &pmoves);
+	if (to->ty!=b->piece_from.ty)
+		e->material[(int)to->player] += sign*(ai_eval_officer(e, to->ty) - ai_eval_officer(e, b->piece_from.ty));
+}
+
+//out = in plus the add columns minus the sub columns, each AI_NN_HIDDEN wide
+//sums saturate instead of wrapping, a network the trainer did not clip then only loses precision, the same in every kernel
+void ai_nn_accumulate(int16_t* out, int16_t* in, int16_t** add, int nadd, int16_t** sub, int nsub) {
+#if defined(__AVX2__)
+	for (int i=0; i<AI_NN_HIDDEN; i+=16) {
+		__m256i v = _mm256_loadu_si256((__m256i*)&in[i]);
+		for (int j=0; j<nadd; j++) v = _mm256_adds_epi16(v, _mm256_loadu_si256((__m256i*)&add[j][i]));
+		for (int j=0; j<nsub; j++) v = _mm256_subs_epi16(v, _mm256_loadu_si256((__m256i*)&sub[j][i]));
+		_mm256_storeu_si256((__m256i*)&out[i], v);
+	}
+#elif defined(__SSE2__)
+	for (int i=0; i<AI_NN_HIDDEN; i+=8) {
+		__m128i v = _mm_loadu_si128((__m128i*)&in[i]);
+		for (int j=0; j<nadd; j++) v = _mm_adds_epi16(v, _mm_loadu_si128((__m128i*)&add[j][i]));
+		for (int j=0; j<nsub; j++) v = _mm_subs_epi16(v, _mm_loadu_si128((__m128i*)&sub[j][i]));
+		_mm_storeu_si128((__m128i*)&out[i], v);
+	}
+#else
+	for (int i=0; i<AI_NN_HIDDEN; i++) {
+		int v = in[i];
+		for (int j=0; j<nadd; j++) v = clamp(v + add[j][i], INT16_MIN, INT16_MAX);
+		for (int j=0; j<nsub; j++) v = clamp(v - sub[j][i], INT16_MIN, INT16_MAX);
+		out[i] = (int16_t)v;
 	}
+#endif
+}
 
-	//"depth"
-	g_move_vecs.maxdepth = maxdepth(len/g->players.length);
-	printf("len %u depth %i\n", len, g_move_vecs.maxdepth);
-	//"breadth"
-	g_move_vecs.finddepth = AI_DEPTH;
+//clipped accumulator dotted with an output's weights
+int32_t ai_nn_dot(int16_t* acc, int16_t* w) {
+#if defined(__AVX2__)
+	__m256i zero = _mm256_setzero_si256(), top = _mm256_set1_epi16(AI_NN_QA), sum = zero;
+	for (int i=0; i<AI_NN_HIDDEN; i+=16) {
+		__m256i h = _mm256_min_epi16(_mm256_max_epi16(_mm256_loadu_si256((__m256i*)&acc[i]), zero), top);
+		sum = _mm256_add_epi32(sum, _mm256_madd_epi16(h, _mm256_loadu_si256((__m256i*)&w[i])));
+	}
 
-	g_move_vecs.first.depth = 0;
-	g_move_vecs.sbranch = &g_move_vecs.first;
-	branch_push(&g_move_vecs);
+	__m128i s = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+	s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+	s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtsi128_si32(s);
+#elif defined(__SSE2__)
+	__m128i zero = _mm_setzero_si128(), top = _mm_set1_epi16(AI_NN_QA), s = zero;
+	for (int i=0; i<AI_NN_HIDDEN; i+=8) {
+		__m128i h = _mm_min_epi16(_mm_max_epi16(_mm_loadu_si128((__m128i*)&acc[i]), zero), top);
+		s = _mm_add_epi32(s, _mm_madd_epi16(h, _mm_loadu_si128((__m128i*)&w[i])));
+	}
 
-	ai_find_move(&g_move_vecs, g, 0, 0, NULL);
+	s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+	s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtsi128_si32(s);
+#else
+	int32_t sum = 0;
+	for (int i=0; i<AI_NN_HIDDEN; i++) sum += (int32_t)clamp(acc[i], 0, AI_NN_QA)*w[i];
+	return sum;
+#endif
+}
 
-	vector_t sbranches_keep = vector_new(sizeof(superbranch_t));
+float ai_nn_output(ai_eval_t* e, int16_t* acc) {
+	int32_t v = ai_nn_dot(acc, &e->nn->output[e->player*AI_NN_HIDDEN]) + e->nn->output_bias[(int)e->player];
+	return (float)v/(float)(AI_NN_QA*AI_NN_QB);
+}
 
-	int cont = 1;
-	vector_iterator sbranch_iter;
-	while (cont) {
-		g_move_vecs.sbranches = g_move_vecs.sbranches_new;
-		g_move_vecs.sbranches_new = vector_new(sizeof(superbranch_t));
+//input column of the piece on a square, NULL if nothing is there
+int16_t* ai_nn_column(game_t* g, ai_nn_t* nn, int pos[2]) {
+	piece_t* p = board_get(g, pos);
+	if (!piece_edible(p) || (uint32_t)p->ty>=nn->header->types) return NULL;
 
-		cont=0;
-		sbranch_iter = vector_iterate(&g_move_vecs.sbranches);
-		while (vector_next(&sbranch_iter)) {
-			superbranch_t* sbranch = sbranch_iter.x;
-			if (sbranch->keep) {
-				continue;
-			} else if (sbranch->branches.length >= g_move_vecs.maxdepth) {
-				sbranch->keep=1;
-				continue;
-			} else {
-				cont = 1;
-			}
+	unsigned feature = ((unsigned)p->player*nn->header->types + p->ty)*nn->header->squares + (unsigned)pos_i(g, pos);
+	return &nn->input[feature*AI_NN_HIDDEN];
+}
 
-			vector_iterator branch_iter = vector_iterate(&sbranch->branches);
+//columns of the pieces on the squares a move touches, at most 4
+int ai_nn_columns(game_t* g, ai_nn_t* nn, move_t* m, int16_t** out) {
+	int n=0;
+	if ((out[n] = ai_nn_column(g, nn, m->from))) n++;
+	if ((out[n] = ai_nn_column(g, nn, m->to))) n++;
 
-			g_move_vecs.sbranch = sbranch;
-			while (vector_next(&branch_iter)) {
-				branch_reenter(g, &g_move_vecs, branch_iter.x, branch_iter.i);
-			}
+	if (m->castle[0]!=-1) {
+		int castle_pos[2];
+		castle_to_pos(m, castle_pos);
+		if ((out[n] = ai_nn_column(g, nn, castle_pos))) n++;
+		if (!i2eq(m->castle, m->to) && (out[n] = ai_nn_column(g, nn, m->castle))) n++;
+	}
 
-			sbranch->v *= AI_DIMINISH;
-			branch_push(&g_move_vecs);
-			ai_find_move(&g_move_vecs, g, g_move_vecs.ally ? sbranch->v : -sbranch->v, 0, NULL);
-			branch_pop(&g_move_vecs);
-			sbranch->v /= AI_DIMINISH;
+	return n;
+}
 
-			while (vector_prev(&branch_iter)) {
-				branch_exit(g, &g_move_vecs, branch_iter.x, branch_iter.i);
-			}
-		}
+//accumulator of the position after the move at ply depth, from the one before it; returns its output
+float ai_nn_update(ai_eval_t* e, unsigned depth, int16_t** add, int nadd, int16_t** sub, int nsub) {
+	int16_t* acc = &e->acc[(depth+1)*AI_NN_HIDDEN];
+	ai_nn_accumulate(acc, acc-AI_NN_HIDDEN, add, nadd, sub, nsub);
+	return e->nn_score[depth+1] = ai_nn_output(e, acc);
+}
 
-		sbranch_iter = vector_iterate(&g_move_vecs.sbranches);
-		while (vector_next(&sbranch_iter)) {
-			superbranch_t* sbranch = sbranch_iter.x;
-			if (sbranch->keep) {
-				vector_pushcpy(&sbranches_keep, sbranch);
-			} else {
-				vector_free(&sbranch->branches);
-			}
-		}
+void ai_eval_init(ai_eval_t* e, game_t* g, char ai_player, player_t* ai_p, ai_eval_params_t* params) {
+	e->params = params;
+	e->nn = NULL;
+	e->player = ai_player;
+	memset(e->material, 0, sizeof(e->material));
+	memset(e->mobility, 0, sizeof(e->mobility));
 
-		vector_free(&g_move_vecs.sbranches);
+	for (unsigned i=0; i<g->players.length; i++) {
+		e->team[i] = (char)is_ally(ai_player, ai_p, (char)i);
 	}
 
-	superbranch_t* max = vector_get(&sbranches_keep, 0);
-	sbranch_iter = vector_iterate(&sbranches_keep);
+	int squares = g->board_w*g->board_h;
+	e->pst = heap(sizeof(float)*(p_blocked+1)*squares);
 
-	vector_next(&sbranch_iter);
-	while (vector_next(&sbranch_iter)) {
-		superbranch_t* sb = sbranch_iter.x;
-		if (sb->v>max->v) max=sb;
+	int pos[2] = {-1, 0};
+	while (board_pos_next(g, pos)) {
+		float center = ai_center(g, pos);
+		for (int ty=0; ty<=p_blocked; ty++) {
+			e->pst[ty*squares + pos_i(g, pos)] = center*params->center[ty];
+		}
 	}
 
-	vector_iterator branch_iter = vector_iterate(&max->branches);
+	e->score = 0;
+	pos[0] = -1; pos[1] = 0;
+	while (board_pos_next(g, pos)) {
+		piece_t* p = board_get(g, pos);
+		if (!piece_edible(p)) continue;
 
-	g_move_vecs.sbranch = max;
-	while (vector_next(&branch_iter)) {
-		branch_t* b = branch_iter.x;
-		branch_reenter(g, &g_move_vecs, b, branch_iter.i);
-		printf("%s\n", move_pgn(g, &b->m));
-		print_board(g);
+		e->material[(int)p->player] += ai_eval_officer(e, p->ty);
+		e->score += ai_eval_square(g, e, pos);
+	}
+}
+
+//evaluates with nn from here on, the accumulator of the root is summed from the board
+void ai_eval_net(ai_eval_t* e, game_t* g, ai_nn_t* nn) {
+	if (!nn || nn->header->squares!=(uint32_t)(g->board_w*g->board_h) || nn->header->players!=g->players.length) return;
+
+	e->nn = nn;
+	e->acc = heap(sizeof(int16_t)*(AI_PLIES+1)*AI_NN_HIDDEN);
+	e->nn_score = heap(sizeof(float)*(AI_PLIES+1));
+
+	int16_t* add[1];
+	memcpy(e->acc, nn->bias, sizeof(int16_t)*AI_NN_HIDDEN);
+
+	int pos[2] = {-1, 0};
+	while (board_pos_next(g, pos)) {
+		if ((add[0] = ai_nn_column(g, nn, pos))) ai_nn_accumulate(e->acc, e->acc, add, 1, NULL, 0);
+	}
+
+	e->score = e->nn_score[0] = ai_nn_output(e, e->acc);
+}
+
+void ai_eval_free(ai_eval_t* e) {
+	drop(e->pst);
+
+	if (e->nn) {
+		drop(e->acc);
+		drop(e->nn_score);
+	}
+}
+
+//regenerates moves of a square and keeps mobility and dependents in step
+void ai_moves_regen(game_t* g, move_vecs_t* vecs, unsigned i) {
+	ai_moves_t* c = &vecs->moves;
+	piece_t* p = vector_get(&g->board, i);
+	uint64_t bit = (uint64_t)1<<(i%64);
+
+	int slot = c->slot[i];
+	if (slot!=-1) {
+		uint16_t* depends = &c->depends[slot*c->cap];
+		for (int d=0; d<c->depends_len[slot]; d++) {
+			vecs->dependents[depends[d]*vecs->words + i/64] &= ~bit;
+		}
+
+		vecs->eval.mobility[(int)c->player[slot]] -= c->len[slot];
+
+		if (!piece_edible(p)) {
+			c->square[slot] = -1;
+			c->slot[i] = -1;
+			c->free[c->nfree++] = slot;
+			return;
+		}
+	} else if (!piece_edible(p)) {
+		return;
+	} else {
+		slot = c->free[--c->nfree];
+		c->slot[i] = slot;
+		c->square[slot] = (int)i;
+	}
+
+	int pos[2] = {(int)i%g->board_w, (int)i/g->board_w};
+
+	vector_clear(&c->scratch);
+	piece_moves(g, p, &c->scratch, 0);
+
+	ai_cmove_t* moves = &c->moves[slot*c->cap];
+	c->len[slot] = min((int)c->scratch.length, c->cap);
+
+	vector_iterator move_iter = vector_iterate(&c->scratch);
+	while (vector_next(&move_iter) && move_iter.i<(unsigned long)c->len[slot]) {
+		move_t* m = move_iter.x;
+		moves[move_iter.i].to = (uint16_t)pos_i(g, m->to);
+		moves[move_iter.i].castle = m->castle[0]==-1 ? AI_NOSQUARE : (uint16_t)pos_i(g, m->castle);
+	}
+
+	c->player[slot] = p->player;
+	vecs->eval.mobility[(int)p->player] += c->len[slot];
+
+	uint16_t* depends = &c->depends[slot*c->cap];
+	c->depends_len[slot] = piece_depends(g, p, pos, c->scratch_depends);
+	for (int d=0; d<c->depends_len[slot]; d++) {
+		depends[d] = (uint16_t)c->scratch_depends[d];
+		vecs->dependents[depends[d]*vecs->words + i/64] |= bit;
+	}
+}
+
+//decodes a cached move of the piece on from
+void ai_cmove_move(game_t* g, int from, ai_cmove_t* cm, move_t* m) {
+	m->from[0] = from%g->board_w;
+	m->from[1] = from/g->board_w;
+	m->to[0] = cm->to%g->board_w;
+	m->to[1] = cm->to/g->board_w;
+
+	if (cm->castle==AI_NOSQUARE) {
+		m->castle[0] = -1;
+		m->castle[1] = -1;
+	} else {
+		m->castle[0] = cm->castle%g->board_w;
+		m->castle[1] = cm->castle/g->board_w;
+	}
+}
+
+void ai_moves_init(ai_moves_t* c, game_t* g) {
+	int squares = g->board_w*g->board_h;
+	c->cap = piece_depends_max(g);
+
+	c->slots = 2;
+	int pos[2] = {-1, 0};
+	while (board_pos_next(g, pos)) {
+		if (piece_edible(board_get(g, pos))) c->slots++;
+	}
+
+	c->moves = heap(sizeof(ai_cmove_t)*c->slots*c->cap);
+	c->depends = heap(sizeof(uint16_t)*c->slots*c->cap);
+	c->len = heap(sizeof(int)*c->slots);
+	c->depends_len = heap(sizeof(int)*c->slots);
+	c->square = heap(sizeof(int)*c->slots);
+	c->player = heap(c->slots);
+	c->free = heap(sizeof(int)*c->slots);
+
+	for (int i=0; i<c->slots; i++) {
+		c->square[i] = -1;
+		c->free[i] = c->slots-1-i;
+	}
+
+	c->nfree = c->slots;
+
+	c->slot = heap(sizeof(int)*squares);
+	for (int i=0; i<squares; i++) c->slot[i] = -1;
+
+	c->scratch = vector_new(sizeof(move_t));
+	c->scratch_depends = heap(sizeof(int)*c->cap);
+}
+
+void ai_moves_free(ai_moves_t* c) {
+	drop(c->moves);
+	drop(c->depends);
+	drop(c->len);
+	drop(c->depends_len);
+	drop(c->square);
+	drop(c->player);
+	drop(c->free);
+	drop(c->slot);
+	vector_free(&c->scratch);
+	drop(c->scratch_depends);
+}
+
+//adds a square and the moves depending on it to the collection
+void ai_moves_collect(game_t* g, move_vecs_t* vecs, int pos[2]) {
+	int i = pos_i(g, pos);
+	vecs->collect[i/64] |= (uint64_t)1<<(i%64);
+
+	uint64_t* dependents = &vecs->dependents[i*vecs->words];
+	for (unsigned w=0; w<vecs->words; w++) vecs->collect[w] |= dependents[w];
+}
+
+//squares of a move and the moves depending on them, before the index is updated for it
+void ai_moves_collect_move(game_t* g, move_vecs_t* vecs, move_t* m) {
+	memset(vecs->collect, 0, sizeof(uint64_t)*vecs->words);
+	ai_moves_collect(g, vecs, m->from);
+	ai_moves_collect(g, vecs, m->to);
+
+	if (m->castle[0]!=-1) {
+		int castle_pos[2];
+		castle_to_pos(m, castle_pos);
+		ai_moves_collect(g, vecs, m->castle);
+		ai_moves_collect(g, vecs, castle_pos);
+	}
+}
+
+//player_check after a move, only trying pieces that could reach a king before it or were collected for it
+int ai_player_check(game_t* g, move_vecs_t* vecs, char p_i, player_t* player) {
+	if (g->flags & game_win_by_pieces) return 0;
+
+	for (int* king=(int*)player->kings.data; *king!=-1; king++) {
+		move_t mv = {.to={*king%g->board_w, *king/g->board_w}};
+		mv.castle[0] = -1;
+
+		uint64_t* dependents = &vecs->dependents[*king*vecs->words];
+		for (unsigned w=0; w<vecs->words; w++) {
+			for (uint64_t bits=dependents[w]|vecs->collect[w]; bits; bits &= bits-1) {
+				int i = (int)(w*64) + __builtin_ctzll(bits);
+				piece_t* p = vector_get(&g->board, i);
+				if (!piece_edible(p) || is_ally(p_i, player, p->player)) continue;
+
+				mv.from[0] = i%g->board_w;
+				mv.from[1] = i/g->board_w;
+				if (valid_move(g, &mv, 1)) return 1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+#define CHECKMATE_VAL 15.0f
+
+float checkmate_value(game_t* g, move_vecs_t* vecs) {
+	//stalemate, indesirable to either player, EXCEPT when win by pieces
+	if (!((player_t*)vector_get(&g->players, g->player))->check && ~g->flags&game_win_by_pieces)
+		return (vecs->ally ? 1.0f : -1.0f) * CHECKMATE_VAL;
+	else return CHECKMATE_VAL;
+}
+
+unsigned move_num(game_t* g, move_t* m) {
+	unsigned i = m->from[0] + m->from[1]*g->board_w + ((m->to[0] + m->to[1]*g->board_w)<<8);
+	if (m->castle[0]!=-1) {
+		i += (m->castle[0] + m->castle[1]*g->board_w)<<16;
+	}
+
+	return i;
+}
+
+int branch_init(game_t* g, move_vecs_t* vecs, branch_t* b, unsigned depth, move_t m, char make, char enter) {
+	if (make) b->m = m;
+
+	piece_t* from = board_get(g, b->m.from);
+	piece_t* to = board_get(g, b->m.to);
+
+	if (make) {
+		b->player = g->player;
+		b->ally = vecs->ally;
+
+		b->piece_from = *from;
+		b->piece_to = *to;
+	} else if (enter) { //toggle checks
+		vector_iterator p_iter = vector_iterate(&g->players);
+		while (vector_next(&p_iter)) {
+			((player_t*)p_iter.x)->check ^= b->checks[p_iter.i];
+		}
+	}
+
+	uint64_t hash = vecs->hash;
+	uint64_t sym_hash[AI_SYMS];
+	if (enter) {
+		hash ^= ai_hash_move(g, &b->m, NULL);
+		for (unsigned i=0; i<vecs->nsyms; i++) sym_hash[i] = vecs->sym_hash[depth][i] ^ ai_hash_move(g, &b->m, &vecs->syms[i]);
+	}
+
+	float eval = make ? ai_eval_move(g, &vecs->eval, &b->m) : 0;
+
+	int16_t* sub[4];
+	int nsub = vecs->eval.nn ? ai_nn_columns(g, vecs->eval.nn, &b->m, sub) : 0;
+
+	move_noswap(g, &b->m, from, to);
+	ai_moves_collect_move(g, vecs, &b->m);
+
+	if (make) {
+		vector_iterator p_iter = vector_iterate(&g->players);
+		while (vector_next(&p_iter)) {
+			player_t* p = p_iter.x;
+			char check = (char)ai_player_check(g, vecs, (char)p_iter.i, p);
+
+			if (check && p_iter.i==b->player) {
+				unmove_noswap(g, &b->m, from, to, b->piece_from, b->piece_to);
+				return 0;
+			}
+
+			b->checks[p_iter.i] = check!=p->check;
+			if (enter) p->check = check;
+		}
+
+		b->num = move_num(g, &b->m);
+		b->eval = ai_eval_move(g, &vecs->eval, &b->m) - eval;
+	}
+
+	//reentering also updates the accumulator, the next ply's may be of another line
+	if (vecs->eval.nn) {
+		int16_t* add[4];
+		int nadd = ai_nn_columns(g, vecs->eval.nn, &b->m, add);
+		float nn = ai_nn_update(&vecs->eval, depth, add, nadd, sub, nsub);
+		if (make) b->eval += nn - vecs->eval.nn_score[depth];
+	}
+
+	if (enter) {
+		hash ^= ai_hash_move(g, &b->m, NULL);
+		for (unsigned i=0; i<vecs->nsyms; i++) sym_hash[i] ^= ai_hash_move(g, &b->m, &vecs->syms[i]);
+		float mob = make ? ai_eval_mobility(g, &vecs->eval) : 0;
+
+		//collected before the move, regenerating changes the dependents
+		for (unsigned w=0; w<vecs->words; w++) {
+			for (uint64_t bits=vecs->collect[w]; bits; bits &= bits-1) {
+				unsigned i = w*64 + (unsigned)__builtin_ctzll(bits);
+				vecs->log[vecs->log_len++] = (ai_log_t){.depth=(uint16_t)depth, .square=(uint16_t)i};
+				ai_moves_regen(g, vecs, i);
+				vecs->regens++;
+			}
+		}
+
+		if (make) b->eval += ai_eval_mobility(g, &vecs->eval) - mob;
+		vecs->eval.score += b->eval;
+		ai_eval_material(g, &vecs->eval, b, to, 1);
+
+		next_player(g);
+		vecs->ally = (char)is_ally(vecs->ai_player, vecs->ai_p, g->player);
+
+		b->hash_prev = vecs->hash;
+		vecs->hash = hash ^ ai_player_key(b->player) ^ ai_player_key(g->player);
+
+		for (unsigned i=0; i<vecs->nsyms; i++) {
+			ai_sym_t* sym = &vecs->syms[i];
+			vecs->sym_hash[depth+1][i] = sym_hash[i] ^ ai_player_key(sym->player[(int)b->player]) ^ ai_player_key(sym->player[(int)g->player]);
+		}
+	} else {
+		unmove_noswap(g, &b->m, from, to, b->piece_from, b->piece_to);
+	}
+
+	return 1;
+}
+
+void branch_reenter(game_t* g, move_vecs_t* vecs, branch_t* b, unsigned depth) {
+	branch_init(g, vecs, b, depth, (move_t) {0}, 0, 1);
+}
+
+void branch_exit(game_t* g, move_vecs_t* vecs, branch_t* b, unsigned depth) {
+	piece_t* from = board_get(g, b->m.from);
+	piece_t* to = board_get(g, b->m.to);
+
+	vecs->eval.score -= b->eval;
+	ai_eval_material(g, &vecs->eval, b, to, -1);
+
+	unmove_noswap(g, &b->m, from, to, b->piece_from, b->piece_to);
+
+	while (vecs->log_len>0 && vecs->log[vecs->log_len-1].depth==depth) {
+		ai_moves_regen(g, vecs, vecs->log[--vecs->log_len].square);
+	}
+
+	vector_iterator p_iter = vector_iterate(&g->players);
+	while (vector_next(&p_iter)) {
+		((player_t*)p_iter.x)->check ^= b->checks[p_iter.i];
+	}
+
+	g->player = b->player;
+	vecs->ally = b->ally;
+	vecs->hash = b->hash_prev;
+}
+
+unsigned ai_hash_branches(branch_t* branches, unsigned l) {
+	unsigned x=1;
+	for (unsigned i = 0; i<l; i++) {
+		if (branches[i].m.from[0] == -1) break;
+		x *= branches[i].m.from[0]+branches[i].m.from[1] + 1;
+		x *= branches[i].m.to[0]+branches[i].m.to[1] + 1;
+	}
+
+	return x;
+}
+
+//doubles the pool once every line is in use, lines are referred to by index so they can move
+void ai_lines_grow(move_vecs_t* vecs) {
+	int cap = vecs->lines_cap*2;
+	ai_line_t* lines = heap(sizeof(ai_line_t)*cap);
+	memcpy(lines, vecs->lines, sizeof(ai_line_t)*vecs->lines_cap);
+	drop(vecs->lines);
+	vecs->lines = lines;
+
+	drop(vecs->lines_free);
+	vecs->lines_free = heap(sizeof(int)*cap);
+	vecs->nlines_free = cap-vecs->lines_cap;
+	for (int i=0; i<vecs->nlines_free; i++) vecs->lines_free[i] = cap-1-i;
+	vecs->lines_cap = cap;
+}
+
+int ai_line_push(move_vecs_t* vecs, int parent, branch_t* b) {
+	if (vecs->nlines_free==0) ai_lines_grow(vecs);
+
+	int i = vecs->lines_free[--vecs->nlines_free];
+	vecs->lines[i] = (ai_line_t){.b=*b, .parent=parent, .refs=0};
+	if (parent!=-1) vecs->lines[parent].refs++;
+	return i;
+}
+
+void ai_line_release(move_vecs_t* vecs, int i) {
+	while (i!=-1 && --vecs->lines[i].refs==0) {
+		vecs->lines_free[vecs->nlines_free++] = i;
+		i = vecs->lines[i].parent;
+	}
+}
+
+//copies the moves of a superbranch into the current line, returns its depth
+unsigned ai_line_get(move_vecs_t* vecs, superbranch_t* sb) {
+	unsigned d = sb->depth;
+	for (int i=sb->line; i!=-1; i=vecs->lines[i].parent) {
+		vecs->line[--d] = vecs->lines[i].b;
+	}
+
+	return sb->depth;
+}
+
+void sbranch_push(move_vecs_t* vecs, branch_t* branches, float v, char keep) {
+	unsigned char len_branches = branches ? AI_DEPTH-1 : 0;
+	for (unsigned char i = 0; i < len_branches; i++) {
+		if (branches[i].m.from[0] == -1) {
+			len_branches = i;
+			break;
+		}
+	}
+
+	unsigned depth = vecs->sbranch->depth;
+	unsigned l = depth+1+len_branches;
+
+	//pushed line, the current one followed by the best reply
+	branch_t* pushed[AI_PLIES];
+	for (unsigned cd=0; cd<l; cd++) {
+		pushed[cd] = cd<=depth ? &vecs->line[cd] : &branches[cd-depth-1];
+	}
+
+	//do not insert multiple enemy branches
+	char cdexists=0;
+	superbranch_t* min=NULL;
+	int replace=0;
+
+	for (unsigned sb_i=0; sb_i<vecs->sbranches_new_len; sb_i++) {
+		superbranch_t* sb = &vecs->sbranches_new[sb_i];
+
+		branch_t* sb_line[AI_PLIES];
+		unsigned d = sb->depth;
+		for (int i=sb->line; i!=-1; i=vecs->lines[i].parent) {
+			sb_line[--d] = &vecs->lines[i].b;
+		}
+
+		char ally=1;
+
+		unsigned most = sb->depth<l?sb->depth:l;
+
+		for (unsigned cd=0; cd<most; cd++) {
+			ally=sb_line[cd]->ally;
+			if (sb_line[cd]->num!=pushed[cd]->num) break;
+		}
+
+		if (ally ? v>sb->v : v<sb->v) {
+			min = sb;
+			replace = !ally;
+		} else if (!ally) {
+			cdexists=1;
+			break;
+		}
+	}
+
+	if (cdexists) return;
+
+	superbranch_t* new_sb;
+	if (replace || vecs->sbranches_new_len==vecs->beam_len) {
+		if (!min) { //retain ordering
+			return;
+		}
+
+		ai_line_release(vecs, min->line);
+		new_sb = min;
+	} else {
+		new_sb = &vecs->sbranches_new[vecs->sbranches_new_len++];
+	}
+
+	new_sb->v = v;
+	new_sb->keep=keep;
+	new_sb->depth = l;
+
+	//the plies before depth are shared with the superbranch being extended
+	new_sb->line = vecs->sbranch->line;
+	for (unsigned cd=depth; cd<l; cd++) {
+		new_sb->line = ai_line_push(vecs, new_sb->line, pushed[cd]);
+	}
+
+	vecs->lines[new_sb->line].refs++;
+}
+
+int* ai_history(game_t* g, move_vecs_t* vecs, piece_ty ty, int to[2]) {
+	return &vecs->history[ty*g->board_w*g->board_h + pos_i(g, to)];
+}
+
+//captures only generates the moves taking an edible piece or promoting
+void ai_order_moves(game_t* g, move_vecs_t* vecs, ai_order_t* order, unsigned bdepth, unsigned tt_move, char captures) {
+	order->length = 0;
+
+	//in board order rather than by slot, so ties do not depend on the line searched before
+	ai_moves_t* c = &vecs->moves;
+	for (int sq=0; sq<g->board_w*g->board_h; sq++) {
+		int slot = c->slot[sq];
+		if (slot==-1) continue;
+
+		piece_t* p = vector_get(&g->board, sq);
+		if (!piece_owned(p, g->player)) continue;
+
+		ai_cmove_t* moves = &c->moves[slot*c->cap];
+		for (int i=0; i<c->len[slot]; i++) {
+			move_t mv;
+			ai_cmove_move(g, sq, &moves[i], &mv);
+			move_t* m = &mv;
+
+			piece_t* target = board_get(g, m->to);
+			int capture = piece_edible(target) && m->castle[0]==-1;
+			int promotes = ai_promotes(g, p, m->to);
+			if (captures && !capture && !promotes) continue;
+
+			unsigned num = move_num(g, m);
+
+			ai_move_t* om = &order->moves[order->length++];
+			om->m = *m;
+
+			if (num==tt_move) {
+				om->score = AI_ORDER_TT;
+			} else if (capture || promotes) { //mvv-lva
+				om->score = AI_ORDER_CAPTURE + (int)(ai_eval_capture(g, &vecs->eval, m)*AI_ORDER_MVV) - (int)piecety_value(p->ty);
+			} else if (num==vecs->killers[bdepth][0]) {
+				om->score = AI_ORDER_KILLER;
+			} else if (num==vecs->killers[bdepth][1]) {
+				om->score = AI_ORDER_KILLER-1;
+			} else {
+				om->score = *ai_history(g, vecs, p->ty, m->to);
+			}
+		}
+	}
+}
+
+//selection sort as we go, most nodes cut off after a few moves
+ai_move_t* ai_order_next(ai_order_t* order, unsigned i) {
+	ai_move_t* moves = order->moves;
+	unsigned best = i;
+	for (unsigned j=i+1; j<order->length; j++) {
+		if (moves[j].score>moves[best].score) best=j;
+	}
+
+	ai_move_t tmp = moves[i];
+	moves[i] = moves[best];
+	moves[best] = tmp;
+	return &moves[i];
+}
+
+void ai_cutoff(game_t* g, move_vecs_t* vecs, branch_t* b, unsigned bdepth, int plies) {
+	if (piece_edible(&b->piece_to)) return;
+
+	if (vecs->killers[bdepth][0]!=b->num) {
+		vecs->killers[bdepth][1] = vecs->killers[bdepth][0];
+		vecs->killers[bdepth][0] = b->num;
+	}
+
+	int* h = ai_history(g, vecs, b->piece_from.ty, b->m.to);
+	*h += plies*plies;
+
+	if (*h>=AI_ORDER_KILLER/2) { //age everything so history stays under killers
+		for (int i=0; i<(p_blocked+1)*g->board_w*g->board_h; i++) vecs->history[i] /= 2;
+	}
+}
+
+void ai_node(move_vecs_t* vecs, unsigned bdepth) {
+	vecs->nodes++;
+	vecs->ply_nodes[min(bdepth, AI_PLIES-1)]++;
+}
+
+int ai_stopped(move_vecs_t* vecs) {
+	if (vecs->stop && atomic_load_explicit(vecs->stop, memory_order_relaxed)) vecs->aborted=1;
+	if (vecs->cancel && atomic_load_explicit(vecs->cancel, memory_order_relaxed)) vecs->aborted=1;
+	if (vecs->max_nodes && vecs->nodes>=vecs->max_nodes) vecs->aborted=1;
+
+	if ((vecs->deadline>0 || vecs->deadline_ref) && vecs->nodes>=vecs->next_check) {
+		vecs->next_check = vecs->nodes+AI_CLOCK_NODES;
+
+		double now = ai_time();
+		if (vecs->deadline>0 && now>=vecs->deadline) vecs->aborted=1;
+		if (vecs->deadline_ref) {
+			double deadline = atomic_load_explicit(vecs->deadline_ref, memory_order_relaxed);
+			if (deadline>0 && now>=deadline) vecs->aborted=1;
+		}
+	}
+
+	return vecs->aborted;
+}
+
+//maps the file at path read only, NULL if it can not be read
+void* ai_map(char* path, size_t* size) {
+	int fd = open(path, O_RDONLY);
+	if (fd<0) return NULL;
+
+	struct stat st;
+	if (fstat(fd, &st)<0 || st.st_size==0) {
+		close(fd);
+		return NULL;
+	}
+
+	void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (data==MAP_FAILED) return NULL;
+
+	*size = (size_t)st.st_size;
+	return data;
+}
+
+//opens every file in dir ending in ext, returns how many open took
+unsigned ai_open_dir(char* dir, char* ext, int (*open_file)(char* path)) {
+	DIR* d = opendir(dir);
+	if (!d) return 0;
+
+	unsigned opened=0;
+	size_t ext_len = strlen(ext);
+
+	struct dirent* ent;
+	while ((ent=readdir(d))) {
+		size_t len = strlen(ent->d_name);
+		if (len<=ext_len || !streq(ent->d_name+len-ext_len, ext)) continue;
+
+		char* path = heapstr("%s/%s", dir, ent->d_name);
+		if (open_file(path)) opened++;
+		else fprintf(stderr, "could not open %s\n", path);
+
+		drop(path);
+	}
+
+	closedir(d);
+	return opened;
+}
+
+//evaluation parameters of a variant, written by termchess_tune
+//a line per parameter, "<name> <value>" with the names selfplay configs use, and "variant <hex>"
+//parameters a file leaves out keep their value from g_ai_eval
+
+typedef struct {
+	uint64_t variant;
+	ai_eval_params_t params;
+} ai_eval_file_t;
+
+ai_eval_file_t g_ai_evals[AI_EVALS];
+unsigned g_ai_evals_len = 0;
+
+//parameter named key, with center.<piece> for the center terms, NULL if there is none
+float* ai_eval_param(ai_eval_params_t* params, char* key) {
+	if (streq(key, "ally")) return &params->ally;
+	if (streq(key, "advance")) return &params->advance;
+	if (streq(key, "mobility")) return &params->mobility;
+	if (streq(key, "null")) return &params->null;
+	if (streq(key, "null.material")) return &params->null_material;
+	if (streq(key, "lmr")) return &params->lmr;
+
+	float* values = params->piece;
+	if (strncmp(key, "center.", 7)==0) {
+		key += 7;
+		values = params->center;
+	}
+
+	if (!*key) return NULL;
+	for (int ty=0; ty<p_empty; ty++) {
+		if (strncasecmp(key, PIECE_NAME[ty], strlen(key))==0) return &values[ty];
+	}
+
+	return NULL;
+}
+
+int ai_eval_read(char* path, uint64_t* variant, ai_eval_params_t* out) {
+	FILE* f = fopen(path, "r");
+	if (!f) return 0;
+
+	*out = g_ai_eval;
+	*variant = 0;
+
+	int ok = 1;
+	char key[64];
+	char value[64];
+	while (ok && fscanf(f, "%63s %63s", key, value)==2) {
+		float* param;
+		if (streq(key, "variant")) *variant = strtoull(value, NULL, 16);
+		else if ((param=ai_eval_param(out, key))) *param = (float)atof(value);
+		else ok = 0;
+	}
+
+	fclose(f);
+	return ok && *variant!=0;
+}
+
+long ai_eval_write(char* path, uint64_t variant, ai_eval_params_t* params) {
+	FILE* f = fopen(path, "w");
+	if (!f) return -1;
+
+	fprintf(f, "variant %016llx\n", (unsigned long long)variant);
+	for (int ty=0; ty<p_empty; ty++) {
+		fprintf(f, "%.*s %g\n", (int)strcspn(PIECE_NAME[ty], "/"), PIECE_NAME[ty], params->piece[ty]);
+	}
+
+	for (int ty=0; ty<p_empty; ty++) {
+		fprintf(f, "center.%.*s %g\n", (int)strcspn(PIECE_NAME[ty], "/"), PIECE_NAME[ty], params->center[ty]);
+	}
+
+	fprintf(f, "ally %g\nadvance %g\nmobility %g\n", params->ally, params->advance, params->mobility);
+	fprintf(f, "null %g\nnull.material %g\nlmr %g\n", params->null, params->null_material, params->lmr);
+
+	long len = ftell(f);
+	return fclose(f)==0 ? len : -1;
+}
+
+int ai_eval_open(char* path) {
+	if (g_ai_evals_len==AI_EVALS) return 0;
+
+	ai_eval_file_t* e = &g_ai_evals[g_ai_evals_len];
+	if (!ai_eval_read(path, &e->variant, &e->params)) return 0;
+
+	g_ai_evals_len++;
+	return 1;
+}
+
+//opens every .eval file in dir, returns how many were read
+unsigned ai_evals_open(char* dir) {
+	return ai_open_dir(dir, ".eval", ai_eval_open);
+}
+
+//parameters of a search, the caller's, then the variant's file, then g_ai_eval
+ai_eval_params_t* ai_eval_params(ai_settings_t* settings, uint64_t variant) {
+	if (settings->eval) return settings->eval;
+
+	for (unsigned i=0; i<g_ai_evals_len; i++) {
+		if (g_ai_evals[i].variant==variant) return &g_ai_evals[i].params;
+	}
+
+	return &g_ai_eval;
+}
+
+//endgame tablebases, the outcome of every position of a few pieces on a variant's board, written by termchess_tbgen
+//a table holds one material, indexed by the side to move and then the square of each piece, sorted by player and type
+//a value is 0 for a draw, otherwise the plies to mate plus one, odd when the side to move is the one mated
+//only two player variants without pawns have tables, so nothing promotes and the tables of captures are smaller
+//castling is left out, positions where a king could still castle are not probed
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t variant;
+	uint32_t squares;
+	uint32_t pieces;
+	uint8_t ty[AI_TB_MAXPIECES];
+	uint8_t player[AI_TB_MAXPIECES];
+	uint32_t reserved;
+	uint64_t len;
+} ai_tb_header_t;
+
+typedef struct {
+	uint8_t ty;
+	uint8_t player;
+	uint16_t sq;
+} ai_tb_piece_t;
+
+typedef struct {
+	void* data;
+	size_t size;
+	ai_tb_header_t* header;
+	uint8_t* values;
+} ai_tb_t;
+
+ai_tb_t g_ai_tbs[AI_TBS];
+unsigned g_ai_tbs_len = 0;
+
+//maps the table at path, returns 0 if it can not be read or is not a table
+int ai_tb_open(char* path) {
+	if (g_ai_tbs_len==AI_TBS) return 0;
+
+	size_t size;
+	void* data = ai_map(path, &size);
+	if (!data) return 0;
+
+	ai_tb_header_t* header = data;
+	if (size<sizeof(ai_tb_header_t) || header->magic!=AI_TB_MAGIC || header->version!=AI_TB_VERSION
+			|| header->pieces>AI_TB_MAXPIECES || header->len > size-sizeof(ai_tb_header_t)) {
+		munmap(data, size);
+		return 0;
+	}
+
+	g_ai_tbs[g_ai_tbs_len++] = (ai_tb_t){.data=data, .size=size, .header=header, .values=(uint8_t*)(header+1)};
+	return 1;
+}
+
+//opens every .tb file in dir, returns how many were tables
+unsigned ai_tbs_open(char* dir) {
+	return ai_open_dir(dir, ".tb", ai_tb_open);
+}
+
+void ai_tbs_close() {
+	for (unsigned i=0; i<g_ai_tbs_len; i++) munmap(g_ai_tbs[i].data, g_ai_tbs[i].size);
+	g_ai_tbs_len = 0;
+}
+
+//most pieces in a table of the variant, 0 without one
+int ai_tb_pieces(uint64_t variant) {
+	int most=0;
+	for (unsigned i=0; i<g_ai_tbs_len; i++) {
+		if (g_ai_tbs[i].header->variant==variant && (int)g_ai_tbs[i].header->pieces>most) most = (int)g_ai_tbs[i].header->pieces;
+	}
+
+	return most;
+}
+
+//the order of the pieces in a table
+void ai_tb_sort(ai_tb_piece_t* pieces, int n) {
+	for (int i=1; i<n; i++) {
+		for (int j=i; j>0 && (pieces[j].player<pieces[j-1].player
+				|| (pieces[j].player==pieces[j-1].player && pieces[j].ty<pieces[j-1].ty)); j--) {
+			ai_tb_piece_t tmp = pieces[j];
+			pieces[j] = pieces[j-1];
+			pieces[j-1] = tmp;
+		}
+	}
+}
+
+uint64_t ai_tb_index(ai_tb_piece_t* pieces, int n, unsigned squares, char player) {
+	uint64_t i = (uint64_t)player;
+	for (int p=0; p<n; p++) i = i*squares + pieces[p].sq;
+	return i;
+}
+
+//value of the position of sorted pieces, -1 without a table for their material
+int ai_tb_value(uint64_t variant, unsigned squares, char player, ai_tb_piece_t* pieces, int n) {
+	for (unsigned t=0; t<g_ai_tbs_len; t++) {
+		ai_tb_header_t* h = g_ai_tbs[t].header;
+		if (h->variant!=variant || h->squares!=squares || (int)h->pieces!=n) continue;
+
+		int p=0;
+		while (p<n && h->ty[p]==pieces[p].ty && h->player[p]==pieces[p].player) p++;
+		if (p<n) continue;
+
+		uint64_t i = ai_tb_index(pieces, n, squares, player);
+		return i<h->len ? g_ai_tbs[t].values[i] : -1;
+	}
+
+	return -1;
+}
+
+//adds the piece on square i, returns 0 if the position can not be in a table
+int ai_tb_add(game_t* g, int i, ai_tb_piece_t* pieces, int* n, int max, char* castle) {
+	piece_t* p = vector_get(&g->board, i);
+	if (!piece_edible(p)) return 1;
+	if (*n==max || p->ty==p_pawn || p->player<0 || p->player>1) return 0;
+
+	//an unmoved king and a piece it can castle with
+	if (p->flags&piece_firstmv && (p->ty==p_king || memchr(g->castleable.data, p->ty, g->castleable.length))) {
+		castle[(int)p->player] |= p->ty==p_king ? 1 : 2;
+		if (castle[(int)p->player]==3) return 0;
+	}
+
+	pieces[(*n)++] = (ai_tb_piece_t){.ty=(uint8_t)p->ty, .player=(uint8_t)p->player, .sq=(uint16_t)i};
+	return 1;
+}
+
+//value of g's position, -1 without a table for it
+int ai_tb_probe(game_t* g, uint64_t variant) {
+	if (g_ai_tbs_len==0 || g->players.length!=2) return -1;
+
+	ai_tb_piece_t pieces[AI_TB_MAXPIECES];
+	int n=0;
+	char castle[2] = {0,0};
+
+	for (int i=0; i<g->board_w*g->board_h; i++) {
+		if (!ai_tb_add(g, i, pieces, &n, AI_TB_MAXPIECES, castle)) return -1;
+	}
+
+	ai_tb_sort(pieces, n);
+	return ai_tb_value(variant, (unsigned)(g->board_w*g->board_h), g->player, pieces, n);
+}
+
+//a value from the perspective of the player to move, a nearer mate being worth more
+float ai_tb_score(int v) {
+	float mate = CHECKMATE_VAL - AI_TB_PLY*(float)(v-1);
+	return v%2 ? -mate : mate;
+}
+
+//the move to the best outcome by the tables, the quickest win, a draw or the slowest loss
+//returns 0 when the position or one after a move has no table
+int ai_tb_move(game_t* g, uint64_t variant, move_t* out, int* out_v) {
+	if (ai_tb_probe(g, variant)<0) return 0;
+
+	vector_t moves = vector_new(sizeof(move_t));
+	vector_iterator p_iter = vector_iterate(&g->board);
+	while (vector_next(&p_iter)) {
+		piece_t* p = p_iter.x;
+		if (piece_edible(p) && piece_owned(p, g->player)) piece_moves(g, p, &moves, 1);
+	}
+
+	//ranked by the value after the move, for the opponent
+	int found=0, best_rank=0;
+	vector_iterator m_iter = vector_iterate(&moves);
+	while (vector_next(&m_iter)) {
+		game_t next = game_copy(g);
+		make_move(&next, m_iter.x, 0, 1, next.player);
+
+		int v = next.won ? 1 : ai_tb_probe(&next, variant);
+		game_free(&next);
+
+		if (v<0) {
+			found = 0;
+			break;
+		}
+
+		int rank = v==0 ? 0 : v%2 ? 512-v : v-512;
+		if (!found || rank>best_rank) {
+			*out = *(move_t*)m_iter.x;
+			*out_v = v==0 ? 0 : v+1;
+			best_rank = rank;
+			found = 1;
+		}
+	}
+
+	vector_free(&moves);
+	return found;
+}
+
+//tablebase value of the position being searched, -1 if it has too many pieces or no table
+//draws are left to the search, its values are relative to the root and a draw has no place among them
+int ai_tb_probe_vecs(move_vecs_t* vecs, game_t* g) {
+	ai_moves_t* c = &vecs->moves;
+	if (c->slots-c->nfree > vecs->tb_pieces) return -1;
+
+	ai_tb_piece_t pieces[AI_TB_MAXPIECES];
+	int n=0;
+	char castle[2] = {0,0};
+
+	for (int slot=0; slot<c->slots; slot++) {
+		if (c->square[slot]!=-1 && !ai_tb_add(g, c->square[slot], pieces, &n, vecs->tb_pieces, castle)) return -1;
+	}
+
+	ai_tb_sort(pieces, n);
+	int v = ai_tb_value(vecs->variant, (unsigned)(g->board_w*g->board_h), g->player, pieces, n);
+	if (v>0) vecs->tb_hits++;
+	return v;
+}
+
+ai_nn_t g_ai_nns[AI_NNS];
+unsigned g_ai_nns_len = 0;
+
+//maps the network at path, returns 0 if it can not be read, is not a network or is of another width
+int ai_nn_open(char* path) {
+	if (g_ai_nns_len==AI_NNS) return 0;
+
+	size_t size;
+	void* data = ai_map(path, &size);
+	if (!data) return 0;
+
+	ai_nn_header_t* h = data;
+	if (size<sizeof(ai_nn_header_t) || h->magic!=AI_NN_MAGIC || h->version!=AI_NN_VERSION || h->hidden!=AI_NN_HIDDEN
+			|| h->players>AI_MAXPLAYER || h->types>p_empty
+			|| size != sizeof(ai_nn_header_t) + sizeof(int16_t)*AI_NN_HIDDEN*(1+(size_t)h->players*h->types*h->squares+h->players)
+				+ sizeof(int32_t)*h->players) {
+		munmap(data, size);
+		return 0;
+	}
+
+	ai_nn_t* nn = &g_ai_nns[g_ai_nns_len++];
+	*nn = (ai_nn_t){.data=data, .size=size, .header=h, .bias=(int16_t*)(h+1)};
+	nn->input = nn->bias + AI_NN_HIDDEN;
+	nn->output = nn->input + (size_t)h->players*h->types*h->squares*AI_NN_HIDDEN;
+	nn->output_bias = (int32_t*)(nn->output + h->players*AI_NN_HIDDEN);
+	return 1;
+}
+
+//opens every .nn file in dir, returns how many were networks
+unsigned ai_nns_open(char* dir) {
+	return ai_open_dir(dir, ".nn", ai_nn_open);
+}
+
+void ai_nns_close() {
+	for (unsigned i=0; i<g_ai_nns_len; i++) munmap(g_ai_nns[i].data, g_ai_nns[i].size);
+	g_ai_nns_len = 0;
+}
+
+ai_nn_t* ai_nn_find(uint64_t variant) {
+	for (unsigned i=0; i<g_ai_nns_len; i++) {
+		if (g_ai_nns[i].header->variant==variant) return &g_ai_nns[i];
+	}
+
+	return NULL;
+}
+
+//resolves captures past the horizon so the line is not cut in the middle of an exchange
+//the player to move may stand pat on v unless in check, then every move is searched
+float ai_quiesce(move_vecs_t* vecs, game_t* g, float v, float alpha, float beta, unsigned bdepth, int qdepth) {
+	vecs->decided = 0;
+	if (ai_stopped(vecs)) return v;
+
+	if (vecs->tb_pieces) {
+		int tb = ai_tb_probe_vecs(vecs, g);
+		if (tb>0) {
+			vecs->decided = 1;
+			return ai_tb_score(tb);
+		}
+	}
+
+	char ally = vecs->ally;
+	char check = ((player_t*)vector_get(&g->players, g->player))->check;
+
+	float gain = -INFINITY;
+	char gain_decided = 0;
+	if (!check || qdepth>=AI_QDEPTH) {
+		gain = v;
+		if (gain>=beta || qdepth>=AI_QDEPTH) return gain;
+		if (gain>alpha) alpha=gain;
+	}
+
+	ai_order_t* order = &vecs->order[AI_DEPTH+qdepth];
+	ai_order_moves(g, vecs, order, bdepth, 0, (char)!check);
+
+	for (unsigned order_i=0; order_i<order->length; order_i++) {
+		move_t* m = &ai_order_next(order, order_i)->m;
+
+		float v2 = v + ai_eval_capture(g, &vecs->eval, m);
+		if (!check && v2+AI_DELTA<=alpha) continue;
+
+		branch_t b;
+		int enter = fabsf(v2)<AI_MAXLOSS;
+		if (!branch_init(g, vecs, &b, bdepth, *m, 1, (char)enter))
+			continue;
+
+		ai_node(vecs, bdepth);
+		v2 = v + (ally ? b.eval : -b.eval);
+
+		char decided = 0;
+		if (enter) {
+			int inv = ally != vecs->ally;
+			v2 = inv ? -ai_quiesce(vecs, g, -v2, -beta, -alpha, bdepth+1, qdepth+1)
+					: ai_quiesce(vecs, g, v2, alpha, beta, bdepth+1, qdepth+1);
+			decided = vecs->decided;
+
+			branch_exit(g, vecs, &b, bdepth);
+		}
+
+		if (v2>gain) {
+			gain=v2;
+			gain_decided=decided;
+		}
+
+		if (gain>alpha) alpha=gain;
+		if (alpha>=beta) break;
+	}
+
+	//only when in check
+	if (gain == -INFINITY) {
+		vecs->decided = 1;
+		return -checkmate_value(g, vecs);
+	}
+
+	vecs->decided = gain_decided;
+	return gain;
+}
+
+int ai_excluded(move_vecs_t* vecs, move_t* m) {
+	for (unsigned i=0; i<vecs->exclude_len; i++) {
+		if (!memcmp(&vecs->exclude[i], m, sizeof(move_t))) return 1;
+	}
+
+	return 0;
+}
+
+//value for the player to move if it passed and the next player resolved its captures, only asks whether it reaches beta
+//-INFINITY where a pass is not tried: in check, short of material, or with an ally moving next
+float ai_null_move(move_vecs_t* vecs, game_t* g, float v, float beta, unsigned bdepth) {
+	ai_eval_params_t* params = vecs->eval.params;
+	char player = g->player;
+	if (((player_t*)vector_get(&g->players, player))->check || vecs->eval.material[(int)player]<params->null_material)
+		return -INFINITY;
+
+	char ally = vecs->ally;
+	next_player(g);
+
+	char next_ally = (char)is_ally(vecs->ai_player, vecs->ai_p, g->player);
+	if (g->won || next_ally==ally) {
+		g->won = 0;
+		g->player = player;
+		return -INFINITY;
+	}
+
+	uint64_t hash = vecs->hash;
+	vecs->hash ^= ai_player_key(player) ^ ai_player_key(g->player);
+	vecs->ally = next_ally;
+
+	for (unsigned i=0; i<vecs->nsyms; i++) {
+		ai_sym_t* sym = &vecs->syms[i];
+		vecs->sym_hash[bdepth+1][i] = vecs->sym_hash[bdepth][i] ^ ai_player_key(sym->player[(int)player]) ^ ai_player_key(sym->player[(int)g->player]);
+	}
+
+	if (vecs->eval.nn) {
+		memcpy(&vecs->eval.acc[(bdepth+1)*AI_NN_HIDDEN], &vecs->eval.acc[bdepth*AI_NN_HIDDEN], sizeof(int16_t)*AI_NN_HIDDEN);
+		vecs->eval.nn_score[bdepth+1] = vecs->eval.nn_score[bdepth];
+	}
+
+	//a null window just above -beta rather than an empty one at it, so every capture is tried until one refutes the pass
+	float nv = -ai_quiesce(vecs, g, -v, -beta, nextafterf(-beta, INFINITY), bdepth+1, 0);
+
+	g->player = player;
+	vecs->ally = ally;
+	vecs->hash = hash;
+	return nv;
+}
+
+//value a line has to beat to enter the beam, -INFINITY while there is room
+float ai_beam_floor(move_vecs_t* vecs) {
+	if (vecs->sbranches_new_len<vecs->beam_len) return -INFINITY;
+
+	float floor = INFINITY;
+	for (unsigned i=0; i<vecs->sbranches_new_len; i++) {
+		if (vecs->sbranches_new[i].v<floor) floor = vecs->sbranches_new[i].v;
+	}
+
+	return floor;
+}
+
+//alpha and beta are from the perspective of the player to move. every move at depth 0 is pushed to the beam with its value,
+//those of the ai's team need only be refuted below the beam's floor and those of an enemy below its best
+float ai_find_move(move_vecs_t* vecs, game_t* g, float v, float alpha, float beta, int depth, branch_t* best) {
+	float gain = -INFINITY;
+
+	char ally = vecs->ally;
+
+	unsigned bdepth = vecs->sbranch->depth + depth;
+
+	//space to find another move / another branch *after this one*, otherwise quiesce
+	int space = bdepth+1 < vecs->maxdepth && depth+1 < AI_DEPTH;
+
+	vecs->decided = 0;
+	if (ai_stopped(vecs)) {
+		if (depth>0) best[0].m.from[0] = -1;
+		return v;
+	}
+
+	if (vecs->tb_pieces && depth>0) {
+		int tb = ai_tb_probe_vecs(vecs, g);
+		if (tb>0) {
+			best[0].m.from[0] = -1;
+			vecs->decided = 1;
+			return ai_tb_score(tb);
+		}
+	}
+
+	//the root of each superbranch is pushed as a whole, only the plies below it are cached
+	unsigned char draft = (unsigned char)min(AI_DEPTH-depth, vecs->maxdepth-(int)bdepth);
+	float alpha_orig = alpha;
+
+	int sym;
+	uint64_t key = ai_tt_key(vecs, bdepth, &sym);
+
+	ai_tt_hit_t hit = {.move=0};
+	int found = ai_tt_probe(vecs->tt, key, &hit);
+	vecs->tt_probes++;
+	if (found) vecs->tt_hits++;
+	if (found && hit.tag!=vecs->tt_tag) vecs->tt_shared_hits++;
+	if (found && sym!=-1 && hit.move) hit.move = ai_sym_num(&vecs->syms[sym], hit.move, 1);
+
+	if (found && depth>0 && hit.draft==draft) {
+		float tt_v = hit.flags&AI_TT_ABSOLUTE ? hit.v : v+hit.v;
+		if ((~hit.flags&(AI_TT_LOWER|AI_TT_UPPER))
+				|| (hit.flags&AI_TT_LOWER && tt_v>=beta) || (hit.flags&AI_TT_UPPER && tt_v<=alpha)) {
+			best[0].m.from[0] = -1;
+			vecs->decided = (char)(hit.flags&AI_TT_ABSOLUTE);
+			return tt_v;
+		}
+	}
+
+	ai_eval_params_t* params = vecs->eval.params;
+
+	//the player to move would still reach beta after passing, so one of its moves should too
+	if (params->null!=0 && depth>0 && !space && beta<INFINITY && v>=beta) {
+		float nv = ai_null_move(vecs, g, v, beta, bdepth);
+		if (nv>=beta) {
+			best[0].m.from[0] = -1;
+			if (!vecs->aborted) {
+				unsigned move = sym!=-1 && hit.move ? ai_sym_num(&vecs->syms[sym], hit.move, 0) : hit.move;
+				ai_tt_store_value(vecs, key, nv, v, draft, AI_TT_LOWER | (vecs->decided ? AI_TT_ABSOLUTE : 0), move);
+			}
+
+			return nv;
+		}
+	}
+
+	unsigned best_num = 0;
+	char gain_decided = 0;
+	unsigned searched = 0; //moves not excluded nor illegal, for reductions
+
+	ai_order_t* order = &vecs->order[depth];
+	ai_order_moves(g, vecs, order, bdepth, hit.move, 0);
+
+	for (unsigned order_i=0; order_i<order->length; order_i++) {
+		move_t* m = &ai_order_next(order, order_i)->m;
+		if (bdepth==0 && ai_excluded(vecs, m)) continue;
+
+		branch_t* b = &vecs->line[bdepth];
+
+		float captured = ai_eval_capture(g, &vecs->eval, m);
+		float v2 = v + captured;
+
+		//make the unrealistic assumption that all enemy teams are allied, benefits are shared
+		int enter = fabsf(v2)<AI_MAXLOSS;
+
+		char check = ((player_t*)vector_get(&g->players, g->player))->check;
+		if (!branch_init(g, vecs, b, bdepth, *m, 1, (char)enter))
+			continue;
+
+		ai_node(vecs, bdepth);
+		v2 = v + (ally ? b->eval : -b->eval);
+		searched++;
+
+		branch_t subbest[AI_DEPTH];
+		subbest[0].m.from[0] = -1;
+
+		char decided = 0;
+		if (enter) {
+			int inv = ally != vecs->ally;
+			float a2 = depth==0 ? (ally ? ai_beam_floor(vecs) : gain) : alpha, b2 = depth==0 ? INFINITY : beta;
+
+			//late quiet moves that do not check are first searched a ply shorter, which stands only if it fails low
+			float r = INFINITY;
+			if (params->lmr!=0 && searched>params->lmr && space && inv && a2>-INFINITY && captured==0 && !check
+					&& !((player_t*)vector_get(&g->players, g->player))->check && !vecs->tb_pieces) {
+				r = -ai_quiesce(vecs, g, -v2, -b2, -a2, bdepth+1, 0);
+			}
+
+			if (r<=a2) {
+				v2 = r;
+			} else if (space) {
+				v2 = inv ? -ai_find_move(vecs, g, -v2, -b2, -a2, depth+1, subbest)
+						: ai_find_move(vecs, g, v2, a2, b2, depth+1, subbest);
+			} else {
+				v2 = inv ? -ai_quiesce(vecs, g, -v2, -b2, -a2, bdepth+1, 0)
+						: ai_quiesce(vecs, g, v2, a2, b2, bdepth+1, 0);
+			}
+
+			decided = vecs->decided;
+
+			branch_exit(g, vecs, b, bdepth);
+		}
+
+		if (depth == 0) {
+			//keep if there is space but abs>maxloss
+			sbranch_push(vecs, space ? subbest : NULL, ally ? v2 : -v2, (char)(space && !enter));
+		} else if (v2 > gain) {
+			best[0] = *b;
+			if (depth+1<AI_DEPTH) memcpy(&best[1], subbest, (AI_DEPTH-depth-1)*sizeof(branch_t));
+		}
+
+		if (v2>gain) {
+			gain=v2;
+			gain_decided=decided;
+			best_num=b->num;
+		}
+
+		if (depth>0 && gain>alpha) alpha=gain;
+		if (depth>0 && alpha>=beta) {
+			ai_cutoff(g, vecs, b, bdepth, AI_DEPTH-depth);
+			break;
+		}
+	}
+
+	if (gain == -INFINITY) {
+		if (depth>0) {
+			best[0].m.from[0] = -1;
+			float mate = -checkmate_value(g, vecs);
+			if (!vecs->aborted) ai_tt_store_value(vecs, key, mate, v, draft, AI_TT_ABSOLUTE, 0);
+			vecs->decided = 1;
+			return mate;
+		} else {
+			vecs->sbranch->keep=1;
+			vecs->sbranch->v = ally ? -checkmate_value(g, vecs) : checkmate_value(g, vecs);
+			vecs->decided = 0;
+			return 0;
+		}
+	}
+
+	if (depth>0 && !vecs->aborted) {
+		char flags = gain>=beta ? AI_TT_LOWER : (gain<=alpha_orig ? AI_TT_UPPER : 0);
+		if (gain_decided) flags |= AI_TT_ABSOLUTE;
+		if (sym!=-1 && best_num) best_num = ai_sym_num(&vecs->syms[sym], best_num, 0);
+		ai_tt_store_value(vecs, key, gain, v, draft, flags, best_num);
+	}
+
+	vecs->decided = gain_decided;
+	return gain;
+}
+
+//everything the search needs is allocated here, nodes only reuse it
+void ai_vecs_init(move_vecs_t* vecs, game_t* g, ai_eval_params_t* params) {
+	vecs->lines = heap(sizeof(ai_line_t)*AI_LINES);
+	vecs->lines_cap = AI_LINES;
+	vecs->lines_free = heap(sizeof(int)*AI_LINES);
+	vecs->nlines_free = AI_LINES;
+	for (int i=0; i<AI_LINES; i++) vecs->lines_free[i] = AI_LINES-1-i;
+
+	vecs->sbranches = vecs->beam[0];
+	vecs->sbranches_new = vecs->beam[1];
+	vecs->sbranches_len = vecs->sbranches_new_len = 0;
+
+	vecs->ai_player = g->player;
+	vecs->ai_p = vector_get(&g->players, g->player);
+	vecs->ally = 1;
+	vecs->hash = ai_hash_board(g, g->player);
+	vecs->syms = NULL;
+	vecs->nsyms = 0;
+	ai_eval_init(&vecs->eval, g, vecs->ai_player, vecs->ai_p, params);
+
+	vecs->nodes = vecs->regens = vecs->tt_probes = vecs->tt_hits = vecs->tt_shared_hits = vecs->tb_hits = 0;
+	vecs->variant = 0;
+	vecs->tt_tag = 0;
+	vecs->tb_pieces = 0;
+	memset(vecs->ply_nodes, 0, sizeof(vecs->ply_nodes));
+	vecs->rounds = 0;
+	vecs->extensions = 0;
+	vecs->aborted = 0;
+	vecs->decided = 0;
+	vecs->cancel = NULL;
+	vecs->max_nodes = 0;
+	vecs->deadline = 0;
+	vecs->deadline_ref = NULL;
+	vecs->exclude = NULL;
+	vecs->exclude_len = 0;
+	vecs->next_check = 0;
+	vecs->info = NULL;
+	memset(vecs->depth_time, 0, sizeof(vecs->depth_time));
+
+	memset(vecs->killers, 0, sizeof(vecs->killers));
+	vecs->history = heap(sizeof(int)*(p_blocked+1)*g->board_w*g->board_h);
+	memset(vecs->history, 0, sizeof(int)*(p_blocked+1)*g->board_w*g->board_h);
+
+	vecs->log = heap(sizeof(ai_log_t)*AI_PLIES*g->board_w*g->board_h);
+	vecs->log_len = 0;
+
+	vecs->words = (unsigned)(g->board_w*g->board_h+63)/64;
+	vecs->dependents = heap(sizeof(uint64_t)*vecs->words*g->board_w*g->board_h);
+	memset(vecs->dependents, 0, sizeof(uint64_t)*vecs->words*g->board_w*g->board_h);
+	vecs->collect = heap(sizeof(uint64_t)*vecs->words);
+
+	ai_moves_init(&vecs->moves, g);
+	for (int i=0; i<g->board_w*g->board_h; i++) ai_moves_regen(g, vecs, (unsigned)i);
+
+	unsigned len = 0;
+	for (int slot=0; slot<vecs->moves.slots; slot++) {
+		if (vecs->moves.square[slot]!=-1) len += (unsigned)vecs->moves.len[slot];
+	}
+
+	//"depth"
+	vecs->maxdepth = maxdepth(len/g->players.length);
+	vecs->beam_len = AI_LEN;
+
+	//pieces never change hands, so the largest army bounds the moves of any ply
+	int most = 0;
+	for (int player=0; player<(int)g->players.length; player++) {
+		int pieces = 0;
+		for (int i=0; i<g->board_w*g->board_h; i++) {
+			if (piece_owned(vector_get(&g->board, i), (char)player)) pieces++;
+		}
+
+		if (pieces>most) most = pieces;
+	}
+
+	for (int i=0; i<AI_DEPTH+AI_QDEPTH+1; i++) {
+		vecs->order[i] = (ai_order_t){.moves=heap(sizeof(ai_move_t)*most*vecs->moves.cap), .length=0};
+	}
+}
+
+void ai_vecs_free(move_vecs_t* vecs) {
+	ai_moves_free(&vecs->moves);
+	drop(vecs->dependents);
+	drop(vecs->collect);
+	drop(vecs->log);
+	drop(vecs->lines);
+	drop(vecs->lines_free);
+
+	for (int i=0; i<AI_DEPTH+AI_QDEPTH+1; i++) drop(vecs->order[i].moves);
+	drop(vecs->history);
+	ai_eval_free(&vecs->eval);
+}
+
+void ai_depth_reached(move_vecs_t* vecs, unsigned depth) {
+	double t = ai_time()-vecs->start;
+	for (unsigned d=1; d<=depth && d<=AI_MAXDEPTH; d++) {
+		if (vecs->depth_time[d]==0) vecs->depth_time[d] = t;
+	}
+}
+
+//adds the counters of one thread
+void ai_vecs_stats(move_vecs_t* vecs, ai_stats_t* stats) {
+	stats->nodes += vecs->nodes;
+	stats->regens += vecs->regens;
+	stats->tt_probes += vecs->tt_probes;
+	stats->tt_hits += vecs->tt_hits;
+	stats->tt_shared_hits += vecs->tt_shared_hits;
+	stats->tb_hits += vecs->tb_hits;
+	for (int d=0; d<AI_PLIES; d++) stats->ply_nodes[d] += vecs->ply_nodes[d];
+
+	for (int d=0; d<=AI_MAXDEPTH; d++) {
+		double t = vecs->depth_time[d];
+		if (t>0 && (stats->depth_time[d]==0 || t<stats->depth_time[d])) stats->depth_time[d] = t;
+	}
+}
+
+//runs the beam until every superbranch is kept, returns the best (its line stays in the pool)
+//or 0 if aborted before any root move was searched
+int ai_search_vecs(move_vecs_t* vecs, game_t* g, superbranch_t* out) {
+	vecs->first = (superbranch_t){.line=-1, .depth=0};
+	vecs->sbranch = &vecs->first;
+	vecs->sbranches_new_len = 0;
+
+	ai_find_move(vecs, g, 0, -INFINITY, INFINITY, 0, NULL);
+
+	superbranch_t* max = NULL;
+	superbranch_t best;
+
+	int cont = 1;
+	while (cont) {
+		superbranch_t* sbranches = vecs->sbranches;
+		vecs->sbranches = vecs->sbranches_new;
+		vecs->sbranches_len = vecs->sbranches_new_len;
+		vecs->sbranches_new = sbranches;
+		vecs->sbranches_new_len = 0;
+
+		unsigned len = vecs->sbranches_len;
+
+		unsigned deepest = 0;
+		for (unsigned sb_i=0; sb_i<len; sb_i++) {
+			if (vecs->sbranches[sb_i].depth>deepest) deepest = vecs->sbranches[sb_i].depth;
+		}
+
+		ai_depth_reached(vecs, deepest);
+		if (vecs->rounds<AI_ROUNDS) vecs->round_sbranches[vecs->rounds++] = len;
+
+		if (vecs->thread==0 && vecs->info && len) {
+			ai_stats_t stats = {.threads=vecs->threads, .depth=(int)deepest, .time=ai_time()-vecs->start};
+			ai_vecs_stats(vecs, &stats);
+			stats.nodes_per_sec = stats.time>0 ? (double)stats.nodes/stats.time : 0;
+
+			//the best line so far, completed or still in the beam
+			superbranch_t* lead = max;
+			for (unsigned sb_i=0; sb_i<len; sb_i++) {
+				if (!lead || vecs->sbranches[sb_i].v>lead->v) lead = &vecs->sbranches[sb_i];
+			}
+
+			stats.value = lead->v;
+			stats.pv_len = ai_line_get(vecs, lead);
+			for (unsigned i=0; i<stats.pv_len; i++) stats.pv[i] = vecs->line[i].m;
+
+			vecs->info(vecs->info_arg, &stats);
+		}
+
+		//helpers start at different superbranches to fill the table ahead of the others
+		unsigned offset = len ? (unsigned)(vecs->thread*len/vecs->threads) : 0;
+
+		cont=0;
+		for (unsigned sb_i=0; sb_i<len && !vecs->aborted; sb_i++) {
+			superbranch_t* sbranch = &vecs->sbranches[(sb_i+offset)%len];
+			if (sbranch->keep) {
+				continue;
+			} else if (sbranch->depth >= (unsigned)vecs->maxdepth) {
+				sbranch->keep=1;
+				continue;
+			} else {
+				cont = 1;
+			}
+
+			unsigned depth = ai_line_get(vecs, sbranch);
+
+			vecs->sbranch = sbranch;
+			for (unsigned i=0; i<depth; i++) {
+				branch_reenter(g, vecs, &vecs->line[i], i);
+			}
+
+			vecs->extensions++;
+			sbranch->v *= AI_DIMINISH;
+			ai_find_move(vecs, g, vecs->ally ? sbranch->v : -sbranch->v, -INFINITY, INFINITY, 0, NULL);
+			sbranch->v /= AI_DIMINISH;
+
+			for (unsigned i=depth; i-- > 0;) {
+				branch_exit(g, vecs, &vecs->line[i], i);
+			}
+		}
+
+		//nothing was completed before the search stopped, settle for the best line in the beam
+		if (vecs->aborted && !max) {
+			for (unsigned sb_i=0; sb_i<len; sb_i++) {
+				if (!max || vecs->sbranches[sb_i].v>max->v) max = &vecs->sbranches[sb_i];
+			}
+
+			if (max) {
+				best = *max;
+				max = &best;
+				vecs->lines[best.line].refs++;
+			}
+		}
+
+		for (unsigned sb_i=0; sb_i<len; sb_i++) {
+			superbranch_t* sbranch = &vecs->sbranches[sb_i];
+			if (sbranch->keep && !vecs->aborted && (!max || sbranch->v>max->v)) {
+				if (max) ai_line_release(vecs, max->line);
+				best = *sbranch;
+				max = &best;
+			} else {
+				ai_line_release(vecs, sbranch->line);
+			}
+		}
+
+		vecs->sbranches_len = 0;
+
+		if (vecs->aborted) {
+			for (unsigned sb_i=0; sb_i<vecs->sbranches_new_len; sb_i++) {
+				ai_line_release(vecs, vecs->sbranches_new[sb_i].line);
+			}
+
+			vecs->sbranches_new_len = 0;
+			cont = 0;
+		}
+	}
+
+	if (max) *out = *max;
+	return max!=NULL;
+}
+
+typedef struct {
+	move_vecs_t vecs;
+	game_t* g;
+	superbranch_t best;
+	int found;
+	int verbosity;
+} ai_thread_t;
+
+int ai_search_thread(ai_thread_t* t) {
+	t->found = ai_search_vecs(&t->vecs, t->g, &t->best);
+
+	//end helpers once the main search is done, they only exist to populate the table
+	if (t->vecs.thread==0 && t->vecs.stop) atomic_store(t->vecs.stop, 1);
+
+	if (t->found && t->vecs.thread==0 && t->verbosity>=2) {
+		unsigned depth = ai_line_get(&t->vecs, &t->best);
+
+		t->vecs.sbranch = &t->best;
+		for (unsigned i=0; i<depth; i++) {
+			branch_t* b = &t->vecs.line[i];
+			branch_reenter(t->g, &t->vecs, b, i);
+
+			char* pgn = move_pgn(t->g, &b->m);
+			printf("%s\n", pgn);
+			drop(pgn);
+			print_board(t->g);
+		}
+
+		for (unsigned i=depth; i-- > 0;) {
+			branch_exit(t->g, &t->vecs, &t->vecs.line[i], i);
+		}
+	}
+
+	if (t->found && t->vecs.thread==0 && t->verbosity>=1) printf("move value: %f\n", t->best.v);
+
+	return 1;
+}
+
+//throughput of a variant on this machine, measured by the searches made on it
+typedef struct {
+	uint64_t variant;
+	double nodes_per_sec; //of one thread
+	float branching;
+	unsigned searches; //0 for an unused slot
+} ai_calibration_t;
+
+ai_calibration_t g_ai_calibrations[AI_CALIBRATIONS];
+unsigned g_ai_calibrations_next = 0; //slot taken by the next variant measured
+atomic_flag g_ai_calibrations_lock = ATOMIC_FLAG_INIT; //held for a few loads and stores, so it spins
+
+//seconds per move of each difficulty, the same on every variant
+const double ai_difficulty_latencies[AI_DIFFICULTIES] = {0.05, 0.2, 0.75, 2.0, 5.0};
+
+double ai_difficulty_latency(int difficulty) {
+	return ai_difficulty_latencies[clamp(difficulty, 0, AI_DIFFICULTIES-1)];
+}
+
+//identifies the rules and starting position, the positions of a game share its calibration
+//game_mcts picks the engine, not a rule, so those games share books, tablebases, networks and evals with the others
+uint64_t ai_variant(game_t* g) {
+	uint64_t h = ai_mix(((uint64_t)g->board_w<<32) | ((uint64_t)g->board_h<<16) | g->players.length)
+			^ ai_mix(((uint64_t)(g->flags&~game_mcts)<<8) | g->promote_to);
+
+	vector_iterator board_iter = vector_iterate(&g->init_board);
+	while (vector_next(&board_iter)) {
+		h ^= ai_piece_key((int)board_iter.i, board_iter.x);
+	}
+
+	return h;
+}
+
+void ai_calibrations_lock() {
+	while (atomic_flag_test_and_set_explicit(&g_ai_calibrations_lock, memory_order_acquire));
+}
+
+void ai_calibrations_unlock() {
+	atomic_flag_clear_explicit(&g_ai_calibrations_lock, memory_order_release);
+}
+
+ai_calibration_t* ai_calibration_find(uint64_t variant) {
+	for (int i=0; i<AI_CALIBRATIONS; i++) {
+		if (g_ai_calibrations[i].searches && g_ai_calibrations[i].variant==variant) return &g_ai_calibrations[i];
+	}
+
+	return NULL;
+}
+
+//copies the calibration of the variant to out, returns 0 if it was never measured
+int ai_calibration_get(uint64_t variant, ai_calibration_t* out) {
+	ai_calibrations_lock();
+
+	ai_calibration_t* c = ai_calibration_find(variant);
+	if (c) *out = *c;
+
+	ai_calibrations_unlock();
+	return c!=NULL;
+}
+
+//folds a search made on one thread into the calibration of its variant
+void ai_calibrate(uint64_t variant, double time, unsigned long nodes, unsigned long extensions) {
+	if (nodes<AI_CALIBRATION_MINNODES || time<=0) return;
+
+	double nodes_per_sec = (double)nodes/time;
+	float branching = powf((float)nodes/(float)(extensions+1), 1.0f/AI_DEPTH);
+
+	ai_calibrations_lock();
+
+	ai_calibration_t* c = ai_calibration_find(variant);
+	if (c) {
+		c->nodes_per_sec += AI_CALIBRATION_WEIGHT*(nodes_per_sec-c->nodes_per_sec);
+		c->branching += (float)AI_CALIBRATION_WEIGHT*(branching-c->branching);
+		c->searches++;
+	} else {
+		g_ai_calibrations[g_ai_calibrations_next] = (ai_calibration_t){.variant=variant,
+			.nodes_per_sec=nodes_per_sec, .branching=branching, .searches=1};
+		g_ai_calibrations_next = (g_ai_calibrations_next+1)%AI_CALIBRATIONS;
+	}
+
+	ai_calibrations_unlock();
+}
+
+//depth and beam width of a search expected to take latency seconds on one thread
+//the first plies cost one extension, then each round extends up to beam superbranches by AI_DEPTH plies
+void ai_budget(ai_calibration_t* c, double latency, int* depth, unsigned* beam) {
+	double extensions = c->nodes_per_sec*latency/pow(c->branching, AI_DEPTH) - 1;
+
+	if (extensions>=AI_LEN) {
+		*beam = AI_LEN;
+		*depth = (int)min((1+floor(extensions/AI_LEN))*AI_DEPTH, AI_MAXDEPTH);
+	} else {
+		//less than a full round, narrow the beam rather than looking less than two rounds ahead
+		*beam = (unsigned)clamp((int)extensions, AI_MINLEN, AI_LEN);
+		*depth = 2*AI_DEPTH;
+	}
+}
+
+//opening books, the moves played from the positions of a variant's first plies weighted by how they did
+//a book is a header and its entries sorted by key, mapped read only so the pages are shared between processes
+//books are written by termchess_book and opened once at startup, after which threads only read them
+//
+//each book holds one variant, the hash of its rules and initial board, so a custom board never finds moves of another
+//positions are keyed by ai_hash_canonical with their moves mapped to the same image, so symmetric openings share entries
+//files are in native byte order and only move between machines of the same one
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t variant;
+	uint64_t len;
+} ai_book_header_t;
+
+typedef struct {
+	uint64_t key; //ai_hash_canonical of the position, with the player to move
+	uint8_t from[2];
+	uint8_t to[2];
+	uint32_t weight; //2 per win of the player who moved, 1 per draw
+} ai_book_entry_t;
+
+typedef struct {
+	void* data;
+	size_t size;
+	uint64_t variant;
+	uint64_t len;
+	ai_book_entry_t* entries;
+} ai_book_t;
+
+ai_book_t g_ai_books[AI_BOOKS];
+unsigned g_ai_books_len = 0;
+
+//maps the book at path, returns 0 if it can not be read or is not a book
+int ai_book_open(char* path) {
+	if (g_ai_books_len==AI_BOOKS) return 0;
+
+	size_t size;
+	void* data = ai_map(path, &size);
+	if (!data) return 0;
+
+	ai_book_header_t* header = data;
+	if (size<sizeof(ai_book_header_t) || header->magic!=AI_BOOK_MAGIC || header->version!=AI_BOOK_VERSION
+			|| header->len > (size-sizeof(ai_book_header_t))/sizeof(ai_book_entry_t)) {
+		munmap(data, size);
+		return 0;
+	}
+
+	g_ai_books[g_ai_books_len++] = (ai_book_t){.data=data, .size=size,
+		.variant=header->variant, .len=header->len, .entries=(ai_book_entry_t*)(header+1)};
+
+	return 1;
+}
+
+//opens every .book file in dir, returns how many were books
+unsigned ai_books_open(char* dir) {
+	return ai_open_dir(dir, ".book", ai_book_open);
+}
+
+void ai_books_close() {
+	for (unsigned i=0; i<g_ai_books_len; i++) munmap(g_ai_books[i].data, g_ai_books[i].size);
+	g_ai_books_len = 0;
+}
+
+ai_book_t* ai_book_find(uint64_t variant) {
+	for (unsigned i=0; i<g_ai_books_len; i++) {
+		if (g_ai_books[i].variant==variant) return &g_ai_books[i];
+	}
+
+	return NULL;
+}
+
+//entries of the position with key, returns how many and sets out to the first
+uint64_t ai_book_entries(ai_book_t* book, uint64_t key, ai_book_entry_t** out) {
+	uint64_t lo=0, hi=book->len;
+	while (lo<hi) {
+		uint64_t mid = lo+(hi-lo)/2;
+		if (book->entries[mid].key<key) lo = mid+1;
+		else hi = mid;
+	}
+
+	uint64_t end = lo;
+	while (end<book->len && book->entries[end].key==key) end++;
+
+	*out = &book->entries[lo];
+	return end-lo;
+}
+
+//the legal move of the player to move from and to the squares of an entry
+int ai_book_legal(game_t* g, ai_book_entry_t* e, move_t* out) {
+	int from[2] = {e->from[0], e->from[1]};
+	if (from[0]>=g->board_w || from[1]>=g->board_h) return 0;
+
+	piece_t* p = board_get(g, from);
+	if (!piece_edible(p) || !piece_owned(p, g->player)) return 0;
+
+	vector_t moves = vector_new(sizeof(move_t));
+	piece_moves(g, p, &moves, 1);
+
+	int found=0;
+	vector_iterator m_iter = vector_iterate(&moves);
+	while (vector_next(&m_iter)) {
+		move_t* m = m_iter.x;
+		if (m->to[0]==e->to[0] && m->to[1]==e->to[1]) {
+			*out = *m;
+			found = 1;
+			break;
+		}
+	}
+
+	vector_free(&moves);
+	return found;
+}
+
+//maps the move of an entry to its image, or back with inverse
+void ai_book_entry_sym(game_t* g, ai_sym_t* s, ai_book_entry_t* e, char inverse) {
+	int from[2] = {e->from[0], e->from[1]}, to[2] = {e->to[0], e->to[1]};
+	if (from[0]>=g->board_w || from[1]>=g->board_h || to[0]>=g->board_w || to[1]>=g->board_h) return; //a collision, not legal anyway
+
+	ai_sym_pos(g, s, from, inverse);
+	ai_sym_pos(g, s, to, inverse);
+
+	e->from[0] = (uint8_t)from[0];
+	e->from[1] = (uint8_t)from[1];
+	e->to[0] = (uint8_t)to[0];
+	e->to[1] = (uint8_t)to[1];
+}
+
+//picks a move of g's position from the book of its variant, by weight with the random number r
+//returns 0 when there is no book or the position is not in it
+int ai_book_move(game_t* g, uint64_t r, move_t* out) {
+	if (g_ai_books_len==0) return 0;
+
+	ai_book_t* book = ai_book_find(ai_variant(g));
+	if (!book) return 0;
+
+	ai_sym_t syms[AI_SYMS];
+	unsigned nsyms = ai_syms(g, syms);
+
+	int sym;
+	ai_book_entry_t* entries;
+	uint64_t len = ai_book_entries(book, ai_hash_canonical(g, g->player, syms, nsyms, &sym), &entries);
+	int found = 0;
+
+	uint64_t total=0;
+	for (uint64_t i=0; i<len; i++) total += entries[i].weight;
+
+	//falls through to the next entries when a collision left an illegal one
+	uint64_t pick = total ? r%total : 0;
+	for (uint64_t i=0; total && i<len; i++) {
+		if (pick<entries[i].weight || i+1==len) {
+			for (uint64_t j=0; !found && j<len; j++) {
+				ai_book_entry_t e = entries[(i+j)%len];
+				if (sym!=-1) ai_book_entry_sym(g, &syms[sym], &e, 1);
+				found = ai_book_legal(g, &e, out);
+			}
+
+			break;
+		}
+
+		pick -= entries[i].weight;
+	}
+
+	ai_syms_free(syms, nsyms);
+	return found;
+}
+
+int ai_book_entry_cmp(const void* a, const void* b) {
+	const ai_book_entry_t* ea = a;
+	const ai_book_entry_t* eb = b;
+	if (ea->key!=eb->key) return ea->key<eb->key ? -1 : 1;
+	return memcmp(ea->from, eb->from, 4);
+}
+
+//sorts entries (ai_book_entry_t), merges those of the same move and drops moves weighing less than min
+//then writes them as the book of variant, returns the number of entries or -1 if path can not be written
+long ai_book_write(char* path, uint64_t variant, vector_t* entries, uint32_t min) {
+	qsort(entries->data, entries->length, sizeof(ai_book_entry_t), ai_book_entry_cmp);
+
+	ai_book_entry_t* es = (ai_book_entry_t*)entries->data;
+	unsigned long len=0;
+	for (unsigned long i=0; i<entries->length; i++) {
+		if (len && es[len-1].key==es[i].key && memcmp(es[len-1].from, es[i].from, 4)==0) {
+			es[len-1].weight += es[i].weight;
+			continue;
+		}
+
+		if (len && es[len-1].weight<min) len--; //the last move is complete
+		es[len++] = es[i];
+	}
+
+	if (len && es[len-1].weight<min) len--;
+	vector_truncate(entries, len);
+
+	FILE* f = fopen(path, "wb");
+	if (!f) return -1;
+
+	ai_book_header_t header = {.magic=AI_BOOK_MAGIC, .version=AI_BOOK_VERSION, .variant=variant, .len=len};
+	fwrite(&header, sizeof(header), 1, f);
+	fwrite(entries->data, sizeof(ai_book_entry_t), len, f);
+	fclose(f);
+
+	return (long)len;
+}
+
+ai_mcts_t ai_mcts_new() {
+	ai_mcts_t mcts;
+	for (int i=0; i<AI_MAXTHREADS; i++) {
+		mcts.trees[i] = (ai_mcts_tree_t){.nodes=NULL, .spare=NULL, .len=0, .ai_player=-1, .base=0};
+	}
+
+	return mcts;
+}
+
+void ai_mcts_free(ai_mcts_t* mcts) {
+	for (int i=0; i<AI_MAXTHREADS; i++) {
+		ai_mcts_tree_t* t = &mcts->trees[i];
+		drop(t->nodes);
+		drop(t->spare);
+		*t = (ai_mcts_tree_t){.nodes=NULL, .spare=NULL, .len=0, .ai_player=-1, .base=0};
+	}
+}
+
+uint64_t ai_mcts_rand(uint64_t* state) { //xorshift64*
+	*state ^= *state>>12;
+	*state ^= *state<<25;
+	*state ^= *state>>27;
+	return *state * 0x2545f4914f6cdd1dULL;
+}
+
+//moves the root of a tree to the position of vecs, the subtree already searched below it is kept
+//values are for the team of the ai that searched, so another team starts over
+void ai_mcts_root(ai_mcts_tree_t* t, move_vecs_t* vecs) {
+	if (!t->nodes) {
+		t->nodes = heap(sizeof(ai_mcts_node_t)*AI_MCTS_NODES);
+		t->spare = heap(sizeof(ai_mcts_node_t)*AI_MCTS_NODES);
+		t->len = 0;
+	}
+
+	int root = -1;
+	if (t->len>0 && t->ai_player!=-1 && is_ally(vecs->ai_player, vecs->ai_p, t->ai_player)) {
+		//the same position can be reached by several lines, the most searched is kept
+		for (unsigned i=0; i<t->len; i++) {
+			ai_mcts_node_t* n = &t->nodes[i];
+			if (n->hash==vecs->hash && n->children!=-1 && (root==-1 || n->visits>t->nodes[root].visits)) root = (int)i;
+		}
+	}
+
+	if (root==-1) {
+		t->ai_player = vecs->ai_player;
+		t->base = vecs->eval.score;
+		t->nodes[0] = (ai_mcts_node_t){.hash=vecs->hash, .visits=0, .value=0, .children=-1, .len=0,
+			.from=AI_NOSQUARE, .to=AI_NOSQUARE, .castle=AI_NOSQUARE, .ally=0};
+		t->len = 1;
+		return;
+	} else if (root==0) {
+		return;
+	}
+
+	//breadth first, so the children of each node stay contiguous
+	t->spare[0] = t->nodes[root];
+	unsigned len = 1;
+	for (unsigned i=0; i<len; i++) {
+		ai_mcts_node_t* n = &t->spare[i];
+		if (n->children==-1) continue;
+
+		memcpy(&t->spare[len], &t->nodes[n->children], sizeof(ai_mcts_node_t)*n->len);
+		n->children = (int)len;
+		len += n->len;
+	}
+
+	ai_mcts_node_t* nodes = t->nodes;
+	t->nodes = t->spare;
+	t->spare = nodes;
+	t->len = len;
+}
+
+void ai_mcts_move(game_t* g, ai_mcts_node_t* n, move_t* m) {
+	ai_cmove_move(g, n->from, &(ai_cmove_t){.to=n->to, .castle=n->castle}, m);
+}
+
+//adds the legal moves of the position as children of n, in the order the beam would search them
+//excluded moves are added too and skipped when selecting, the tree may be kept for a search without them
+//returns 0 if they do not fit in the arena, n is then left as a leaf
+int ai_mcts_expand(game_t* g, move_vecs_t* vecs, ai_mcts_tree_t* t, ai_mcts_node_t* n, unsigned bdepth) {
+	ai_order_t* order = &vecs->order[0];
+	ai_order_moves(g, vecs, order, bdepth, 0, 0);
+	if (t->len+order->length > AI_MCTS_NODES) return 0;
+
+	n->children = (int)t->len;
+	n->len = 0;
+
+	for (unsigned order_i=0; order_i<order->length; order_i++) {
+		move_t* m = &ai_order_next(order, order_i)->m;
+
+		branch_t b;
+		if (!branch_init(g, vecs, &b, bdepth, *m, 1, 0)) continue;
+
+		t->nodes[t->len++] = (ai_mcts_node_t){.hash=0, .visits=0, .value=0, .children=-1, .len=0,
+			.from=(uint16_t)pos_i(g, m->from), .to=(uint16_t)pos_i(g, m->to),
+			.castle=m->castle[0]==-1 ? AI_NOSQUARE : (uint16_t)pos_i(g, m->castle), .ally=vecs->ally};
+		n->len++;
+	}
+
+	return 1;
+}
+
+//uct, children not visited yet come first in the order they were added
+ai_mcts_node_t* ai_mcts_select(game_t* g, move_vecs_t* vecs, ai_mcts_tree_t* t, ai_mcts_node_t* n, unsigned bdepth) {
+	ai_mcts_node_t* best = NULL;
+	float best_u = -INFINITY;
+	float explore = AI_MCTS_EXPLORE*sqrtf(logf((float)n->visits+1));
+
+	for (unsigned i=0; i<n->len; i++) {
+		ai_mcts_node_t* c = &t->nodes[n->children+(int)i];
+
+		if (bdepth==0 && vecs->exclude_len) {
+			move_t m;
+			ai_mcts_move(g, c, &m);
+			if (ai_excluded(vecs, &m)) continue;
+		}
+
+		if (c->visits==0) return c;
+
+		float u = c->value/(float)c->visits + explore/sqrtf((float)c->visits);
+		if (u>best_u) {
+			best_u = u;
+			best = c;
+		}
+	}
+
+	return best;
+}
+
+//score of the ai's team when the player to move has no moves, relative to the tree's base like the scores of the eval
+float ai_mcts_terminal(game_t* g, move_vecs_t* vecs, ai_mcts_tree_t* t) {
+	return t->base + (vecs->ally ? -checkmate_value(g, vecs) : checkmate_value(g, vecs));
+}
+
+//chance of the ai's team winning from its score
+float ai_mcts_reward(float score) {
+	return 1.0f/(1.0f+expf(-score/AI_MCTS_SCALE));
+}
+
+//captures first, the best by mvv-lva, otherwise a random move, for AI_MCTS_PLAYOUT plies
+//returns the score of the ai's team where it ends, once the exchanges left are played out
+float ai_mcts_playout(game_t* g, move_vecs_t* vecs, ai_mcts_tree_t* t, unsigned bdepth, uint64_t* rng) {
+	branch_t line[AI_MCTS_PLAYOUT];
+	ai_order_t* order = &vecs->order[1];
+
+	int plies = 0;
+	float score = NAN;
+
+	for (; plies<AI_MCTS_PLAYOUT; plies++) {
+		unsigned d = bdepth+(unsigned)plies;
+		int made = 0;
+
+		ai_order_moves(g, vecs, order, d, 0, 1);
+		for (unsigned i=0; i<order->length && !made; i++) {
+			made = branch_init(g, vecs, &line[plies], d, ai_order_next(order, i)->m, 1, 1);
+		}
+
+		if (!made) {
+			ai_order_moves(g, vecs, order, d, 0, 0);
+			unsigned start = order->length ? (unsigned)(ai_mcts_rand(rng)%order->length) : 0;
+			for (unsigned i=0; i<order->length && !made; i++) {
+				made = branch_init(g, vecs, &line[plies], d, order->moves[(start+i)%order->length].m, 1, 1);
+			}
+		}
+
+		if (!made) {
+			score = ai_mcts_terminal(g, vecs, t);
+			break;
+		}
+
+		ai_node(vecs, d);
+	}
+
+	if (isnan(score)) {
+		float v = vecs->eval.score-t->base;
+		float q = ai_quiesce(vecs, g, vecs->ally ? v : -v, -INFINITY, INFINITY, bdepth+(unsigned)plies, 0);
+		score = t->base + (vecs->ally ? q : -q);
+	}
+
+	for (int i=plies; i-- > 0;) {
+		branch_exit(g, vecs, &line[i], bdepth+(unsigned)i);
+	}
+
+	return score;
+}
+
+//one descent from the root, expanding the first leaf it reaches and playing out from there
+//returns its depth
+unsigned ai_mcts_iterate(game_t* g, move_vecs_t* vecs, ai_mcts_tree_t* t, uint64_t* rng) {
+	ai_mcts_node_t* path[AI_MCTS_MAXDEPTH+1];
+	branch_t line[AI_MCTS_MAXDEPTH];
+	unsigned depth = 0;
+	float score;
+
+	path[0] = &t->nodes[0];
+
+	while (1) {
+		ai_mcts_node_t* n = path[depth];
+		if (depth>=AI_MCTS_MAXDEPTH || (n->children==-1 && !ai_mcts_expand(g, vecs, t, n, depth))) {
+			score = ai_mcts_playout(g, vecs, t, depth, rng);
+			break;
+		}
+
+		ai_mcts_node_t* c = ai_mcts_select(g, vecs, t, n, depth);
+		if (!c) {
+			score = ai_mcts_terminal(g, vecs, t);
+			break;
+		}
+
+		move_t m;
+		ai_mcts_move(g, c, &m);
+		branch_init(g, vecs, &line[depth], depth, m, 1, 1); //legal, it was tried when expanding
+		ai_node(vecs, depth);
+
+		if (!c->hash) c->hash = vecs->hash;
+		path[++depth] = c;
+
+		if (c->visits==0) {
+			score = ai_mcts_playout(g, vecs, t, depth, rng);
+			break;
+		}
+	}
+
+	float r = ai_mcts_reward(score-t->base);
+	for (unsigned i=0; i<=depth; i++) {
+		path[i]->visits++;
+		path[i]->value += path[i]->ally ? r : 1-r;
+	}
+
+	for (unsigned i=depth; i-- > 0;) {
+		branch_exit(g, vecs, &line[i], i);
+	}
+
+	return depth;
+}
+
+typedef struct {
+	move_vecs_t vecs;
+	game_t* g;
+	ai_mcts_tree_t* tree;
+	uint64_t rng;
+	unsigned long iterations; //0 for no limit but the vecs' own
+	unsigned deepest;
+} ai_mcts_thread_t;
+
+//the most visited child of n that is not excluded, NULL if none was visited
+ai_mcts_node_t* ai_mcts_best(game_t* g, move_vecs_t* vecs, ai_mcts_tree_t* t, ai_mcts_node_t* n, char root) {
+	ai_mcts_node_t* best = NULL;
+	for (unsigned i=0; n->children!=-1 && i<n->len; i++) {
+		ai_mcts_node_t* c = &t->nodes[n->children+(int)i];
+		if (c->visits==0 || (best && c->visits<=best->visits)) continue;
+
+		if (root && vecs->exclude_len) {
+			move_t m;
+			ai_mcts_move(g, c, &m);
+			if (ai_excluded(vecs, &m)) continue;
+		}
+
+		best = c;
+	}
+
+	return best;
+}
+
+void ai_mcts_stats(ai_mcts_thread_t* t, ai_stats_t* stats) {
+	ai_mcts_node_t* best = ai_mcts_best(t->g, &t->vecs, t->tree, &t->tree->nodes[0], 1);
+	stats->depth = (int)t->deepest;
+
+	if (best) {
+		float r = fminf(fmaxf(best->value/(float)best->visits, 1e-6f), 1-1e-6f);
+		stats->value = fminf(fmaxf(AI_MCTS_SCALE*logf(r/(1-r)), -CHECKMATE_VAL), CHECKMATE_VAL);
+	}
+
+	stats->pv_len = 0;
+	for (ai_mcts_node_t* n=best; n && stats->pv_len<AI_PLIES; n=ai_mcts_best(t->g, &t->vecs, t->tree, n, 0)) {
+		ai_mcts_move(t->g, n, &stats->pv[stats->pv_len++]);
+	}
+}
+
+int ai_mcts_thread(ai_mcts_thread_t* t) {
+	move_vecs_t* vecs = &t->vecs;
+
+	for (unsigned long i=0; !ai_stopped(vecs) && (!t->iterations || i<t->iterations); i++) {
+		unsigned depth = ai_mcts_iterate(t->g, vecs, t->tree, &t->rng);
+		if (depth>t->deepest) t->deepest = depth;
+
+		if (vecs->thread==0 && vecs->info && (i+1)%AI_MCTS_INFO==0) {
+			ai_stats_t stats = {.threads=vecs->threads, .time=ai_time()-vecs->start};
+			ai_vecs_stats(vecs, &stats);
+			ai_mcts_stats(t, &stats);
+			stats.nodes_per_sec = stats.time>0 ? (double)stats.nodes/stats.time : 0;
+			vecs->info(vecs->info_arg, &stats);
+		}
+	}
+
+	//helpers only add to the visits of the root moves, they end with the main thread
+	if (vecs->thread==0 && vecs->stop) atomic_store(vecs->stop, 1);
+	return 1;
+}
+
+//monte carlo tree search, for boards too wide for the beam to see far
+//every thread grows its own tree from the root and the visits of the root moves are summed
+int ai_mcts_search(game_t* g, ai_settings_t* settings, int threads, uint64_t variant, move_t* out_m) {
+	ai_eval_params_t* params = ai_eval_params(settings, variant);
+	ai_nn_t* nn = params->net ? ai_nn_find(variant) : NULL;
+
+	ai_mcts_t new_trees;
+	ai_mcts_t* trees = settings->mcts_trees;
+	if (!trees) {
+		new_trees = ai_mcts_new();
+		trees = &new_trees;
+	}
+
+	//without a limit the search would not end
+	unsigned long iterations = 0;
+	if (!settings->nodes && settings->movetime<=0 && settings->latency<=0 && !settings->deadline) iterations = AI_MCTS_ITERATIONS;
+
+	atomic_int stop;
+	atomic_init(&stop, 0);
+
+	double start = ai_time();
+
+	ai_mcts_thread_t* ts = heap(sizeof(ai_mcts_thread_t)*threads);
+	for (int i=0; i<threads; i++) {
+		ai_mcts_thread_t* t = &ts[i];
+		if (i==0) {
+			t->g = g;
+		} else {
+			t->g = heap(sizeof(game_t));
+			*t->g = game_copy(g);
+		}
+
+		ai_vecs_init(&t->vecs, t->g, params);
+		ai_eval_net(&t->vecs.eval, t->g, nn);
+		t->vecs.thread = i;
+		t->vecs.threads = threads;
+		t->vecs.stop = threads>1 ? &stop : NULL;
+		t->vecs.start = start;
+
+		t->vecs.cancel = settings->stop;
+		t->vecs.max_nodes = settings->nodes;
+		if (settings->movetime>0) t->vecs.deadline = start+settings->movetime;
+		else if (settings->latency>0) t->vecs.deadline = start+settings->latency;
+		t->vecs.deadline_ref = settings->deadline;
+		t->vecs.exclude = settings->exclude;
+		t->vecs.exclude_len = settings->exclude_len;
+		if (i==0) {
+			t->vecs.info = settings->info;
+			t->vecs.info_arg = settings->info_arg;
+		}
+
+		t->tree = &trees->trees[i];
+		ai_mcts_root(t->tree, &t->vecs);
+		t->rng = ai_search_random(settings, (unsigned)i+1) | 1;
+		t->iterations = iterations;
+		t->deepest = 0;
+	}
+
+	if (threads==1) {
+		ai_mcts_thread(&ts[0]);
+	} else {
+#ifndef __EMSCRIPTEN__
+		thrd_t* thrds = heap(sizeof(thrd_t)*threads);
+		for (int i=1; i<threads; i++) {
+			thrd_create(&thrds[i], (int(*)(void*))ai_mcts_thread, &ts[i]);
+		}
+
+		ai_mcts_thread(&ts[0]);
+
+		for (int i=1; i<threads; i++) {
+			thrd_join(thrds[i], NULL);
+		}
+
+		drop(thrds);
+#endif
+	}
+
+	//visits of the helpers' root moves go to the same move in the main tree
+	ai_mcts_tree_t* tree = ts[0].tree;
+	ai_mcts_node_t* root = &tree->nodes[0];
+	for (int i=1; i<threads && root->children!=-1; i++) {
+		ai_mcts_node_t* h_root = &ts[i].tree->nodes[0];
+
+		for (unsigned j=0; h_root->children!=-1 && j<h_root->len; j++) {
+			ai_mcts_node_t* h = &ts[i].tree->nodes[h_root->children+(int)j];
+
+			for (unsigned k=0; k<root->len; k++) {
+				ai_mcts_node_t* c = &tree->nodes[root->children+(int)k];
+				if (c->from!=h->from || c->to!=h->to || c->castle!=h->castle) continue;
+
+				c->visits += h->visits;
+				c->value += h->value;
+				root->visits += h->visits;
+				break;
+			}
+		}
+	}
+
+	ai_mcts_node_t* best = ai_mcts_best(g, &ts[0].vecs, tree, root, 1);
+	if (best) ai_mcts_move(g, best, out_m);
+
+	if (settings->stats) {
+		ai_stats_t* stats = settings->stats;
+		memset(stats, 0, sizeof(ai_stats_t));
+		stats->time = ai_time()-start;
+		stats->threads = threads;
+		stats->aborted = ts[0].vecs.aborted;
+
+		for (int i=0; i<threads; i++) {
+			ai_vecs_stats(&ts[i].vecs, stats);
+			if (ts[i].deepest>ts[0].deepest) ts[0].deepest = ts[i].deepest;
+		}
+
+		ai_mcts_stats(&ts[0], stats);
+		stats->nodes_per_sec = stats->time>0 ? (double)stats->nodes/stats->time : 0;
+	}
+
+	for (int i=0; i<threads; i++) {
+		ai_vecs_free(&ts[i].vecs);
+
+		if (i>0) {
+			game_free(ts[i].g);
+			drop(ts[i].g);
+		}
+	}
+
+	drop(ts);
+	if (trees==&new_trees) ai_mcts_free(&new_trees);
+
+	return best!=NULL;
+}
+
+int ai_search_move(game_t* g, ai_settings_t* settings, move_t* out_m) {
+	int threads = clamp(settings->threads, 1, AI_MAXTHREADS);
+#ifdef __EMSCRIPTEN__
+	threads = 1;
+#endif
+
+	//cancelled before it started, there is no move to fall back on
+	if (settings->stop && atomic_load(settings->stop)) {
+		if (settings->stats) *settings->stats = (ai_stats_t){.aborted=1};
+		return 0;
+	}
+
+	ai_tt_t* tt = settings->tt;
+	if (!tt) {
+#ifdef __EMSCRIPTEN__
+		if (!g_ai_tt.entries) ai_tt_global();
+#else
+		call_once(&g_ai_tt_once, ai_tt_global);
+#endif
+		tt = &g_ai_tt;
+	}
+
+	if (!settings->nobook && !settings->exclude_len && ai_book_move(g, ai_search_random(settings, 0), out_m)) {
+		if (settings->stats) {
+			ai_stats_t* stats = settings->stats;
+			memset(stats, 0, sizeof(ai_stats_t));
+			stats->book = 1;
+			stats->pv_len = 1;
+			stats->pv[0] = *out_m;
+		}
+
+		return 1;
+	}
+
+	uint64_t variant = ai_variant(g);
+
+	//endgames in a tablebase are played from it, the searches after exclusions are left to search
+	int tb_v;
+	if (!settings->exclude_len && g_ai_tbs_len && ai_tb_move(g, variant, out_m, &tb_v)) {
+		if (settings->stats) {
+			ai_stats_t* stats = settings->stats;
+			memset(stats, 0, sizeof(ai_stats_t));
+			stats->tablebase = 1;
+			stats->value = tb_v ? ai_tb_score(tb_v) : 0;
+			stats->pv_len = 1;
+			stats->pv[0] = *out_m;
+		}
+
+		return 1;
+	}
+
+	if (settings->mcts || g->flags&game_mcts) return ai_mcts_search(g, settings, threads, variant, out_m);
+
+	int tb_pieces = g->players.length==2 ? ai_tb_pieces(variant) : 0;
+	ai_eval_params_t* params = ai_eval_params(settings, variant);
+	ai_nn_t* nn = params->net ? ai_nn_find(variant) : NULL;
+
+	//a network need not score the images of a position alike
+	ai_sym_t syms[AI_SYMS];
+	unsigned nsyms = nn ? 0 : ai_syms(g, syms);
+
+	//a variant not seen yet is measured with a small search first
+	int budget_depth = 0;
+	unsigned budget_beam = AI_LEN;
+
+	if (settings->latency>0 && settings->depth<=0) {
+		ai_calibration_t c;
+		if (!ai_calibration_get(variant, &c)) {
+			move_t probe;
+			ai_search(g, &(ai_settings_t){.threads=1, .tt=tt, .eval=settings->eval, .stop=settings->stop,
+				.movetime=settings->latency*AI_CALIBRATION_TIME}, &probe);
+		}
+
+		if (ai_calibration_get(variant, &c)) ai_budget(&c, settings->latency, &budget_depth, &budget_beam);
+	}
+
+	atomic_int stop;
+	atomic_init(&stop, 0);
+
+	double start = ai_time();
+
+	ai_thread_t* ts = heap(sizeof(ai_thread_t)*threads);
+	for (int i=0; i<threads; i++) {
+		ai_thread_t* t = &ts[i];
+		if (i==0) {
+			t->g = g;
+		} else {
+			t->g = heap(sizeof(game_t));
+			*t->g = game_copy(g);
+		}
+
+		ai_vecs_init(&t->vecs, t->g, params);
+		ai_eval_net(&t->vecs.eval, t->g, nn);
+		ai_vecs_syms(&t->vecs, t->g, syms, nsyms);
+		t->vecs.tt = tt;
+		t->vecs.tt_tag = (unsigned char)settings->tt_tag;
+		t->vecs.variant = variant;
+		t->vecs.tb_pieces = tb_pieces;
+		t->vecs.thread = i;
+		t->vecs.threads = threads;
+		t->vecs.stop = threads>1 ? &stop : NULL;
+		t->vecs.start = start;
+		if (settings->depth>0) t->vecs.maxdepth = clamp(settings->depth, 1, AI_MAXDEPTH);
+		else if (budget_depth>0) t->vecs.maxdepth = budget_depth;
+		t->vecs.maxdepth += i%2; //odd helpers look one ply further
+		t->vecs.beam_len = budget_beam;
+
+		t->vecs.cancel = settings->stop;
+		t->vecs.max_nodes = settings->nodes;
+		if (settings->movetime>0) t->vecs.deadline = start+settings->movetime;
+		else if (settings->latency>0) t->vecs.deadline = start+settings->latency*AI_LATENCY_LIMIT; //the estimate was far off
+		t->vecs.deadline_ref = settings->deadline;
+		t->vecs.exclude = settings->exclude;
+		t->vecs.exclude_len = settings->exclude_len;
+		if (i==0) {
+			t->vecs.info = settings->info;
+			t->vecs.info_arg = settings->info_arg;
+		}
+
+		t->verbosity = settings->verbosity;
+	}
+
+	if (settings->verbosity>=1) printf("depth %i, beam %u, %i threads\n", ts[0].vecs.maxdepth, budget_beam, threads);
+
+	if (threads==1) {
+		ai_search_thread(&ts[0]);
+	} else {
+#ifndef __EMSCRIPTEN__
+
+		thrd_t* thrds = heap(sizeof(thrd_t)*threads);
+		for (int i=1; i<threads; i++) {
+			thrd_create(&thrds[i], (int(*)(void*))ai_search_thread, &ts[i]);
+		}
+
+		ai_search_thread(&ts[0]);
+
+		for (int i=1; i<threads; i++) {
+			thrd_join(thrds[i], NULL);
+		}
+
+		drop(thrds);
+#endif
+	}
+
+	//deepest completed search wins, ties go to the main thread
+	//an aborted search only has the lines it kept so far, it is used only when none completed, the main thread's first
+	ai_thread_t* best = NULL;
+	for (int i=0; i<threads; i++) {
+		if (!ts[i].found) continue;
+		if (!best || (!ts[i].vecs.aborted && (best->vecs.aborted || ts[i].vecs.maxdepth>best->vecs.maxdepth))) best = &ts[i];
+	}
+
+	if (best) {
+		ai_line_get(&best->vecs, &best->best);
+		*out_m = best->vecs.line[0].m;
+	}
+
+	ai_calibrate(variant, ai_time()-start, ts[0].vecs.nodes, ts[0].vecs.extensions);
+
+	if (settings->stats) {
+		ai_stats_t* stats = settings->stats;
+		memset(stats, 0, sizeof(ai_stats_t));
+		stats->time = ai_time()-start;
+		stats->threads = threads;
+		stats->depth = best ? best->vecs.maxdepth : 0;
+		stats->beam = budget_beam;
+
+		if (best) {
+			stats->rounds = best->vecs.rounds;
+			memcpy(stats->round_sbranches, best->vecs.round_sbranches, sizeof(unsigned)*best->vecs.rounds);
+
+			stats->aborted = best->vecs.aborted;
+			stats->value = best->best.v;
+			stats->pv_len = ai_line_get(&best->vecs, &best->best);
+			for (unsigned i=0; i<stats->pv_len; i++) stats->pv[i] = best->vecs.line[i].m;
+		}
+
+		unsigned long extensions = 0;
+		for (int i=0; i<threads; i++) {
+			ai_vecs_stats(&ts[i].vecs, stats);
+			extensions += ts[i].vecs.extensions;
+		}
+
+		stats->nodes_per_sec = stats->time>0 ? (double)stats->nodes/stats->time : 0;
+		stats->branching = stats->nodes ? powf((float)stats->nodes/(float)(extensions+threads), 1.0f/AI_DEPTH) : 0;
+	}
+
+	for (int i=0; i<threads; i++) {
+		ai_vecs_free(&ts[i].vecs);
+
+		if (i>0) {
+			game_free(ts[i].g);
+			drop(ts[i].g);
+		}
 	}
 
-	while (vector_prev(&branch_iter)) {
-		branch_exit(g, &g_move_vecs, branch_iter.x, branch_iter.i);
+	drop(ts);
+	ai_syms_free(syms, nsyms);
+	return best!=NULL;
+}
+
+int ai_search(game_t* g, ai_settings_t* settings, move_t* out_m) {
+	if (!settings->deterministic) return ai_search_move(g, settings, out_m);
+
+	//only the node and depth limits are kept, on one thread with new trees and an empty table of its own,
+	//tt may be shared with searches still running
+	ai_settings_t fixed = *settings;
+	fixed.threads = 1;
+	fixed.movetime = 0;
+	fixed.deadline = NULL;
+	fixed.latency = 0;
+	fixed.mcts_trees = NULL;
+
+	unsigned bits = AI_TT_BITS;
+	if (settings->tt) for (bits=0; ((uint64_t)1<<bits)<=settings->tt->mask; bits++);
+
+	ai_tt_t tt = ai_tt_new(bits);
+	fixed.tt = &tt;
+
+	int found = ai_search_move(g, &fixed, out_m);
+	ai_tt_free(&tt);
+	return found;
+}
+
+void ai_json(vector_t* out, const char* fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	int len = vsnprintf(NULL, 0, fmt, args);
+	va_end(args);
+
+	//stock the terminator too, then drop it so the next write overwrites it
+	char* str = vector_stock(out, (unsigned)len+1);
+	va_start(args, fmt);
+	vsnprintf(str, (size_t)len+1, fmt, args);
+	va_end(args);
+
+	vector_truncate(out, out->length-1);
+}
+
+//one object, the per ply and per round arrays are cut after their last nonzero entry
+char* ai_stats_json(ai_stats_t* stats) {
+	vector_t out = vector_new(1);
+
+	ai_json(&out, "{\"nodes\":%lu,\"nodes_per_sec\":%.0f,\"time\":%.6f,\"threads\":%i,\"depth\":%i,\"beam\":%u,\"branching\":%.2f,"
+			"\"aborted\":%s,\"value\":%.4f,\"regens\":%lu,\"tt_probes\":%lu,\"tt_hits\":%lu,\"tt_shared_hits\":%lu,\"tb_hits\":%lu,\"ply_nodes\":[",
+			stats->nodes, stats->nodes_per_sec, stats->time, stats->threads, stats->depth, stats->beam, stats->branching,
+			stats->aborted ? "true" : "false", isfinite(stats->value) ? stats->value : 0,
+			stats->regens, stats->tt_probes, stats->tt_hits, stats->tt_shared_hits, stats->tb_hits);
+
+	int plies = AI_PLIES;
+	while (plies>0 && stats->ply_nodes[plies-1]==0) plies--;
+	for (int d=0; d<plies; d++) ai_json(&out, d ? ",%lu" : "%lu", stats->ply_nodes[d]);
+
+	ai_json(&out, "],\"round_sbranches\":[");
+	for (unsigned r=0; r<stats->rounds; r++) ai_json(&out, r ? ",%u" : "%u", stats->round_sbranches[r]);
+
+	ai_json(&out, "],\"depth_time\":[");
+	int deepest = AI_MAXDEPTH;
+	while (deepest>0 && stats->depth_time[deepest]==0) deepest--;
+	for (int d=1; d<=deepest; d++) ai_json(&out, d>1 ? ",%.6f" : "%.6f", stats->depth_time[d]);
+
+	ai_json(&out, "]}");
+	vector_pushcpy(&out, &(char){0});
+	return out.data;
+}
+
+//settings may be NULL to search on one thread
+int ai_make_move(game_t* g, ai_settings_t* settings, move_t* out_m) {
+	move_t m;
+	if (!ai_search(g, settings ? settings : &(ai_settings_t){.threads=1}, &m)) return 0;
+
+	make_move(g, &m, 0, 1, g->player);
+	if (out_m) *out_m = m;
+	return 1;
+}
+
+//the best k root moves for the player to move, each searched with the limits of settings
+//and the moves found before it left out, best first. g is left as it was
+//returns how many were found, fewer than k if there are no more moves or the search was stopped
+unsigned ai_analyze(game_t* g, ai_settings_t* settings, unsigned k, ai_analysis_t* out) {
+	ai_stats_t stats;
+	ai_settings_t line_settings = *settings;
+	line_settings.stats = &stats;
+	line_settings.nobook = 1; //every line is searched so their values compare
+
+	move_t* exclude = heap(sizeof(move_t)*(k+settings->exclude_len));
+	if (settings->exclude_len) memcpy(exclude, settings->exclude, sizeof(move_t)*settings->exclude_len);
+	line_settings.exclude = exclude;
+	line_settings.exclude_len = settings->exclude_len;
+
+	unsigned n=0;
+	for (; n<k; n++) {
+		move_t m;
+		if (!ai_search(g, &line_settings, &m)) break;
+
+		exclude[line_settings.exclude_len++] = m;
+
+		ai_analysis_t* line = &out[n];
+		*line = (ai_analysis_t){.m=m, .value=stats.value, .depth=stats.depth, .aborted=stats.aborted, .pv_len=stats.pv_len};
+		memcpy(line->pv, stats.pv, sizeof(move_t)*stats.pv_len);
 	}
 
-	printf("move value: %f\n", max->v);
+	drop(exclude);
 
-	branch_t* fbranch = vector_get(&max->branches, 0);
-	make_move(g, &fbranch->m, 0, 1, g->player);
-	if (out_m) *out_m = fbranch->m;
+	//a later search can see further than an earlier one
+	for (unsigned i=1; i<n; i++) {
+		for (unsigned j=i; j>0 && out[j].value>out[j-1].value; j--) {
+			ai_analysis_t tmp = out[j];
+			out[j] = out[j-1];
+			out[j-1] = tmp;
+		}
+	}
+
+	return n;
+}
 
-	sbranch_iter = vector_iterate(&sbranches_keep);
-	while (vector_next(&sbranch_iter)) {
-		superbranch_t* sb = sbranch_iter.x;
-		vector_free(&sb->branches);
+char* ai_analysis_json(game_t* g, ai_analysis_t* lines, unsigned n) {
+	vector_t out = vector_new(1);
+	ai_json(&out, "[");
+
+	for (unsigned i=0; i<n; i++) {
+		char* m_str = move_str(g, &lines[i].m);
+		ai_json(&out, "%s{\"move\":\"%s\",\"value\":%.4f,\"depth\":%i,\"aborted\":%s,\"pv\":[",
+				i ? "," : "", m_str, isfinite(lines[i].value) ? lines[i].value : 0, lines[i].depth,
+				lines[i].aborted ? "true" : "false");
+		drop(m_str);
+
+		for (unsigned j=0; j<lines[i].pv_len; j++) {
+			char* pv_str = move_str(g, &lines[i].pv[j]);
+			ai_json(&out, j ? ",\"%s\"" : "\"%s\"", pv_str);
+			drop(pv_str);
+		}
+
+		ai_json(&out, "]}");
 	}
-}
\ No newline at end of file
+
+	ai_json(&out, "]");
+	vector_pushcpy(&out, &(char){0});
+	return out.data;
+}
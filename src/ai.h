@@ -3,7 +3,239 @@
 #pragma once
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdarg.h>
 #include <math.h>
-#include "util.h"
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <string.h>
+#include <strings.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#ifndef __EMSCRIPTEN__
+#include "threads.h"
+#endif
 #include "chess.h"
-void ai_make_move(game_t* g, move_t* out_m);
+#include "util.h"
+#define AI_MAXPLAYER 4
+#define AI_SYMS 7 //symmetries of a board besides the identity, at most the square's other seven
+#define AI_DEPTH 2 //full width plies per extension of a superbranch, captures are resolved past it by ai_quiesce
+#define AI_MAXDEPTH 30 //eventual depth
+#define AI_QDEPTH 8 //most plies of quiescence
+#define AI_MAXTHREADS 64
+#define AI_PLIES (AI_MAXDEPTH+AI_DEPTH+AI_QDEPTH+2) //helpers search one ply past AI_MAXDEPTH
+#define AI_ROUNDS (AI_MAXDEPTH+2) //superbranches grow every round, so the beam ends before this
+#define AI_TB_MAGIC 0x42544354 //"TCTB"
+#define AI_TB_VERSION 1
+#define AI_TB_MAXPIECES 6
+#define AI_DIFFICULTIES 5
+#define AI_DIFFICULTY_DEFAULT 2
+#define AI_NN_MAGIC 0x4e4e4354 //"TCNN"
+#define AI_NN_VERSION 1
+#define AI_NN_HIDDEN 32 //accumulator width, a multiple of 16 for the avx2 kernels
+#define AI_NN_QA 127 //accumulator value of 1, the top of the clipped relu
+#define AI_NN_QB 64 //output weight of 1
+typedef struct {
+	unsigned long nodes;
+	unsigned long ply_nodes[AI_PLIES]; //nodes by ply from the root, quiescence included
+	unsigned long regens; //cached move lists regenerated by branch_init
+	unsigned long tt_probes;
+	unsigned long tt_hits; //probes finding the position, whether or not they cut off
+	unsigned long tt_shared_hits; //of those, entries stored by a search with another tt_tag
+	unsigned long tb_hits; //positions found in an endgame tablebase
+	int threads;
+	int depth; //maxdepth of the search the move came from
+	unsigned rounds; //of the beam, in the search the move came from
+	unsigned round_sbranches[AI_ROUNDS]; //superbranches in the beam each round
+	unsigned beam; //width of the beam, AI_LEN unless picked for a latency
+	float branching; //effective, from the nodes per superbranch extension of AI_DEPTH plies
+	double time; //seconds
+	double nodes_per_sec;
+	double depth_time[AI_MAXDEPTH+1]; //seconds until a line of length i was first searched, 0 if never
+
+	char aborted; //stopped by a limit or the caller, the move may come from an unfinished beam
+	char book; //the move came from an opening book, nothing was searched
+	char tablebase; //the move came from an endgame tablebase, value is exact
+	float value; //of the principal line, for the ai's team
+	unsigned pv_len;
+	move_t pv[AI_PLIES];
+} ai_stats_t;
+typedef struct {
+	_Atomic uint64_t key;
+	_Atomic uint64_t data;
+} ai_tt_entry_t;
+typedef struct {
+	ai_tt_entry_t* entries;
+	uint64_t mask;
+	size_t mapped; //bytes of the entries from ai_tt_shared, 0 if they are on the heap
+} ai_tt_t;
+typedef struct {
+	float piece[p_blocked+1]; //material
+	float ally; //added to pieces of the ai's team, losing them is worse than taking others
+	float center[p_blocked+1]; //per square closer to the center
+	float advance; //per square a promoting piece has moved towards promotion
+	float mobility; //per move in the cached move lists, 0 leaves it out
+	char net; //a network loaded for the variant replaces material, center, advance and ally, 0 leaves it out
+
+	//selectivity of the search, kept with the evaluation so each variant can set its own
+	float null; //1 tries a null move before the moves of a node that has a beta, 0 leaves it out
+	float null_material; //least material besides pawns and kings for a null move, below it zugzwang is likely
+	float lmr; //moves of a node searched in full before the later quiet ones are reduced, 0 leaves it out
+} ai_eval_params_t;
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t variant;
+	uint32_t squares;
+	uint32_t players;
+	uint32_t types;
+	uint32_t hidden;
+} ai_nn_header_t;
+typedef struct {
+	int* square; //[squares] image of each square
+	int* inverse; //[squares]
+	char player[AI_MAXPLAYER];
+	char swap; //of the axes, before the flips
+	char flip[2];
+} ai_sym_t;
+typedef struct {
+	uint64_t hash; //of the position after the move, 0 until it is entered
+	uint32_t visits;
+	float value; //rewards summed for the team that made the move
+	int children; //first in the arena, -1 until expanded
+	uint16_t len; //children, 0 once expanded means no moves
+	uint16_t from;
+	uint16_t to;
+	uint16_t castle; //AI_NOSQUARE if not castling
+	char ally; //made by the ai's team
+} ai_mcts_node_t;
+typedef struct {
+	ai_mcts_node_t* nodes;
+	ai_mcts_node_t* spare; //the subtree of a new root is copied here
+	unsigned len;
+	char ai_player; //whose team the values are for
+	float base; //score of the ai's team the rewards are relative to, at the first root
+} ai_mcts_tree_t;
+typedef struct ai_mcts {
+	ai_mcts_tree_t trees[AI_MAXTHREADS];
+} ai_mcts_t;
+typedef struct {
+	int threads; //lazy smp; <=1 searches only on the calling thread
+	ai_tt_t* tt; //shared between all threads of the search, NULL uses g_ai_tt
+	unsigned tt_tag; //of the caller, e.g. a game on the server sharing tt with others; its low bits are kept with the entries
+	ai_stats_t* stats; //optional, filled after the search
+	ai_eval_params_t* eval; //NULL uses the variant's from ai_evals_open, or g_ai_eval without one
+	int verbosity; //0 is silent, 1 prints the depth and value, 2 also the principal line
+
+	//limits, 0 for none; a stopped search returns the best line it has
+	atomic_int* stop; //set from another thread
+	unsigned long nodes; //per thread
+	double movetime; //seconds
+	_Atomic double* deadline; //ai_time to stop at, 0 for none; may be moved by another thread while searching
+	int depth; //instead of the depth picked from the number of moves
+	double latency; //seconds the search should take, depth and beam width are picked from the variant's calibration
+	move_t* exclude; //root moves left out of the search
+	unsigned exclude_len;
+	char nobook; //search positions the opening books have, which are otherwise played from them
+	char mcts; //monte carlo tree search instead of the beam, as games flagged game_mcts do
+	ai_mcts_t* mcts_trees; //reused by the next search with mcts if it is in a position below them, NULL for new trees
+
+	//the same position and settings always give the same move, value and nodes: the clock, threads and
+	//mcts_trees are ignored and a new table the size of tt is used instead; book moves and playouts are drawn from seed
+	char deterministic;
+	uint64_t seed;
+
+	void (*info)(void* arg, ai_stats_t* stats); //called on the main thread after each round of the beam, with the best line so far
+	void* info_arg;
+} ai_settings_t;
+typedef struct {
+	move_t m;
+	float value; //for the player to move
+	int depth;
+	char aborted;
+	unsigned pv_len;
+	move_t pv[AI_PLIES];
+} ai_analysis_t;
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t variant;
+	uint32_t squares;
+	uint32_t pieces;
+	uint8_t ty[AI_TB_MAXPIECES];
+	uint8_t player[AI_TB_MAXPIECES];
+	uint32_t reserved;
+	uint64_t len;
+} ai_tb_header_t;
+typedef struct {
+	uint8_t ty;
+	uint8_t player;
+	uint16_t sq;
+} ai_tb_piece_t;
+extern ai_eval_params_t g_ai_eval;
+double ai_time();
+void ai_tt_clear(ai_tt_t* tt);
+ai_tt_t ai_tt_new(unsigned bits);
+ai_tt_t ai_tt_shared(size_t mb, char huge);
+void ai_tt_free(ai_tt_t* tt);
+uint64_t ai_random();
+uint64_t ai_search_random(ai_settings_t* settings, unsigned i);
+uint64_t ai_hash_board_sym(game_t* g, char ai_player, ai_sym_t* s);
+uint64_t ai_hash_board(game_t* g, char ai_player);
+unsigned ai_syms(game_t* g, ai_sym_t* out);
+void ai_syms_free(ai_sym_t* syms, unsigned n);
+uint64_t ai_hash_canonical(game_t* g, char ai_player, ai_sym_t* syms, unsigned n, int* sym);
+void ai_sym_pos(game_t* g, ai_sym_t* s, int pos[2], char inverse);
+void ai_sym_move(game_t* g, ai_sym_t* s, move_t* m, char inverse);
+float ai_center(game_t* g, int pos[2]);
+int ai_progress(game_t* g, piece_t* p, int pos[2]);
+typedef struct {
+	uint64_t variant;
+	double nodes_per_sec; //of one thread
+	float branching;
+	unsigned searches; //0 for an unused slot
+} ai_calibration_t;
+double ai_difficulty_latency(int difficulty);
+uint64_t ai_variant(game_t* g);
+int ai_calibration_get(uint64_t variant, ai_calibration_t* out);
+typedef struct {
+	uint64_t key; //ai_hash_canonical of the position, with the player to move
+	uint8_t from[2];
+	uint8_t to[2];
+	uint32_t weight; //2 per win of the player who moved, 1 per draw
+} ai_book_entry_t;
+int ai_book_open(char* path);
+unsigned ai_books_open(char* dir);
+void ai_books_close();
+int ai_book_move(game_t* g, uint64_t r, move_t* out);
+void ai_book_entry_sym(game_t* g, ai_sym_t* s, ai_book_entry_t* e, char inverse);
+long ai_book_write(char* path, uint64_t variant, vector_t* entries, uint32_t min);
+float* ai_eval_param(ai_eval_params_t* params, char* key);
+int ai_eval_read(char* path, uint64_t* variant, ai_eval_params_t* out);
+long ai_eval_write(char* path, uint64_t variant, ai_eval_params_t* params);
+int ai_eval_open(char* path);
+unsigned ai_evals_open(char* dir);
+int ai_tb_open(char* path);
+unsigned ai_tbs_open(char* dir);
+void ai_tbs_close();
+void ai_tb_sort(ai_tb_piece_t* pieces, int n);
+uint64_t ai_tb_index(ai_tb_piece_t* pieces, int n, unsigned squares, char player);
+int ai_tb_probe(game_t* g, uint64_t variant);
+int ai_nn_open(char* path);
+unsigned ai_nns_open(char* dir);
+void ai_nns_close();
+ai_mcts_t ai_mcts_new();
+void ai_mcts_free(ai_mcts_t* mcts);
+int ai_search(game_t* g, ai_settings_t* settings, move_t* out_m);
+char* ai_stats_json(ai_stats_t* stats);
+int ai_make_move(game_t* g, ai_settings_t* settings, move_t* out_m);
+unsigned ai_analyze(game_t* g, ai_settings_t* settings, unsigned k, ai_analysis_t* out);
+char* ai_analysis_json(game_t* g, ai_analysis_t* lines, unsigned n);
@@ -0,0 +1,405 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#include "threads.h"
+
+#include "vector.h"
+#include "util.h"
+
+#include "chess.h"
+#include "chessfrontend.h"
+#include "network.h"
+#include "ai.h"
+
+//searches for the ai seats of server games, off the event loop
+//each game has at most one job, searched on one thread with the game's budget
+//the pool's threads are the global budget, a core is left for the event loop
+//and when more jobs wait than there are threads each gets a smaller share of its movetime
+//
+//after an ai moves, its seat ponders the reply it predicted while the human thinks
+//ponders are only taken when no other job waits, and give up their thread to one that arrives
+//if the prediction is played the ponder continues as the real search, with the time it already spent counted
+//
+//finished games can be analyzed a position at a time, at the same low priority
+//
+//with ai_pool_share the workers search with one table, keyed by variant, so games of a variant pass on positions to each other
+
+#define AI_POOL_MAXTHREADS 16
+#define AI_POOL_TT_BITS 18
+#define AI_POOL_MOVETIME 2.0 //seconds per move per game
+#define AI_POOL_MINTIME 0.1 //movetime is never shared down below this
+#define AI_POOL_NODES 2000000 //per move per game, bounds boards where the clock is rarely checked
+#define AI_POOL_PONDERTIME 8.0 //seconds a ponder may run on the opponent's time
+#define AI_POOL_LINES 3 //ranked moves per analyzed position
+#define AI_POOL_ANALYSIS_NODES 100000 //per line
+#define AI_POOL_STATS 256 //searches between lines of the shared table's hit rates
+
+typedef struct {
+	unsigned game; //id of the server game
+	unsigned gen; //position the snapshot was taken from, results for older ones are dropped
+
+	game_t g; //snapshot, owned by the job
+	atomic_int stop;
+	_Atomic double deadline; //set when the job is taken, moved by a ponder hit
+	double start;
+	unsigned long nodes;
+	ai_stats_t stats;
+
+	char idle; //only taken when no other job waits, and gives its thread up to one that arrives
+	char ponder; //searching the position after a predicted move, on the opponent's time
+	char yielded; //an idle job stopped for another job, its result is too shallow to use
+
+	int found;
+	move_t m;
+
+	unsigned k; //lines to analyze instead of finding a move, 0 for none
+	unsigned lines_len;
+	ai_analysis_t lines[AI_POOL_LINES];
+} ai_job_t;
+
+typedef struct {
+	server_t* serv; //woken when a job is done
+
+	mtx_t lock;
+	cnd_t work;
+	vector_t queue; //ai_job_t*, oldest first
+	vector_t running; //ai_job_t*
+	vector_t done; //ai_job_t*, taken by ai_pool_done
+	char quit;
+
+	double movetime;
+	double pondertime;
+	unsigned long nodes;
+
+	int threads;
+	thrd_t thrds[AI_POOL_MAXTHREADS];
+
+	ai_tt_t tt; //from ai_pool_share, used by every worker instead of its own table
+	unsigned long searches; //since the start, as the counters of the table
+	unsigned long tt_probes;
+	unsigned long tt_hits;
+	unsigned long tt_shared_hits; //found entries another game stored
+} ai_pool_t;
+
+typedef struct {
+	ai_pool_t* pool;
+	ai_tt_t tt; //kept between jobs, positions of unrelated games just miss; not allocated with a shared table
+	ai_mcts_t mcts; //same, for games flagged game_mcts
+} ai_pool_worker_t;
+
+//jobs other than ponders, in a vector of ai_job_t*
+unsigned ai_pool_load(vector_t* jobs) {
+	unsigned load=0;
+
+	vector_iterator job_iter = vector_iterate(jobs);
+	while (vector_next(&job_iter)) {
+		if (!(*(ai_job_t**)job_iter.x)->idle) load++;
+	}
+
+	return load;
+}
+
+ai_job_t* ai_pool_take(ai_pool_t* pool) {
+	mtx_lock(&pool->lock);
+	while (!pool->quit && pool->queue.length==0) cnd_wait(&pool->work, &pool->lock);
+
+	if (pool->quit) {
+		mtx_unlock(&pool->lock);
+		return NULL;
+	}
+
+	//oldest job that isnt idle, or the oldest idle one
+	unsigned job_i=0;
+	vector_iterator job_iter = vector_iterate(&pool->queue);
+	while (vector_next(&job_iter)) {
+		if (!(*(ai_job_t**)job_iter.x)->idle) {
+			job_i = job_iter.i;
+			break;
+		}
+	}
+
+	ai_job_t* job = *(ai_job_t**)vector_get(&pool->queue, job_i);
+	vector_remove(&pool->queue, job_i);
+	vector_pushcpy(&pool->running, &job);
+
+	job->start = ai_time();
+	job->nodes = pool->nodes;
+	if (job->k) {
+		job->nodes = AI_POOL_ANALYSIS_NODES; //lines are limited one by one, not with the deadline
+	} else if (job->ponder) {
+		job->nodes = (unsigned long)(pool->nodes*pool->pondertime/pool->movetime);
+		atomic_store(&job->deadline, job->start+pool->pondertime);
+	} else {
+		//share the threads between everything waiting or searching
+		unsigned load = ai_pool_load(&pool->queue) + ai_pool_load(&pool->running);
+		double movetime = pool->movetime;
+		if (load > (unsigned)pool->threads) movetime = max(AI_POOL_MINTIME, pool->movetime*pool->threads/load);
+
+		atomic_store(&job->deadline, job->start+movetime);
+	}
+
+	mtx_unlock(&pool->lock);
+	return job;
+}
+
+//hit rates of the searches so far, with the share of hits from other games; called with the lock held
+void ai_pool_stats(ai_pool_t* pool, FILE* f) {
+	fprintf(f, "ai: %lu searches, %lu probes, %.1f%% hits, %.1f%% from other games\n", pool->searches, pool->tt_probes,
+			pool->tt_probes ? 100.0*pool->tt_hits/pool->tt_probes : 0, pool->tt_probes ? 100.0*pool->tt_shared_hits/pool->tt_probes : 0);
+	fflush(f);
+}
+
+int ai_pool_thread(ai_pool_worker_t* worker) {
+	ai_pool_t* pool = worker->pool;
+	ai_job_t* job;
+
+	while ((job=ai_pool_take(pool))) {
+		ai_settings_t settings = {.threads=1, .tt=pool->tt.entries ? &pool->tt : &worker->tt, .tt_tag=job->game,
+			.mcts_trees=&worker->mcts, .stats=&job->stats, .stop=&job->stop, .nodes=job->nodes, .deadline=&job->deadline};
+
+		//aim for half the share of the movetime, the deadline is only reached when the estimate is off
+		if (!job->k && !job->ponder) settings.latency = (atomic_load(&job->deadline)-job->start)/2;
+
+		if (job->k) {
+			settings.movetime = pool->movetime/job->k;
+			job->lines_len = ai_analyze(&job->g, &settings, job->k, job->lines);
+		} else {
+			job->found = ai_search(&job->g, &settings, &job->m);
+		}
+
+		mtx_lock(&pool->lock);
+		vector_search_remove(&pool->running, &job);
+		vector_pushcpy(&pool->done, &job);
+
+		pool->searches++;
+		pool->tt_probes += job->stats.tt_probes;
+		pool->tt_hits += job->stats.tt_hits;
+		pool->tt_shared_hits += job->stats.tt_shared_hits;
+		if (pool->tt.entries && pool->searches%AI_POOL_STATS==0) ai_pool_stats(pool, stderr);
+
+		mtx_unlock(&pool->lock);
+
+		server_wake(pool->serv);
+	}
+
+	if (worker->tt.entries) ai_tt_free(&worker->tt);
+	ai_mcts_free(&worker->mcts);
+	drop(worker);
+	return 0;
+}
+
+//one table of at most mb megabytes for every worker, so games of a variant find the positions others searched
+//called before ai_pool_start; huge asks for huge pages
+void ai_pool_share(ai_pool_t* pool, size_t mb, char huge) {
+	pool->tt = ai_tt_shared(mb, huge);
+}
+
+//threads<=0 uses all cores but one
+void ai_pool_start(ai_pool_t* pool, server_t* serv, int threads) {
+	if (threads<=0) threads = (int)sysconf(_SC_NPROCESSORS_ONLN)-1;
+
+	pool->serv = serv;
+	pool->queue = vector_new(sizeof(ai_job_t*));
+	pool->running = vector_new(sizeof(ai_job_t*));
+	pool->done = vector_new(sizeof(ai_job_t*));
+	pool->quit = 0;
+
+	pool->movetime = AI_POOL_MOVETIME;
+	pool->pondertime = AI_POOL_PONDERTIME;
+	pool->nodes = AI_POOL_NODES;
+	pool->threads = clamp(threads, 1, AI_POOL_MAXTHREADS);
+	pool->searches = pool->tt_probes = pool->tt_hits = pool->tt_shared_hits = 0;
+
+	mtx_init(&pool->lock, mtx_plain);
+	cnd_init(&pool->work);
+
+	for (int i=0; i<pool->threads; i++) {
+		ai_pool_worker_t* worker = heapcpy(sizeof(ai_pool_worker_t), &(ai_pool_worker_t){.pool=pool,
+			.tt=pool->tt.entries ? (ai_tt_t){.entries=NULL} : ai_tt_new(AI_POOL_TT_BITS), .mcts=ai_mcts_new()});
+		thrd_create(&pool->thrds[i], (int(*)(void*))ai_pool_thread, worker);
+	}
+}
+
+void ai_job_free(ai_job_t* job) {
+	game_free(&job->g);
+	drop(job);
+}
+
+void ai_pool_free_jobs(vector_t* jobs) {
+	vector_iterator job_iter = vector_iterate(jobs);
+	while (vector_next(&job_iter)) ai_job_free(*(ai_job_t**)job_iter.x);
+	vector_free(jobs);
+}
+
+//stops the running searches and joins the workers, then frees every job not taken by ai_pool_done and the shared table
+void ai_pool_stop(ai_pool_t* pool) {
+	mtx_lock(&pool->lock);
+	pool->quit = 1;
+
+	vector_iterator job_iter = vector_iterate(&pool->running);
+	while (vector_next(&job_iter)) atomic_store(&(*(ai_job_t**)job_iter.x)->stop, 1);
+
+	cnd_broadcast(&pool->work);
+	mtx_unlock(&pool->lock);
+
+	for (int i=0; i<pool->threads; i++) thrd_join(pool->thrds[i], NULL);
+
+	//workers move their job to done before they see quit, so nothing is left running
+	ai_pool_free_jobs(&pool->queue);
+	ai_pool_free_jobs(&pool->running);
+	ai_pool_free_jobs(&pool->done);
+
+	if (pool->tt.entries) ai_tt_free(&pool->tt);
+
+	cnd_destroy(&pool->work);
+	mtx_destroy(&pool->lock);
+}
+
+ai_job_t* ai_job_new(unsigned game, unsigned gen, game_t* g) {
+	ai_job_t* job = heapcpy(sizeof(ai_job_t), &(ai_job_t){.game=game, .gen=gen, .g=game_copy(g), .found=0, .idle=0, .ponder=0, .yielded=0, .k=0, .lines_len=0});
+	atomic_init(&job->stop, 0);
+	atomic_init(&job->deadline, 0);
+	return job;
+}
+
+//queues a search on a copy of g, for the player to move
+void ai_pool_submit(ai_pool_t* pool, unsigned game, unsigned gen, game_t* g) {
+	ai_job_t* job = ai_job_new(game, gen, g);
+
+	mtx_lock(&pool->lock);
+	vector_pushcpy(&pool->queue, &job);
+
+	//every thread is busy, stop an idle job to make room
+	if (pool->running.length >= (unsigned)pool->threads) {
+		vector_iterator job_iter = vector_iterate(&pool->running);
+		while (vector_next(&job_iter)) {
+			ai_job_t* running = *(ai_job_t**)job_iter.x;
+			if (!running->idle || running->yielded) continue;
+
+			running->yielded = 1;
+			atomic_store(&running->stop, 1);
+			break;
+		}
+	}
+
+	cnd_signal(&pool->work);
+	mtx_unlock(&pool->lock);
+}
+
+//queues a ponder on g after the predicted move, gen being that of the position after it
+//returns 0 when the move is not legal or no ai is to move after it
+int ai_pool_ponder(ai_pool_t* pool, unsigned game, unsigned gen, game_t* g, move_t* predicted) {
+	ai_job_t* job = ai_job_new(game, gen, g);
+	job->idle = 1;
+	job->ponder = 1;
+
+	if (make_move(&job->g, predicted, 1, 1, job->g.player) != move_success || job->g.won
+		|| !((player_t*)vector_get(&job->g.players, job->g.player))->ai) {
+		ai_job_free(job);
+		return 0;
+	}
+
+	mtx_lock(&pool->lock);
+	vector_pushcpy(&pool->queue, &job);
+	cnd_signal(&pool->work);
+	mtx_unlock(&pool->lock);
+
+	return 1;
+}
+
+//the predicted move was played, the game's ponder becomes its search
+//time spent pondering counts towards the movetime, so the reply comes sooner
+//returns 0 if the ponder already came back through ai_pool_done or yielded
+int ai_pool_ponderhit(ai_pool_t* pool, unsigned game) {
+	int hit=0;
+	mtx_lock(&pool->lock);
+
+	vector_iterator job_iter = vector_iterate(&pool->queue);
+	while (vector_next(&job_iter)) {
+		ai_job_t* job = *(ai_job_t**)job_iter.x;
+		if (job->game==game && job->ponder) {
+			job->idle = 0;
+			job->ponder = 0;
+			hit = 1;
+		}
+	}
+
+	job_iter = vector_iterate(&pool->running);
+	while (vector_next(&job_iter)) {
+		ai_job_t* job = *(ai_job_t**)job_iter.x;
+		if (job->game!=game || !job->ponder || job->yielded) continue;
+
+		job->idle = 0;
+		job->ponder = 0;
+		atomic_store(&job->deadline, max(job->start+pool->movetime, ai_time()+AI_POOL_MINTIME));
+		hit = 1;
+	}
+
+	mtx_unlock(&pool->lock);
+	return hit;
+}
+
+//an idle job that yielded goes back at the end of the queue
+void ai_pool_requeue(ai_pool_t* pool, ai_job_t* job) {
+	atomic_store(&job->stop, 0);
+	job->yielded = 0;
+
+	mtx_lock(&pool->lock);
+	vector_pushcpy(&pool->queue, &job);
+	cnd_signal(&pool->work);
+	mtx_unlock(&pool->lock);
+}
+
+//queues ranked moves of g for the player to move, for analysis of a finished game
+//id and ply are returned in the game and gen of the job
+void ai_pool_analyze(ai_pool_t* pool, unsigned id, unsigned ply, game_t* g) {
+	ai_job_t* job = ai_job_new(id, ply, g);
+	job->idle = 1;
+	job->k = AI_POOL_LINES;
+
+	ai_pool_requeue(pool, job);
+}
+
+//stops the searches of a game, queued jobs are freed now
+//running ones end at their next node and still come back through ai_pool_done, aborted
+void ai_pool_cancel(ai_pool_t* pool, unsigned game) {
+	mtx_lock(&pool->lock);
+
+	//collected first, removing them while iterating the queue would skip the job after each
+	vector_t cancelled = vector_new(sizeof(ai_job_t*));
+
+	vector_iterator job_iter = vector_iterate(&pool->queue);
+	while (vector_next(&job_iter)) {
+		ai_job_t* job = *(ai_job_t**)job_iter.x;
+		if (job->game==game) vector_pushcpy(&cancelled, &job);
+	}
+
+	job_iter = vector_iterate(&cancelled);
+	while (vector_next(&job_iter)) vector_search_remove(&pool->queue, job_iter.x);
+	ai_pool_free_jobs(&cancelled);
+
+	job_iter = vector_iterate(&pool->running);
+	while (vector_next(&job_iter)) {
+		ai_job_t* job = *(ai_job_t**)job_iter.x;
+		if (job->game==game) atomic_store(&job->stop, 1);
+	}
+
+	mtx_unlock(&pool->lock);
+}
+
+//a finished job or NULL, free it with ai_job_free
+ai_job_t* ai_pool_done(ai_pool_t* pool) {
+	ai_job_t* job = NULL;
+
+	mtx_lock(&pool->lock);
+	if (pool->done.length>0) {
+		job = *(ai_job_t**)vector_get(&pool->done, 0);
+		vector_remove(&pool->done, 0);
+	}
+
+	mtx_unlock(&pool->lock);
+	return job;
+}
@@ -0,0 +1,74 @@
+// Automatically generated header.
+
+#pragma once
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include "threads.h"
+#include "vector.h"
+#include "util.h"
+#include "chess.h"
+#include "chessfrontend.h"
+#include "network.h"
+#include "ai.h"
+#define AI_POOL_MAXTHREADS 16
+#define AI_POOL_LINES 3 //ranked moves per analyzed position
+typedef struct {
+	unsigned game; //id of the server game
+	unsigned gen; //position the snapshot was taken from, results for older ones are dropped
+
+	game_t g; //snapshot, owned by the job
+	atomic_int stop;
+	_Atomic double deadline; //set when the job is taken, moved by a ponder hit
+	double start;
+	unsigned long nodes;
+	ai_stats_t stats;
+
+	char idle; //only taken when no other job waits, and gives its thread up to one that arrives
+	char ponder; //searching the position after a predicted move, on the opponent's time
+	char yielded; //an idle job stopped for another job, its result is too shallow to use
+
+	int found;
+	move_t m;
+
+	unsigned k; //lines to analyze instead of finding a move, 0 for none
+	unsigned lines_len;
+	ai_analysis_t lines[AI_POOL_LINES];
+} ai_job_t;
+typedef struct {
+	server_t* serv; //woken when a job is done
+
+	mtx_t lock;
+	cnd_t work;
+	vector_t queue; //ai_job_t*, oldest first
+	vector_t running; //ai_job_t*
+	vector_t done; //ai_job_t*, taken by ai_pool_done
+	char quit;
+
+	double movetime;
+	double pondertime;
+	unsigned long nodes;
+
+	int threads;
+	thrd_t thrds[AI_POOL_MAXTHREADS];
+
+	ai_tt_t tt; //from ai_pool_share, used by every worker instead of its own table
+	unsigned long searches; //since the start, as the counters of the table
+	unsigned long tt_probes;
+	unsigned long tt_hits;
+	unsigned long tt_shared_hits; //found entries another game stored
+} ai_pool_t;
+void ai_pool_stats(ai_pool_t* pool, FILE* f);
+void ai_pool_share(ai_pool_t* pool, size_t mb, char huge);
+void ai_pool_start(ai_pool_t* pool, server_t* serv, int threads);
+void ai_job_free(ai_job_t* job);
+void ai_pool_stop(ai_pool_t* pool);
+void ai_pool_submit(ai_pool_t* pool, unsigned game, unsigned gen, game_t* g);
+int ai_pool_ponder(ai_pool_t* pool, unsigned game, unsigned gen, game_t* g, move_t* predicted);
+int ai_pool_ponderhit(ai_pool_t* pool, unsigned game);
+void ai_pool_requeue(ai_pool_t* pool, ai_job_t* job);
+void ai_pool_analyze(ai_pool_t* pool, unsigned id, unsigned ply, game_t* g);
+void ai_pool_cancel(ai_pool_t* pool, unsigned game);
+ai_job_t* ai_pool_done(ai_pool_t* pool);
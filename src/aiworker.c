@@ -0,0 +1,89 @@
+#include <stdio.h>
+#include <emscripten.h>
+
+#include "chess.h"
+#include "chessfrontend.h"
+#include "ai.h"
+
+//the ai of the web build, in its own module so the page can run it in a worker and keep rendering while it searches or analyzes
+//aiworker_post.js is appended to the module, it passes games in and posts back what this calls it with
+//a search is cancelled by terminating the worker, its table and trees go with it
+
+ai_mcts_t* g_aiworker_mcts = NULL; //of games flagged game_mcts, reused while the next search is below them
+
+void aiworker_info(void* arg, ai_stats_t* stats) {
+	game_t* g = arg;
+	if (!stats->pv_len) return;
+
+	char* best = move_pgn(g, &stats->pv[0]);
+	vector_t m = vector_new(1);
+	write_move(&m, &stats->pv[0]);
+
+	EM_ASM(aiworker_progress($0, $1, $2, UTF8ToString($3), $4, $5);, stats->depth, (double)stats->nodes, stats->value, best, m.data, m.length);
+
+	vector_free(&m);
+	drop(best);
+}
+
+//reads a game written with write_game, frees data
+int aiworker_game(char* data, unsigned len, game_t* g) {
+	cur_t cur = {.start=data, .cur=data, .left=len, .err=0};
+	read_game(&cur, g, NULL, NULL);
+	drop(data);
+	return !cur.err;
+}
+
+//searches the game in data, written with write_game, for the player to move
+EMSCRIPTEN_KEEPALIVE
+void aiworker_search(char* data, unsigned len, int difficulty) {
+	game_t g;
+	if (!aiworker_game(data, len, &g)) {
+		EM_ASM(aiworker_move(0, 0););
+		return;
+	}
+
+	if (g.flags&game_mcts && !g_aiworker_mcts) {
+		ai_mcts_t mcts = ai_mcts_new();
+		g_aiworker_mcts = heapcpy(sizeof(ai_mcts_t), &mcts);
+	}
+
+	ai_settings_t settings = {.threads=1, .latency=ai_difficulty_latency(difficulty), .mcts_trees=g_aiworker_mcts,
+		.info=aiworker_info, .info_arg=&g};
+
+	//the move is written with write_move, nothing if there is none
+	move_t m;
+	vector_t out = vector_new(1);
+	if (ai_search(&g, &settings, &m)) write_move(&out, &m);
+
+	EM_ASM(aiworker_move($0, $1);, out.data, out.length);
+
+	vector_free(&out);
+	game_free(&g);
+}
+
+//ranks the k best moves of the player to move in the game in data, each line searched for movetime seconds
+//each line is passed on with its move written with write_move, then the end of the analysis
+EMSCRIPTEN_KEEPALIVE
+void aiworker_analyze(char* data, unsigned len, unsigned k, double movetime) {
+	game_t g;
+	if (!aiworker_game(data, len, &g)) {
+		EM_ASM(aiworker_analyzed(););
+		return;
+	}
+
+	ai_analysis_t* lines = heap(sizeof(ai_analysis_t)*k);
+	unsigned n = ai_analyze(&g, &(ai_settings_t){.threads=1, .movetime=movetime}, k, lines);
+
+	vector_t m = vector_new(1);
+	for (unsigned i=0; i<n; i++) {
+		vector_clear(&m);
+		write_move(&m, &lines[i].m);
+		EM_ASM(aiworker_line($0, $1, $2, $3);, lines[i].value, lines[i].depth, m.data, m.length);
+	}
+
+	EM_ASM(aiworker_analyzed(););
+
+	vector_free(&m);
+	drop(lines);
+	game_free(&g);
+}
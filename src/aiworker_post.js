@@ -0,0 +1,59 @@
+//message glue of the ai worker, appended to termchess_ai.js with --post-js so it shares the module's scope
+//a page starts it with new Worker("termchess_ai.js"), node with new Worker("./termchess_ai.js") from worker_threads
+//
+//in:  {game, difficulty}         game is a Uint8Array written by write_game
+//out: {progress, move}           after each round, progress is {depth, nodes, value, best}, best and move the best move so far
+//     {move}                     when the search is done, null if there is no move
+//
+//in:  {game, analyze, movetime}  ranks the best analyze moves, each searched for movetime seconds
+//out: {lines}                    when done, an array of {move, value, depth} from the best, empty if there is no move
+//moves are Uint8Arrays written by write_move and best is its move_pgn. terminating the worker cancels the search
+
+var aiworker_port = typeof importScripts==="function" ? self : require("worker_threads").parentPort;
+var aiworker_ready = false;
+var aiworker_queue = []; //games sent before the module was instantiated
+var aiworker_lines = []; //of the analysis running
+
+function aiworker_bytes(buf, len) {
+	return len ? HEAPU8.slice(buf, buf+len) : null;
+}
+
+//called from aiworker.c
+function aiworker_progress(depth, nodes, value, best, buf, len) {
+	aiworker_port.postMessage({progress: {depth: depth, nodes: nodes, value: value, best: best}, move: aiworker_bytes(buf, len)});
+}
+
+function aiworker_move(buf, len) {
+	aiworker_port.postMessage({move: aiworker_bytes(buf, len)});
+}
+
+function aiworker_line(value, depth, buf, len) {
+	aiworker_lines.push({move: aiworker_bytes(buf, len), value: value, depth: depth});
+}
+
+function aiworker_analyzed() {
+	aiworker_port.postMessage({lines: aiworker_lines});
+	aiworker_lines = [];
+}
+
+function aiworker_search(msg) {
+	let buf = _malloc(msg.game.byteLength);
+	HEAPU8.set(msg.game, buf);
+
+	if (msg.analyze) _aiworker_analyze(buf, msg.game.byteLength, msg.analyze, msg.movetime);
+	else _aiworker_search(buf, msg.game.byteLength, msg.difficulty);
+}
+
+function aiworker_message(msg) {
+	if (aiworker_ready) aiworker_search(msg);
+	else aiworker_queue.push(msg);
+}
+
+Module["onRuntimeInitialized"] = () => {
+	aiworker_ready = true;
+	aiworker_queue.forEach(aiworker_search);
+	aiworker_queue = [];
+};
+
+if (typeof importScripts==="function") self.onmessage = (ev) => aiworker_message(ev.data);
+else aiworker_port.on("message", aiworker_message);
@@ -0,0 +1,84 @@
+//checks a built termchess_ai.js answers a search and an analysis, see aiworker_post.js
+//node src/aiworker_test.js build/termchess_ai.js, exits nonzero on failure
+
+const {Worker} = require("worker_threads");
+const path = require("path");
+
+const P_KING = 0, P_QUEEN = 1, P_EMPTY = 9;
+
+//write_game of a queen and king against a king on 8x8, white to move
+function game() {
+	let bytes = [];
+	let int = (x) => bytes.push((x>>>24)&255, (x>>>16)&255, (x>>>8)&255, x&255);
+	let chr = (x) => bytes.push(x&255);
+	let str = (s) => { for (let c of Buffer.from(s)) chr(c); chr(0); };
+
+	int(0); //flags
+	chr(0); //promote_from
+	chr(P_QUEEN); //promote_to
+	chr(0); //castleable
+
+	chr(2); chr(-1); chr(0); //players, last_player, player
+	for (let name of ["white", "black"]) {
+		int(0); //board_rot
+		chr(0); chr(0); chr(0); chr(1); //check, ai, mate, joined
+		str(name);
+		chr(0); //allies
+	}
+
+	let board = [];
+	for (let i=0; i<64; i++) board.push([P_EMPTY, -1]);
+	board[7*8+4] = [P_KING, 0];
+	board[7*8+3] = [P_QUEEN, 0];
+	board[0*8+4] = [P_KING, 1];
+
+	int(8); int(8);
+	for (let vec of [board, board]) {
+		for (let [ty, player] of vec) { chr(ty); int(0); chr(player); }
+	}
+
+	int(0); //moves
+	return new Uint8Array(bytes);
+}
+
+function post(worker, msg, done) {
+	return new Promise((resolve, reject) => {
+		let timeout = setTimeout(() => reject(new Error("timed out")), 60000);
+		let seen = [];
+		worker.removeAllListeners("message");
+		worker.on("message", (m) => {
+			seen.push(m);
+			if (done(m)) {
+				clearTimeout(timeout);
+				resolve(seen);
+			}
+		});
+
+		worker.on("error", reject);
+		worker.postMessage(msg);
+	});
+}
+
+async function main() {
+	if (process.argv.length<3) {
+		console.error("usage: node aiworker_test.js termchess_ai.js");
+		process.exit(2);
+	}
+
+	let worker = new Worker(path.resolve(process.argv[2]));
+	let fail = (why) => { console.error(`fail: ${why}`); worker.terminate(); process.exit(1); };
+
+	let search = await post(worker, {game: game(), difficulty: 1}, (m) => !("progress" in m));
+	if (!search.some((m) => "progress" in m)) fail("no progress before the move");
+	let last = search[search.length-1];
+	if (!(last.move instanceof Uint8Array) || last.move.byteLength==0) fail("no move");
+
+	let analysis = await post(worker, {game: game(), analyze: 3, movetime: 0.2}, (m) => "lines" in m);
+	let lines = analysis[analysis.length-1].lines;
+	if (lines.length==0 || lines.some((l) => !(l.move instanceof Uint8Array))) fail("no lines");
+
+	console.log(`ok: ${search.length-1} progress, ${lines.length} lines`);
+	await worker.terminate();
+}
+
+main().catch((e) => { console.error(`fail: ${e.message}`); process.exit(1); });
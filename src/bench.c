@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <unistd.h>
+
+#include "chess.h"
+#include "chessfrontend.h"
+#include "ai.h"
+
+//benchmarks the first move of each variant, scaling threads from 1 to the core count
+//termchess_bench [-t threads] [-b table bits] [-l ms] [-d] [-n nodes] [-N network dir] [-E eval dir] [-j] [boards...]
+//-l searches for a latency instead of the depth picked from the number of moves
+//-d searches deterministically on one thread, -n to a node budget; moves, values and nodes then compare exactly between builds
+//-j prints a json object per run instead of the table
+
+char* BENCH_BOARDS[] = {"default.board", "doubleking.board", "fourplayer.board", "twovone.board", "capablanca.board", "heirchess.board", "ultimate.board"};
+#define BENCH_NUM_BOARDS 7
+#define BENCH_TT_BITS 20
+#define BENCH_DEPTHS 4 //time-to-depth columns, counting back from the deepest line
+
+typedef struct {
+	char* board;
+	int threads;
+	ai_stats_t stats;
+	char* move;
+} bench_row_t;
+
+int main(int argc, char** argv) {
+	int max_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned tt_bits = BENCH_TT_BITS;
+	char json = 0;
+	double latency = 0;
+	char deterministic = 0;
+	unsigned long nodes = 0;
+
+	vector_t boards = vector_new(sizeof(char*));
+
+	for (int i=1; i<argc; i++) {
+		if (streq(argv[i], "-t") && i+1<argc) max_threads = atoi(argv[++i]);
+		else if (streq(argv[i], "-b") && i+1<argc) tt_bits = (unsigned)atoi(argv[++i]);
+		else if (streq(argv[i], "-l") && i+1<argc) latency = atof(argv[++i])/1000;
+		else if (streq(argv[i], "-d")) deterministic = 1;
+		else if (streq(argv[i], "-n") && i+1<argc) nodes = strtoul(argv[++i], NULL, 10);
+		else if (streq(argv[i], "-N") && i+1<argc) ai_nns_open(argv[++i]);
+		else if (streq(argv[i], "-E") && i+1<argc) ai_evals_open(argv[++i]);
+		else if (streq(argv[i], "-j")) json = 1;
+		else vector_pushcpy(&boards, &argv[i]);
+	}
+
+	if (max_threads<1) max_threads=1;
+	if (max_threads>AI_MAXTHREADS) max_threads=AI_MAXTHREADS;
+	if (deterministic) max_threads=1;
+
+	if (boards.length==0) {
+		for (int i=0; i<BENCH_NUM_BOARDS; i++) vector_pushcpy(&boards, &BENCH_BOARDS[i]);
+	}
+
+	vector_t rows = vector_new(sizeof(bench_row_t));
+
+	vector_iterator board_iter = vector_iterate(&boards);
+	while (vector_next(&board_iter)) {
+		char* path = *(char**)board_iter.x;
+
+		for (int threads=1; threads<=max_threads; threads++) {
+			game_t g;
+			if (!parse_board_file(path, 0, &g)) {
+				fprintf(stderr, "could not read %s\n", path);
+				break;
+			}
+
+			//cold table each run so thread counts are comparable
+			ai_tt_t tt = ai_tt_new(tt_bits);
+			bench_row_t* row = vector_push(&rows);
+			row->board = path;
+			row->threads = threads;
+
+			move_t m;
+			ai_settings_t settings = {.threads=threads, .tt=&tt, .stats=&row->stats, .latency=latency, .nodes=nodes, .deterministic=deterministic};
+			if (ai_search(&g, &settings, &m)) {
+				row->move = move_pgn(&g, &m);
+			} else {
+				row->move = heapcpystr("none");
+			}
+
+			ai_tt_free(&tt);
+			game_free(&g);
+		}
+	}
+
+	if (json) {
+		vector_iterator row_iter = vector_iterate(&rows);
+		while (vector_next(&row_iter)) {
+			bench_row_t* row = row_iter.x;
+
+			char* stats = ai_stats_json(&row->stats);
+			printf("{\"board\":\"%s\",\"move\":\"%s\",\"stats\":%s}\n", row->board, row->move, stats);
+			drop(stats);
+			drop(row->move);
+		}
+
+		vector_free(&rows);
+		vector_free(&boards);
+		return 0;
+	}
+
+	printf("\n%-18s %7s %10s %8s %11s %7s %5s %4s %5s %6s  time to depth\n", "board", "threads", "nodes", "time", "nodes/s", "speedup", "depth", "beam", "ebf", "move");
+
+	vector_iterator row_iter = vector_iterate(&rows);
+	bench_row_t* single = NULL;
+	unsigned long total = 0;
+	while (vector_next(&row_iter)) {
+		bench_row_t* row = row_iter.x;
+		if (row->threads==1) single = row;
+		total += row->stats.nodes;
+
+		printf("%-18s %7i %10lu %7.3fs %11.0f %6.2fx %5i %4u %5.1f %6s ", row->board, row->threads, row->stats.nodes, row->stats.time,
+				row->stats.time>0 ? (double)row->stats.nodes/row->stats.time : 0,
+				row->stats.time>0 ? single->stats.time/row->stats.time : 0, row->stats.depth, row->stats.beam, row->stats.branching, row->move);
+
+		int deepest = 0;
+		for (int d=1; d<=AI_MAXDEPTH; d++) {
+			if (single->stats.depth_time[d]>0 && row->stats.depth_time[d]>0) deepest = d;
+		}
+
+		for (int d=max(deepest-BENCH_DEPTHS+1, 1); d<=deepest; d++) {
+			printf(" %i:%.3fs", d, row->stats.depth_time[d]);
+		}
+
+		printf("\n");
+		drop(row->move);
+	}
+
+	if (deterministic) printf("\ntotal nodes %lu\n", total); //the signature of a build
+
+	vector_free(&rows);
+	vector_free(&boards);
+	return 0;
+}
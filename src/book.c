@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "chess.h"
+#include "chessfrontend.h"
+#include "ai.h"
+
+//builds opening books from replays written by termchess_selfplay -r and games saved with write_game
+//termchess_book [-o dir] [-p plies] [-m weight] [-g] files...
+//-o is where a book per variant is written, as <variant>.book, the directory given to the server and engine with -O
+//-p plies from the start of each game that are kept
+//-m least weight a move needs, a win of the player moving weighs 2 and a draw 1
+//-g reads the files as games saved with write_game instead of replays, unfinished games are skipped
+//
+//games are replayed with the rules the web menu defaults to, same as termchess_engine
+
+#define BOOK_PLIES 16
+#define BOOK_MINWEIGHT 4
+
+typedef struct {
+	uint64_t variant;
+	vector_t entries; //ai_book_entry_t
+	unsigned games;
+} book_variant_t;
+
+typedef struct {
+	vector_t variants; //book_variant_t
+	int plies;
+	unsigned skipped;
+} book_t;
+
+book_variant_t* book_variant(book_t* b, game_t* g) {
+	uint64_t variant = ai_variant(g);
+
+	vector_iterator v_iter = vector_iterate(&b->variants);
+	while (vector_next(&v_iter)) {
+		book_variant_t* v = v_iter.x;
+		if (v->variant==variant) return v;
+	}
+
+	return vector_pushcpy(&b->variants, &(book_variant_t){.variant=variant, .entries=vector_new(sizeof(ai_book_entry_t)), .games=0});
+}
+
+//adds the first plies of moves played on g from its initial board
+//scores holds the result of each player, 1 for a win, 0.5 a draw and 0 a loss
+void book_add(book_t* b, game_t* g, vector_t* moves, double* scores) {
+	book_variant_t* v = book_variant(b, g);
+	v->games++;
+
+	ai_sym_t syms[AI_SYMS];
+	unsigned nsyms = ai_syms(g, syms);
+
+	vector_iterator m_iter = vector_iterate(moves);
+	while (vector_next(&m_iter) && (int)m_iter.i<b->plies && !g->won) {
+		move_t* m = m_iter.x;
+
+		uint32_t weight = (uint32_t)(scores[(int)g->player]*2);
+		if (weight>0) {
+			int sym;
+			ai_book_entry_t e = {.key=ai_hash_canonical(g, g->player, syms, nsyms, &sym),
+				.from={(uint8_t)m->from[0], (uint8_t)m->from[1]}, .to={(uint8_t)m->to[0], (uint8_t)m->to[1]}, .weight=weight};
+
+			if (sym!=-1) ai_book_entry_sym(g, &syms[sym], &e, 0);
+			vector_pushcpy(&v->entries, &e);
+		}
+
+		make_move(g, m, 0, 1, g->player);
+	}
+
+	ai_syms_free(syms, nsyms);
+}
+
+void book_replay_line(book_t* b, char* line) {
+	game_t g;
+	double* scores;
+	vector_t moves = vector_new(sizeof(move_t));
+
+	if (!read_replay(line, &g, &scores, &moves, b->plies)) {
+		b->skipped++;
+		vector_free(&moves);
+		return;
+	}
+
+	book_add(b, &g, &moves, scores);
+
+	vector_free(&moves);
+	game_free(&g);
+	drop(scores);
+}
+
+void book_replays(book_t* b, char* path) {
+	FILE* f = fopen(path, "r");
+	if (!f) {
+		fprintf(stderr, "could not read %s\n", path);
+		return;
+	}
+
+	char* line = NULL;
+	size_t line_cap = 0;
+	while (getline(&line, &line_cap, f) >= 0) book_replay_line(b, line);
+
+	if (line) free(line);
+	fclose(f);
+}
+
+void book_game(book_t* b, char* path) {
+	game_t g;
+	if (!read_game_file(path, &g)) {
+		fprintf(stderr, "could not read %s\n", path);
+		return;
+	}
+
+	double* scores = game_scores(&g);
+	if (!scores) {
+		b->skipped++;
+		game_free(&g);
+		return;
+	}
+
+	game_t start = game_replay(&g, 0);
+	book_add(b, &start, &g.moves, scores);
+
+	drop(scores);
+	game_free(&start);
+	game_free(&g);
+}
+
+int main(int argc, char** argv) {
+	book_t b = {.variants=vector_new(sizeof(book_variant_t)), .plies=BOOK_PLIES, .skipped=0};
+	char* dir = ".";
+	unsigned min = BOOK_MINWEIGHT;
+	char games = 0;
+
+	vector_t files = vector_new(sizeof(char*));
+
+	for (int i=1; i<argc; i++) {
+		if (streq(argv[i], "-o") && i+1<argc) dir = argv[++i];
+		else if (streq(argv[i], "-p") && i+1<argc) b.plies = atoi(argv[++i]);
+		else if (streq(argv[i], "-m") && i+1<argc) min = (unsigned)atoi(argv[++i]);
+		else if (streq(argv[i], "-g")) games = 1;
+		else vector_pushcpy(&files, &argv[i]);
+	}
+
+	if (files.length==0) {
+		fprintf(stderr, "usage: termchess_book [-o dir] [-p plies] [-m weight] [-g] files...\n");
+		return 1;
+	}
+
+	vector_iterator f_iter = vector_iterate(&files);
+	while (vector_next(&f_iter)) {
+		if (games) book_game(&b, *(char**)f_iter.x);
+		else book_replays(&b, *(char**)f_iter.x);
+	}
+
+	int ret = 0;
+
+	vector_iterator v_iter = vector_iterate(&b.variants);
+	while (vector_next(&v_iter)) {
+		book_variant_t* v = v_iter.x;
+
+		char* path = heapstr("%s/%016llx.book", dir, (unsigned long long)v->variant);
+		long len = ai_book_write(path, v->variant, &v->entries, min);
+
+		if (len<0) {
+			fprintf(stderr, "could not write %s\n", path);
+			ret = 1;
+		} else {
+			printf("%s: %u games, %li moves\n", path, v->games, len);
+		}
+
+		drop(path);
+		vector_free(&v->entries);
+	}
+
+	if (b.skipped) printf("%u games skipped\n", b.skipped);
+
+	vector_free(&b.variants);
+	vector_free(&files);
+	return ret;
+}
@@ -1,5 +1,7 @@
 #include <math.h>
 #include <string.h>
+#include <ctype.h>
+#include <limits.h>
 
 #include "vector.h"
 #include "hashtable.h"
@@ -60,6 +62,7 @@ typedef struct {
 
 typedef enum {
 	game_win_by_pieces = 1,
+	game_mcts = 2,
 } game_flags_t;
 
 typedef struct {
@@ -604,24 +607,121 @@ void piece_moves(game_t* g, piece_t* p, vector_t* moves, int check) {
 	}
 }
 
-int piece_moves_modified(game_t* g, piece_t* p, int* pos, int* other) {
-	//special case; pawns dont take pieces when colliding, so pos to to is invalid if to is blocking pawn
-	if (p->ty==p_pawn) {
-		int off[2] = {other[0]-pos[0], other[1]-pos[1]};
+void piece_depends_push(game_t* g, int pos[2], int off[2], int* squares, int* len) {
+	int x[2] = {pos[0]+off[0], pos[1]+off[1]};
+	if (board_get(g, x)) squares[(*len)++] = pos_i(g, x);
+}
 
-		int dir[2];
-		pawn_dir(dir, p->flags);
-		struct pawn_adj adj = pawn_adjacent(dir);
-		return i2eq(off, adj.adj[0]) || i2eq(off, adj.adj[1]) || i2eq(off, dir)
-					|| (p->flags & piece_firstmv && i2eq(off, (int[2]){dir[0]*2, dir[1]*2}));
+void piece_depends_ray(game_t* g, int pos[2], int sx, int sy, int* squares, int* len) {
+	int x[2] = {pos[0]+sx, pos[1]+sy};
+	piece_t* pt;
+	while ((pt=board_get(g, x))) {
+		squares[(*len)++] = pos_i(g, x);
+		if (pt->ty != p_empty) break;
+		x[0] += sx; x[1] += sy;
 	}
+}
 
-	move_t m = {.from={pos[0], pos[1]}, .to={other[0], other[1]}};
-	m.castle[0]=-1;
+//a line for castling matters up to the first piece if it can be castled with, otherwise only that piece does
+//since anything moving in between has moved and cannot be castled with either
+void piece_depends_castle(game_t* g, piece_t* p, int pos[2], int sx, int sy, int* squares, int* len) {
+	int start = *len;
+
+	int x[2] = {pos[0]+sx, pos[1]+sy};
+	piece_t* pt;
+	while ((pt=board_get(g, x))) {
+		squares[(*len)++] = pos_i(g, x);
+
+		if (pt->ty != p_empty) {
+			if (!(pt->flags & piece_firstmv && memchr(g->castleable.data, pt->ty, g->castleable.length)!=NULL
+					&& piece_owned(pt, p->player))) {
+				*len = start;
+				squares[(*len)++] = pos_i(g, x);
+			}
+
+			return;
+		}
+
+		x[0] += sx; x[1] += sy;
+	}
+
+	*len = start;
+}
+
+void piece_depends_rec(game_t* g, piece_t* p, piece_ty override, int pos[2], int* squares, int* len) {
+	switch (override) {
+		case p_blocked:
+		case p_empty: return;
+		case p_bishop:
+		case p_rook:
+		case p_queen: {
+			for (int sx=-1; sx<=1; sx++) {
+				for (int sy=-1; sy<=1; sy++) {
+					if ((sx==0&&sy==0)
+							|| (override==p_bishop && (sy==0 || sx==0))
+							|| (override==p_rook && (sy!=0 && sx!=0)))
+						continue;
+
+					piece_depends_ray(g, pos, sx, sy, squares, len);
+				}
+			}
+
+			break;
+		}
+		case p_heir:
+		case p_king: {
+			int off[2];
+			for (off[0]=-1; off[0]<=1; off[0]++) {
+				for (off[1]=-1; off[1]<=1; off[1]++) {
+					if (off[0]==0 && off[1]==0) continue;
+					piece_depends_push(g, pos, off, squares, len);
+					if (p->flags & piece_firstmv) piece_depends_castle(g, p, pos, off[0], off[1], squares, len);
+				}
+			}
+
+			break;
+		}
+		case p_knight: {
+			int offs[8][2] = {{1,2}, {2,1}, {-1,2}, {-2,1}, {-1,-2}, {-2,-1}, {1,-2}, {2,-1}};
+			for (int i=0; i<8; i++) piece_depends_push(g, pos, offs[i], squares, len);
+			break;
+		}
+		case p_pawn: {
+			int dir[2];
+			pawn_dir(dir, p->flags);
+			struct pawn_adj adj = pawn_adjacent(dir);
 
-	//is this seriously faster than just repeating piece_moves
-	//update: yes
-	return valid_move_override(g, p, p->ty==p_king?p_queen:p->ty, &m, 1); //override king to collide as a queen for castling
+			piece_depends_push(g, pos, dir, squares, len);
+			piece_depends_push(g, pos, adj.adj[0], squares, len);
+			piece_depends_push(g, pos, adj.adj[1], squares, len);
+			if (p->flags & piece_firstmv) piece_depends_push(g, pos, (int[2]){dir[0]*2, dir[1]*2}, squares, len);
+
+			break;
+		}
+		case p_archibishop: {
+			piece_depends_rec(g, p, p_bishop, pos, squares, len);
+			piece_depends_rec(g, p, p_knight, pos, squares, len);
+			break;
+		}
+		case p_chancellor: {
+			piece_depends_rec(g, p, p_rook, pos, squares, len);
+			piece_depends_rec(g, p, p_knight, pos, squares, len);
+			break;
+		}
+	}
+}
+
+//most squares a piece can depend on
+int piece_depends_max(game_t* g) {
+	return 2*(g->board_w+g->board_h) + 16;
+}
+
+//squares (by index) whose contents can change the moves of p
+//returns how many were written to squares, which holds piece_depends_max
+int piece_depends(game_t* g, piece_t* p, int pos[2], int* squares) {
+	int len = 0;
+	piece_depends_rec(g, p, p->ty, pos, squares, &len);
+	return len;
 }
 
 void next_player(game_t* g) {
@@ -738,7 +838,6 @@ game_t parse_board(char* str, game_flags_t flags) {
 
 	g.board_w = 0;
 	g.board_h = 0;
-	printf("%s\n", str);
 
 	while (1) {
 		if (skip_name(&str, "\nAlliance\n")) {
@@ -875,10 +974,46 @@ game_t parse_board(char* str, game_flags_t flags) {
 		p->check=player_check(&g, p_iter.i, p);
 	}
 
-	print_board(&g);
 	return g;
 }
 
+//rules the web menu defaults to, for native tools loading .board files
+int parse_board_file(char* path, game_flags_t flags, game_t* g) {
+	FILE* f = fopen(path, "rb");
+	if (!f) return 0;
+
+	fseek(f, 0, SEEK_END);
+	long len = ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	//unseekable, or a directory, which opens and seeks to LONG_MAX
+	if (len<0 || len==LONG_MAX) {
+		fclose(f);
+		return 0;
+	}
+
+	char* str = heap(len+1);
+	size_t read = fread(str, 1, len, f);
+	str[read] = 0;
+
+	int err = ferror(f);
+	fclose(f);
+
+	if (err) {
+		drop(str);
+		return 0;
+	}
+
+	*g = parse_board(str, flags);
+	drop(str);
+
+	vector_pushcpy(&g->promote_from, &(char){p_pawn});
+	g->promote_to = p_queen;
+	vector_pushcpy(&g->castleable, &(char){p_rook});
+
+	return 1;
+}
+
 char* move_pgn(game_t* g, move_t* m) {
 	static char alphabet[] = "abcdefghijklmnopqrstuvwxyz";
 	if (m->from[0]<sizeof(alphabet) && m->to[0]<sizeof(alphabet)) {
@@ -888,3 +1023,46 @@ char* move_pgn(game_t* g, move_t* m) {
 	}
 }
 
+//move_pgn without the space, for line protocols and replays; e2e4, or 27-1:28-2 past the alphabet
+char* move_str(game_t* g, move_t* m) {
+	char* str = move_pgn(g, m);
+	char* space = strchr(str, ' ');
+	if (!space) return str;
+
+	if (isalpha((unsigned char)str[0])) memmove(space, space+1, strlen(space+1)+1);
+	else *space = ':';
+
+	return str;
+}
+
+//finds the legal move of the player to move written as by move_str
+int move_parse(game_t* g, char* str, move_t* out) {
+	int found = 0;
+	vector_t moves = vector_new(sizeof(move_t));
+
+	vector_iterator p_iter = vector_iterate(&g->board);
+	while (!found && vector_next(&p_iter)) {
+		piece_t* p = p_iter.x;
+		if (!piece_edible(p) || !piece_owned(p, g->player)) continue;
+
+		vector_clear(&moves);
+		piece_moves(g, p, &moves, 1);
+
+		vector_iterator m_iter = vector_iterate(&moves);
+		while (vector_next(&m_iter)) {
+			char* m_str = move_str(g, m_iter.x);
+			int eq = streq(m_str, str);
+			drop(m_str);
+
+			if (eq) {
+				*out = *(move_t*)m_iter.x;
+				found = 1;
+				break;
+			}
+		}
+	}
+
+	vector_free(&moves);
+	return found;
+}
+
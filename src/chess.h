@@ -3,6 +3,7 @@
 #pragma once
 #include <math.h>
 #include <string.h>
+#include <ctype.h>
 #include "vector.h"
 #include "hashtable.h"
 #include "cfg.h"
@@ -51,6 +52,7 @@ typedef struct {
 } player_t;
 typedef enum {
 	game_win_by_pieces = 1,
+	game_mcts = 2,
 } game_flags_t;
 typedef struct {
 	vector_t spectators;
@@ -79,9 +81,11 @@ typedef struct {
 	piece_t piece_swap_from; //needed for eg. promotion, pawn_firstmv, etc
 	mp_extra_t m;
 } game_t;
+int clamp(int x, int min, int max);
 int pos_i(game_t* g, int x[2]);
 piece_t* board_get(game_t* g, int x[2]);
 int board_i(game_t* g, piece_t* ptr);
+void pawn_dir(int dir[2], piece_flags_t flags);
 int pawn_rot(piece_flags_t flags);
 void board_rot_pos(game_t* g, int rot, int pos[2], int pos_out[2]);
 static inline int i2eq(int a[2], int b[2]) {
@@ -100,12 +104,14 @@ void print_board(game_t* g);
 int valid_move(game_t* g, move_t* m, int collision);
 int board_pos_next(game_t* g, int* x);
 int player_check(game_t* g, char p_i, player_t* player);
+int promoteable(game_t* g, piece_t* p, int pos[2]);
 void castle_to_pos(move_t* m, int* pos);
 void move_noswap(game_t* g, move_t* m, piece_t* from, piece_t* to);
 void unmove_noswap(game_t* g, move_t* m, piece_t* from, piece_t* to, piece_t from_swap, piece_t to_swap);
 void move_swap(game_t* g, move_t* m);
 void piece_moves(game_t* g, piece_t* p, vector_t* moves, int check);
-int piece_moves_modified(game_t* g, piece_t* p, int* pos, int* other);
+int piece_depends_max(game_t* g);
+int piece_depends(game_t* g, piece_t* p, int pos[2], int* squares);
 void next_player(game_t* g);
 enum {
 	move_invalid,
@@ -115,4 +121,7 @@ enum {
 } make_move(game_t* g, move_t* m, int validate, int make, char player);
 void undo_move(game_t* g);
 game_t parse_board(char* str, game_flags_t flags);
+int parse_board_file(char* path, game_flags_t flags, game_t* g);
 char* move_pgn(game_t* g, move_t* m);
+char* move_str(game_t* g, move_t* m);
+int move_parse(game_t* g, char* str, move_t* out);
@@ -1,3 +1,5 @@
+#include <limits.h>
+
 #include "ai.h"
 #include "chess.h"
 #include "network.h"
@@ -22,7 +24,7 @@ typedef enum {
 	mp_make_game, //game name, players, board
 	mp_join_game, //game id, player name
 	mp_make_move, //move_t
-	mp_ai_move,
+	mp_ai_move, //ignored, the server plays ai seats
 	mp_leave_game, //nothing
 	mp_undo_move
 } mp_client_t;
@@ -66,6 +68,59 @@ void game_free(game_t* g) {
 	vector_free(&g->moves);
 }
 
+//deep copy for searching on another thread, freed with game_free
+game_t game_copy(game_t* g) {
+	game_t c = *g;
+
+	vector_cpy(&g->promote_from, &c.promote_from);
+	vector_cpy(&g->castleable, &c.castleable);
+	vector_cpy(&g->board, &c.board);
+	vector_cpy(&g->init_board, &c.init_board);
+	vector_cpy(&g->moves, &c.moves);
+
+	c.players = vector_new(sizeof(player_t));
+	vector_iterator p_iter = vector_iterate(&g->players);
+	while (vector_next(&p_iter)) {
+		player_t* p = p_iter.x;
+		player_t* cp = vector_pushcpy(&c.players, p);
+
+		cp->name = heapcpystr(p->name);
+		vector_cpy(&p->kings, &cp->kings);
+		vector_cpy(&p->allies, &cp->allies);
+	}
+
+	return c;
+}
+
+//the team left, or -1 while more than one has moves
+int game_winner(game_t* g) {
+	int winner = -1;
+
+	vector_iterator p_iter = vector_iterate(&g->players);
+	while (vector_next(&p_iter)) {
+		player_t* p = p_iter.x;
+		if (p->mate) continue;
+
+		if (winner==-1) winner = (int)p_iter.i;
+		else if (!is_ally((char)winner, vector_get(&g->players, winner), (char)p_iter.i)) return -1;
+	}
+
+	return winner;
+}
+
+//result of each player of a finished game, 1 for a win of its team, 0.5 a draw and 0 a loss; NULL while it goes on
+double* game_scores(game_t* g) {
+	int winner = game_winner(g);
+	if (!g->won && winner==-1) return NULL;
+
+	double* scores = heap(sizeof(double)*g->players.length);
+	for (unsigned i=0; i<g->players.length; i++) {
+		scores[i] = winner==-1 ? 0.5 : is_ally((char)winner, vector_get(&g->players, winner), (char)i) ? 1 : 0;
+	}
+
+	return scores;
+}
+
 void write_players(vector_t* data, game_t* g) {
 	vector_pushcpy(data, &(char){(char)g->players.length});
 	vector_pushcpy(data, &(char){g->last_player});
@@ -311,6 +366,32 @@ void read_game(cur_t* cur, game_t* g, char* joined, char* full) {
 	}
 }
 
+//reads a game saved with write_game from a file
+int read_game_file(char* path, game_t* g) {
+	FILE* f = fopen(path, "rb");
+	if (!f) return 0;
+
+	fseek(f, 0, SEEK_END);
+	long len = ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	//unseekable, or a directory, as in parse_board_file
+	if (len<0 || len==LONG_MAX) {
+		fclose(f);
+		return 0;
+	}
+
+	char* data = heap(len+1);
+	len = (long)fread(data, 1, len, f);
+	fclose(f);
+
+	cur_t cur = {.start=data, .cur=data, .left=(unsigned)len, .err=0};
+	read_game(&cur, g, NULL, NULL);
+	drop(data);
+
+	return !cur.err;
+}
+
 void mp_extra_free(mp_extra_t* m) {
 	vector_free(&m->spectators);
 }
@@ -339,6 +420,9 @@ typedef struct {
 
 	vector_t hints; //highlight pieces
 	struct {int from[2]; int to[2];} select;
+
+	int difficulty; //of the ai seats in singleplayer, picks their time per move
+	struct ai_mcts* mcts; //trees of the ai seats on games flagged game_mcts, kept between their moves
 } chess_client_t;
 
 //run whenever select changes or game update
@@ -378,31 +462,103 @@ void set_move_cursor(game_t* g, unsigned* cur, unsigned i) {
 	}
 }
 
+//copy of g as it was after its first i moves, freed with game_free
+game_t game_replay(game_t* g, unsigned i) {
+	game_t c = game_copy(g);
+
+	unsigned cur = c.moves.length;
+	set_move_cursor(&c, &cur, 0);
+	vector_clear(&c.moves);
+
+	c.player = 0;
+	c.last_player = -1;
+	c.won = 0;
+
+	vector_iterator p_iter = vector_iterate(&c.players);
+	while (vector_next(&p_iter)) {
+		player_t* p = p_iter.x;
+		p->check = p->mate = p->last_mate = 0;
+	}
+
+	for (unsigned j=0; j<i && j<g->moves.length; j++) {
+		make_move(&c, vector_get(&g->moves, j), 0, 1, c.player);
+	}
+
+	return c;
+}
+
+//parses a line written by termchess_selfplay -r, tokenizing it in place
+//<game> <board> <seats, A or B per player> <score for A> <end> moves <move_str ...>
+//into its game at the initial board, the score of each player, freed with drop, and up to plies of its moves (all if negative)
+//moves stop at the first that is not legal; returns 0 and leaves nothing to free if the line or its board cannot be read
+int read_replay(char* line, game_t* g, double** scores, vector_t* moves, int plies) {
+	char* save;
+	strtok_r(line, " \t\n", &save);
+	char* board = strtok_r(NULL, " \t\n", &save);
+	char* seats = strtok_r(NULL, " \t\n", &save);
+	char* score = strtok_r(NULL, " \t\n", &save);
+	strtok_r(NULL, " \t\n", &save);
+	char* moves_tok = strtok_r(NULL, " \t\n", &save);
+
+	if (!moves_tok || !streq(moves_tok, "moves") || !parse_board_file(board, 0, g)) return 0;
+
+	if (strlen(seats)!=g->players.length) {
+		game_free(g);
+		return 0;
+	}
+
+	*scores = heap(sizeof(double)*g->players.length);
+	for (unsigned i=0; i<g->players.length; i++) (*scores)[i] = seats[i]=='A' ? atof(score) : 1-atof(score);
+
+	//parsed on a copy, moves are only legal in the position they were played in
+	game_t parse = game_copy(g);
+
+	char* tok;
+	while ((plies<0 || (int)moves->length<plies) && (tok=strtok_r(NULL, " \t\n", &save))) {
+		move_t m;
+		if (parse.won || !move_parse(&parse, tok, &m)) break;
+
+		make_move(&parse, &m, 0, 1, parse.player);
+		vector_pushcpy(moves, &m);
+	}
+
+	game_free(&parse);
+	return 1;
+}
+
 void chess_client_set_move_cursor(chess_client_t* client, unsigned i) {
 	set_move_cursor(&client->g, &client->move_cursor, i);
 	refresh_hints(client);
 }
 
+//whether an ai seat is to move, the server plays them in multiplayer
+int chess_client_ai_turn(chess_client_t* client) {
+	if (client->mode==mode_multiplayer || client->g.won) return 0;
+
+	player_t* p = vector_get(&client->g.players, client->g.player);
+	return p->ai;
+}
+
+//after an ai seat moved; the seat to move is handed to the player once no ai is left to move
+void chess_client_ai_moved(chess_client_t* client) {
+	client->move_cursor = client->g.moves.length;
+	if (client->mode==mode_singleplayer && !client->g.won && !chess_client_ai_turn(client)) client->player = client->g.player;
+}
+
+//plays the ai seats on the calling thread until a player is to move
 int chess_client_ai(chess_client_t* client) {
 	int ret=0;
 	move_t m;
 
-	while (!client->g.won) {
-		player_t* p = vector_get(&client->g.players, client->g.player);
-		if (!p->ai) break;
+	while (chess_client_ai_turn(client)) {
+		if (client->g.flags&game_mcts && !client->mcts) {
+			ai_mcts_t mcts = ai_mcts_new();
+			client->mcts = heapcpy(sizeof(ai_mcts_t), &mcts);
+		}
 
-		ai_make_move(&client->g, &m);
+		ai_settings_t settings = {.threads=1, .latency=ai_difficulty_latency(client->difficulty), .mcts_trees=client->mcts};
+		if (!ai_make_move(&client->g, &settings, &m)) break;
 		ret=1;
-
-		if (client->mode==mode_multiplayer) {
-			vector_t data = vector_new(1);
-
-			vector_pushcpy(&data, &(char){mp_ai_move});
-			write_move(&data, &m);
-			client_send(client->net, &data);
-
-			vector_free(&data);
-		}
 	}
 
 	client->move_cursor = client->g.moves.length;
@@ -410,12 +566,11 @@ int chess_client_ai(chess_client_t* client) {
 	return ret;
 }
 
+//the ai seats are left to the caller, which may search off the thread
 void chess_client_initgame(chess_client_t* client, client_mode_t mode, char make) {
 	client->mode = mode;
 
 	if (make) {
-		chess_client_ai(client);
-
 		client->spectating = 0;
 		client->g.m.spectators = vector_new(sizeof(char*));
 
@@ -16,7 +16,7 @@ typedef enum {
 	mp_make_game, //game name, players, board
 	mp_join_game, //game id, player name
 	mp_make_move, //move_t
-	mp_ai_move,
+	mp_ai_move, //ignored, the server plays ai seats
 	mp_leave_game, //nothing
 	mp_undo_move
 } mp_client_t;
@@ -38,12 +38,16 @@ typedef enum {
 } mp_serv_t;
 #include "chess.h"
 void game_free(game_t* g);
+game_t game_copy(game_t* g);
+int game_winner(game_t* g);
+double* game_scores(game_t* g);
 void write_mp_extra(vector_t* data, mp_extra_t* extra);
 void write_move(vector_t* data, move_t* m);
 #include "network.h"
 move_t read_move(cur_t* cur);
 void write_game(vector_t* data, game_t* g);
 void read_game(cur_t* cur, game_t* g, char* joined, char* full);
+int read_game_file(char* path, game_t* g);
 void mp_extra_free(mp_extra_t* m);
 typedef struct {
 	char full;
@@ -68,10 +72,17 @@ typedef struct {
 
 	vector_t hints; //highlight pieces
 	struct {int from[2]; int to[2];} select;
+
+	int difficulty; //of the ai seats in singleplayer, picks their time per move
+	struct ai_mcts* mcts; //trees of the ai seats on games flagged game_mcts, kept between their moves
 } chess_client_t;
 void refresh_hints(chess_client_t* client);
 void set_move_cursor(game_t* g, unsigned* cur, unsigned i);
+game_t game_replay(game_t* g, unsigned i);
+int read_replay(char* line, game_t* g, double** scores, vector_t* moves, int plies);
 void chess_client_set_move_cursor(chess_client_t* client, unsigned i);
+int chess_client_ai_turn(chess_client_t* client);
+void chess_client_ai_moved(chess_client_t* client);
 int chess_client_ai(chess_client_t* client);
 void chess_client_initgame(chess_client_t* client, client_mode_t mode, char make);
 void pnum_leave(game_t* g, unsigned pnum);
@@ -0,0 +1,288 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "threads.h"
+
+#include "chess.h"
+#include "chessfrontend.h"
+#include "ai.h"
+
+//headless engine speaking a line protocol modelled on uci, for batch analysis and tournament managers
+//termchess_engine [-t threads] [-b table bits] [-O book dir] [-T tablebase dir] [-N network dir] [-E eval dir]
+//
+//uci, isready                          id lines and uciok, readyok
+//position board <file> [moves ...]     loads a .board file with the rules the web menu defaults to
+//position game <file> [moves ...]      loads a game saved with write_game, moves included
+//moves ...                             plays moves on the current position
+//go [nodes n] [movetime ms] [depth d]  searches in the background, info lines then bestmove
+//   [multipv k]                        ranks the best k moves, each searched with the limits, one info line each
+//   [latency ms]                       picks depth and beam width to take about this long on this machine
+//   [mcts]                             monte carlo tree search instead of the beam, its tree is kept for the next go
+//stop                                  ends the search early, bestmove is still printed
+//ucinewgame                            clears the transposition table and the mcts tree
+//d                                     prints the board and the player to move
+//quit
+//
+//moves are written as by move_str, the from and to squares without a space, e2e4 or e14f12
+
+#define ENGINE_TT_BITS 20
+
+typedef struct {
+	game_t g;
+	char loaded;
+
+	ai_tt_t tt;
+	ai_mcts_t mcts;
+	int threads;
+
+	thrd_t search;
+	char searching;
+	atomic_int stop;
+
+	ai_settings_t settings;
+	ai_stats_t stats;
+	unsigned multipv;
+
+	mtx_t out; //info and bestmove come from the search thread
+} engine_t;
+
+void engine_print(engine_t* e, const char* str) {
+	mtx_lock(&e->out);
+	printf("%s\n", str);
+	fflush(stdout);
+	mtx_unlock(&e->out);
+}
+
+void engine_info_line(engine_t* e, ai_stats_t* stats, char final) {
+	mtx_lock(&e->out);
+	printf("info depth %i nodes %lu time %.0f nps %.0f", stats->depth, stats->nodes, stats->time*1000, stats->nodes_per_sec);
+	if (final) printf(" beam %u ebf %.2f", stats->beam, stats->branching);
+
+	if (final && stats->pv_len>0) {
+		printf(" score %.3f pv", stats->value);
+		for (unsigned i=0; i<stats->pv_len; i++) {
+			char* str = move_str(&e->g, &stats->pv[i]);
+			printf(" %s", str);
+			drop(str);
+		}
+	}
+
+	printf("\n");
+	fflush(stdout);
+	mtx_unlock(&e->out);
+}
+
+void engine_info(void* arg, ai_stats_t* stats) {
+	engine_info_line(arg, stats, 0);
+}
+
+void engine_analyze(engine_t* e) {
+	ai_analysis_t* lines = heap(sizeof(ai_analysis_t)*e->multipv);
+	unsigned n = ai_analyze(&e->g, &e->settings, e->multipv, lines);
+
+	mtx_lock(&e->out);
+	for (unsigned i=0; i<n; i++) {
+		printf("info multipv %u depth %i score %.3f pv", i+1, lines[i].depth, lines[i].value);
+		for (unsigned j=0; j<lines[i].pv_len; j++) {
+			char* str = move_str(&e->g, &lines[i].pv[j]);
+			printf(" %s", str);
+			drop(str);
+		}
+
+		printf("\n");
+	}
+
+	if (n>0) {
+		char* str = move_str(&e->g, &lines[0].m);
+		printf("bestmove %s\n", str);
+		drop(str);
+	} else {
+		printf("bestmove none\n");
+	}
+
+	fflush(stdout);
+	mtx_unlock(&e->out);
+
+	drop(lines);
+}
+
+int engine_search(engine_t* e) {
+	if (e->multipv>1) {
+		engine_analyze(e);
+		return 1;
+	}
+
+	move_t m;
+	int found = ai_search(&e->g, &e->settings, &m);
+
+	engine_info_line(e, &e->stats, 1);
+
+	if (found) {
+		char* str = move_str(&e->g, &m);
+		char* line = heapstr("bestmove %s", str);
+		engine_print(e, line);
+		drop(line);
+		drop(str);
+	} else {
+		engine_print(e, "bestmove none");
+	}
+
+	return 1;
+}
+
+void engine_wait(engine_t* e) {
+	if (!e->searching) return;
+
+	thrd_join(e->search, NULL);
+	e->searching = 0;
+}
+
+int engine_load(engine_t* e, char* kind, char* path) {
+	game_t g;
+
+	if (streq(kind, "board")) {
+		if (!parse_board_file(path, 0, &g)) return 0;
+	} else if (streq(kind, "game")) {
+		if (!read_game_file(path, &g)) return 0;
+	} else {
+		return 0;
+	}
+
+	if (e->loaded) game_free(&e->g);
+	e->g = g;
+	e->loaded = 1;
+	return 1;
+}
+
+//plays the remaining tokens, stops at the first invalid move
+void engine_moves(engine_t* e, char* save) {
+	char* tok;
+	while ((tok=strtok_r(NULL, " \t\n", &save))) {
+		move_t m;
+		if (e->g.won || !move_parse(&e->g, tok, &m)) {
+			char* line = heapstr("info string illegal move %s", tok);
+			engine_print(e, line);
+			drop(line);
+			return;
+		}
+
+		make_move(&e->g, &m, 0, 1, e->g.player);
+	}
+}
+
+void engine_go(engine_t* e, char* save) {
+	e->settings = (ai_settings_t){.threads=e->threads, .tt=&e->tt, .mcts_trees=&e->mcts, .stats=&e->stats,
+		.stop=&e->stop, .info=engine_info, .info_arg=e};
+	e->multipv = 1;
+
+	char* tok;
+	while ((tok=strtok_r(NULL, " \t\n", &save))) {
+		if (streq(tok, "infinite")) continue; //the beam ends on its own, same as no limits
+
+		if (streq(tok, "mcts")) {
+			e->settings.mcts = 1;
+			continue;
+		}
+
+		char* arg = strtok_r(NULL, " \t\n", &save);
+		if (!arg) break;
+
+		if (streq(tok, "nodes")) e->settings.nodes = strtoul(arg, NULL, 10);
+		else if (streq(tok, "movetime")) e->settings.movetime = atof(arg)/1000;
+		else if (streq(tok, "depth")) e->settings.depth = atoi(arg);
+		else if (streq(tok, "latency")) e->settings.latency = atof(arg)/1000;
+		else if (streq(tok, "multipv")) e->multipv = (unsigned)clamp(atoi(arg), 1, 64);
+	}
+
+	atomic_store(&e->stop, 0);
+	e->searching = 1;
+	thrd_create(&e->search, (int(*)(void*))engine_search, e);
+}
+
+int main(int argc, char** argv) {
+	engine_t e = {.loaded=0, .threads=1, .searching=0};
+	unsigned tt_bits = ENGINE_TT_BITS;
+
+	for (int i=1; i<argc; i++) {
+		if (streq(argv[i], "-t") && i+1<argc) e.threads = clamp(atoi(argv[++i]), 1, AI_MAXTHREADS);
+		else if (streq(argv[i], "-b") && i+1<argc) tt_bits = (unsigned)atoi(argv[++i]);
+		else if (streq(argv[i], "-O") && i+1<argc) ai_books_open(argv[++i]);
+		else if (streq(argv[i], "-T") && i+1<argc) ai_tbs_open(argv[++i]);
+		else if (streq(argv[i], "-N") && i+1<argc) ai_nns_open(argv[++i]);
+		else if (streq(argv[i], "-E") && i+1<argc) ai_evals_open(argv[++i]);
+	}
+
+	e.tt = ai_tt_new(tt_bits);
+	e.mcts = ai_mcts_new();
+	atomic_init(&e.stop, 0);
+	mtx_init(&e.out, mtx_plain);
+
+	char* line = NULL;
+	size_t line_cap = 0;
+
+	while (getline(&line, &line_cap, stdin) >= 0) {
+		char* save;
+		char* cmd = strtok_r(line, " \t\n", &save);
+		if (!cmd) continue;
+
+		if (streq(cmd, "stop") || streq(cmd, "quit")) {
+			atomic_store(&e.stop, 1);
+			engine_wait(&e);
+			if (streq(cmd, "quit")) break;
+			continue;
+		} else if (streq(cmd, "isready")) {
+			engine_print(&e, "readyok");
+			continue;
+		}
+
+		//everything else acts on the position, which the search is using
+		engine_wait(&e);
+
+		if (streq(cmd, "uci")) {
+			engine_print(&e, "id name termchess");
+			engine_print(&e, "uciok");
+		} else if (streq(cmd, "ucinewgame")) {
+			ai_tt_free(&e.tt);
+			e.tt = ai_tt_new(tt_bits);
+			ai_mcts_free(&e.mcts);
+		} else if (streq(cmd, "position")) {
+			char* kind = strtok_r(NULL, " \t\n", &save);
+			char* path = strtok_r(NULL, " \t\n", &save);
+
+			if (!kind || !path || !engine_load(&e, kind, path)) {
+				engine_print(&e, "info string could not load position");
+				continue;
+			}
+
+			char* moves = strtok_r(NULL, " \t\n", &save);
+			if (moves && streq(moves, "moves")) engine_moves(&e, save);
+		} else if (!e.loaded) {
+			engine_print(&e, "info string no position");
+		} else if (streq(cmd, "moves")) {
+			engine_moves(&e, save);
+		} else if (streq(cmd, "go")) {
+			engine_go(&e, save);
+		} else if (streq(cmd, "d")) {
+			mtx_lock(&e.out);
+			print_board(&e.g);
+			printf("player %i%s\n", e.g.player, e.g.won ? " won" : "");
+			fflush(stdout);
+			mtx_unlock(&e.out);
+		} else {
+			char* unknown = heapstr("info string unknown command %s", cmd);
+			engine_print(&e, unknown);
+			drop(unknown);
+		}
+	}
+
+	atomic_store(&e.stop, 1);
+	engine_wait(&e);
+
+	if (line) free(line);
+	if (e.loaded) game_free(&e.g);
+	ai_tt_free(&e.tt);
+	ai_mcts_free(&e.mcts);
+	mtx_destroy(&e.out);
+	return 0;
+}
@@ -4,6 +4,7 @@
 #include "network.h"
 #include "chess.h"
 #include "chessfrontend.h"
+#include "ai.h"
 
 #include "imwasm.h"
 
@@ -26,6 +27,11 @@ char* boards[NUM_BOARDS*2] = {
 
 #define DEFAULT_SERVADDR "wss://esochess.net"
 
+#define ANALYSIS_LINES 3
+#define ANALYSIS_MOVETIME 0.5 //seconds per line
+
+char* DIFFICULTY_NAME[AI_DIFFICULTIES] = {"pushover", "novice", "adept", "master", "grandmaster"};
+
 typedef struct {
 	html_ui_t ui;
 
@@ -47,6 +53,19 @@ typedef struct {
 	//apparently we need two booleans to determine whether the player has been checkmated and when to disable it
 	int mate_change;
 	int check_displayed;
+
+	ai_analysis_t analysis[ANALYSIS_LINES];
+	unsigned analysis_len;
+	unsigned analysis_moves; //length of the game when analyzed, shown only until the next move
+	char analyzing; //in a worker of its own, apart from the ai seats'
+
+	//the ai seats search in the worker of termchess_ai.js
+	char ai_thinking;
+	int ai_depth; //of the last progress
+	float ai_value;
+	char* ai_best; //move_pgn of the best move so far, NULL before the first progress
+	char ai_has_m;
+	move_t ai_m; //played if the search is stopped early
 } chess_web_t;
 
 chess_web_t g_web;
@@ -68,8 +87,13 @@ typedef enum {
 	a_dropmove,
 	a_dragmove,
 	a_doai,
+	a_ai_progress,
+	a_ai_moved,
+	a_ai_movenow,
 	a_checkdisplayed,
 	a_undo_move,
+	a_analyze,
+	a_analyzed,
 	a_back
 } action_t;
 
@@ -127,6 +151,134 @@ void web_move(html_ui_t* ui, chess_web_t* web) { //wrapper level=3
 	}
 }
 
+//a move from the worker, written with write_move; frees data
+move_t web_ai_read(char* data, unsigned len) {
+	move_t m = read_move(&(cur_t){.start=data, .cur=data, .left=len, .err=0});
+	drop(data);
+	return m;
+}
+
+EMSCRIPTEN_KEEPALIVE
+void web_ai_progress(chess_web_t* web, int depth, float value, char* best, char* data, unsigned len) {
+	web->ai_depth = depth;
+	web->ai_value = value;
+	if (web->ai_best) drop(web->ai_best);
+	web->ai_best = best;
+
+	web->ai_has_m = len>0;
+	if (len) web->ai_m = web_ai_read(data, len);
+
+	html_send(&web->ui, a_ai_progress, NULL);
+}
+
+EMSCRIPTEN_KEEPALIVE
+void web_ai_moved(chess_web_t* web, char* data, unsigned len) {
+	move_t* m = len ? heapcpy(sizeof(move_t), &(move_t[]){web_ai_read(data, len)}) : NULL;
+	html_send(&web->ui, a_ai_moved, m);
+}
+
+//starts a search in the worker if an ai seat is to move, the page keeps rendering while it runs
+//the worker is kept between searches with its table, and made on the first
+void web_ai(chess_web_t* web) {
+	if (web->ai_thinking || !chess_client_ai_turn(&web->client)) return;
+
+	web->ai_thinking = 1;
+	web->ai_depth = 0;
+	web->ai_has_m = 0;
+	if (web->ai_best) drop(web->ai_best);
+	web->ai_best = NULL;
+
+	vector_t data = vector_new(1);
+	write_game(&data, &web->client.g);
+
+	MAIN_THREAD_EM_ASM({
+		if (!window.aiworker) aiworker = new Worker("termchess_ai.js");
+
+		let worker = aiworker;
+		worker.onmessage = (ev) => {
+			if (worker!==aiworker) return; //stopped, but its messages were already queued
+
+			let len = ev.data.move ? ev.data.move.byteLength : 0;
+			let buf = len ? _malloc(len) : 0;
+			if (len) HEAP8.set(ev.data.move, buf);
+
+			let p = ev.data.progress;
+			if (p) _web_ai_progress($2, p.depth, p.value, tocstr(p.best), buf, len);
+			else _web_ai_moved($2, buf, len);
+		};
+
+		worker.postMessage({game: HEAPU8.slice($0, $0+$1), difficulty: $3});
+	}, data.data, data.length, web, web->client.difficulty);
+
+	vector_free(&data);
+}
+
+//the worker is terminated, the next search makes a new one
+void web_ai_stop(chess_web_t* web) {
+	if (!web->ai_thinking) return;
+
+	MAIN_THREAD_EM_ASM({
+		aiworker.terminate();
+		aiworker = null;
+	});
+
+	web->ai_thinking = 0;
+}
+
+EMSCRIPTEN_KEEPALIVE
+void web_analysis_line(chess_web_t* web, unsigned i, float value, int depth, char* data, unsigned len) {
+	move_t m = web_ai_read(data, len);
+	if (i<ANALYSIS_LINES) web->analysis[i] = (ai_analysis_t){.m=m, .value=value, .depth=depth, .pv_len=0};
+}
+
+EMSCRIPTEN_KEEPALIVE
+void web_analyzed(chess_web_t* web, unsigned n) {
+	html_send(&web->ui, a_analyzed, (void*)(uintptr_t)n);
+}
+
+//ranks the best moves of the position in another worker of termchess_ai.js, the page keeps rendering meanwhile
+//lines are written into analysis as they come, and shown once they all have
+void web_analyze(chess_web_t* web) {
+	if (web->analyzing) return;
+
+	web->analyzing = 1;
+	web->analysis_len = 0;
+	web->analysis_moves = web->client.g.moves.length;
+
+	vector_t data = vector_new(1);
+	write_game(&data, &web->client.g);
+
+	MAIN_THREAD_EM_ASM({
+		if (!window.aianalysis) aianalysis = new Worker("termchess_ai.js");
+
+		aianalysis.onmessage = (ev) => {
+			ev.data.lines.forEach((line, i) => {
+				let len = line.move.byteLength;
+				let buf = _malloc(len);
+				HEAP8.set(line.move, buf);
+				_web_analysis_line($2, i, line.value, line.depth, buf, len);
+			});
+
+			_web_analyzed($2, ev.data.lines.length);
+		};
+
+		aianalysis.postMessage({game: HEAPU8.slice($0, $0+$1), analyze: $3, movetime: $4});
+	}, data.data, data.length, web, ANALYSIS_LINES, ANALYSIS_MOVETIME);
+
+	vector_free(&data);
+}
+
+//plays a move of the ai seat to move, then searches for the next one if it is also an ai
+void web_ai_play(html_ui_t* ui, chess_web_t* web, move_t* m) {
+	chess_client_set_move_cursor(&web->client, web->client.g.moves.length);
+	make_move(&web->client.g, m, 0, 1, web->client.g.player);
+	chess_client_ai_moved(&web->client);
+
+	refresh_hints(&web->client);
+	web_moved(ui, web, 1);
+	web_ai(web);
+}
+
 void update(html_ui_t* ui, html_event_t* ev, chess_web_t* web) {
 	web->err=NULL;
 
@@ -174,6 +326,7 @@ void update(html_ui_t* ui, html_event_t* ev, chess_web_t* web) {
 					break;
 				}
 				case mode_singleplayer: {
+					web_ai_stop(web);
 					chess_client_leavegame(&web->client);
 
 					web->client.mode = mode_menu;
@@ -260,6 +413,7 @@ void update(html_ui_t* ui, html_event_t* ev, chess_web_t* web) {
 			}
 
 			game_flags_t flags = html_checked("winbypieces") ? game_win_by_pieces : 0;
+			if (html_checked("mcts")) flags |= game_mcts;
 
 			char* b_i = html_input_value("boards");
 			if (streq(b_i, "custom")) {
@@ -320,6 +474,12 @@ void update(html_ui_t* ui, html_event_t* ev, chess_web_t* web) {
 
 			vector_free_strings(&ais);
 
+			if (!web->menu_multiplayer) {
+				char* d_i = html_input_value("difficulty");
+				web->client.difficulty = atoi(d_i);
+				drop(d_i);
+			}
+
 			if (ai_i==web->client.player) {
 				web->err = "you arent an ai, fool";
 				break;
@@ -332,6 +492,7 @@ void update(html_ui_t* ui, html_event_t* ev, chess_web_t* web) {
 			}
 
 			setup_game(web);
+			web_ai(web);
 			break;
 		}
 		case a_joingame: {
@@ -379,12 +540,28 @@ void update(html_ui_t* ui, html_event_t* ev, chess_web_t* web) {
 			break;
 		}
 		case a_doai: {
-			int moved = chess_client_ai(&web->client);
-			refresh_hints(&web->client);
-			web_moved(ui, web, moved);
+			web_ai(web);
+			break;
+		}
+		case a_ai_progress: break; //rerendered with the depth and best move
+		case a_ai_moved: {
+			move_t* m = ev->custom_data;
+			web->ai_thinking = 0;
+
+			if (m) {
+				web_ai_play(ui, web, m);
+				drop(m);
+			}
 
 			break;
 		}
+		case a_ai_movenow: {
+			if (!web->ai_thinking) break;
+
+			web_ai_stop(web);
+			if (web->ai_has_m) web_ai_play(ui, web, &web->ai_m);
+			break;
+		}
 		case a_checkdisplayed: {
 			web->check_displayed=1;
 			break;
@@ -398,6 +575,7 @@ void update(html_ui_t* ui, html_event_t* ev, chess_web_t* web) {
 			break;
 		}
 		case a_undo_move: {
+			web_ai_stop(web);
 			chess_client_undo_move(&web->client);
 			clearhints(web);
 
@@ -405,6 +583,15 @@ void update(html_ui_t* ui, html_event_t* ev, chess_web_t* web) {
 
 			break;
 		}
+		case a_analyze: {
+			web_analyze(web);
+			break;
+		}
+		case a_analyzed: {
+			web->analyzing = 0;
+			web->analysis_len = min((unsigned)(uintptr_t)ev->custom_data, ANALYSIS_LINES);
+			break;
+		}
 	}
 
 	if (web->client.net && web->client.net->err) {
@@ -512,6 +699,10 @@ void render(html_ui_t* ui, chess_web_t* web) {
 				html_label(ui, "winbypieces-label", "win by pieces?");
 				html_checkbox(ui, "winbypieces", NULL, NULL, 0);
 
+				html_br(ui);
+				html_label(ui, "mcts-label", "ai plays by monte carlo tree search?");
+				html_checkbox(ui, "mcts", NULL, NULL, 0);
+
 				html_end(ui);
 
 				html_elem_t* e = html_button(ui, "next", "next");
@@ -553,6 +744,19 @@ void render(html_ui_t* ui, chess_web_t* web) {
 
 				html_end(ui);
 
+				//the server picks the time of its ai seats
+				if (!web->menu_multiplayer) {
+					html_label(ui, "difficulty-label", "ai difficulty:");
+					html_start_select(ui, "difficulty", 0);
+					for (int i=0; i<AI_DIFFICULTIES; i++) {
+						char* istr = heapstr("%i", i);
+						html_option(ui, DIFFICULTY_NAME[i], istr, i==AI_DIFFICULTY_DEFAULT);
+						drop(istr);
+					}
+
+					html_end(ui);
+				}
+
 				html_elem_t* b = html_button(ui, "make", "make thy gracious game");
 				html_event(ui, b, html_click, a_makegame);
 
@@ -656,8 +860,38 @@ void render(html_ui_t* ui, chess_web_t* web) {
 						|| web->client.g.last_player==web->client.player)
 				html_event(ui, html_button(ui, "undo", "undo"), html_click, a_undo_move);
 
+			if (web->ai_thinking) {
+				char* str = web->ai_best ? heapstr("thinking: %s %+.2f (%i)", web->ai_best, web->ai_value, web->ai_depth) : heapstr("thinking");
+				html_p(ui, "thinking", str);
+				drop(str);
+
+				html_event(ui, html_button(ui, "movenow", "move now"), html_click, a_ai_movenow);
+			}
+
+			int analyzed = web->analysis_len>0 && web->analysis_moves==web->client.g.moves.length;
+			if (web->analyzing)
+				html_p(ui, "analyzing", "analyzing");
+			else if (!web->client.g.won && web->client.move_cursor==web->client.g.moves.length)
+				html_event(ui, html_button(ui, "analyze", "analyze"), html_click, a_analyze);
+
+			if (analyzed) {
+				html_start_div(ui, "analysis", 1);
+				for (unsigned i=0; i<web->analysis_len; i++) {
+					ai_analysis_t* line = &web->analysis[i];
+					char* pgn = move_pgn(&web->client.g, &line->m);
+					char* str = heapstr("%s %+.2f (%i)", pgn, line->value, line->depth);
+					html_p(ui, NULL, str);
+					drop(str);
+					drop(pgn);
+				}
+
+				html_end(ui);
+			}
+
 			html_end(ui);
 
+			move_t* suggested = analyzed && web->client.move_cursor==web->client.g.moves.length ? &web->analysis[0].m : NULL;
+
 			move_t* last_m = vector_get(&web->client.g.moves, web->client.g.moves.length-1);
 
 			html_start_table(ui, "board");
@@ -725,6 +959,8 @@ void render(html_ui_t* ui, chess_web_t* web) {
 						html_set_attr(td, html_class, NULL, "selected");
 					} else if (client_hint_search(&web->client, bpos)!=NULL) {
 						html_set_attr(td, html_class, NULL, "hint");
+					} else if (suggested && (i2eq(suggested->from, bpos) || i2eq(suggested->to, bpos))) {
+						html_set_attr(td, html_class, NULL, "suggested");
 					} else if (last_m && i2eq(last_m->from, bpos)) {
 						html_set_attr(td, html_class, NULL, "from");
 					} else if (last_m && i2eq(last_m->to, bpos)) {
@@ -763,6 +999,11 @@ int main() {
 
 	g_web.err = NULL;
 	g_web.client.net = NULL;
+	g_web.client.mcts = NULL;
+	g_web.analysis_len = 0;
+	g_web.analyzing = 0;
+	g_web.ai_thinking = 0;
+	g_web.ai_best = NULL;
 
 	html_run(&g_web.ui, (update_t)update, (render_t)render, &g_web);
 }
\ No newline at end of file
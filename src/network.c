@@ -89,10 +89,12 @@ typedef struct {
 	vector_t conn_upgrade;
 	vector_t msg;
 
-	vector_t conns; //0 is server
+	vector_t conns; //0 is server, 1 is wake
 	vector_t nums;
 	map_t num_conns;
 	unsigned num;
+
+	int wake[2]; //written by server_wake from other threads to interrupt poll
 } server_t;
 
 typedef struct {
@@ -102,6 +104,9 @@ typedef struct {
 	int err;
 } cur_t;
 
+//listener and wake come before connections in conns
+#define SERVER_FDS 2
+
 #define HTTP_LINE_BUF 1024
 char* WS_GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
 
@@ -228,9 +233,39 @@ server_t start_server(int port, char upgrade) {
 	struct pollfd pfd = {.fd=sock, .events=POLLIN};
 	vector_pushcpy(&serv.conns, &pfd);
 	vector_pushcpy(&serv.nums, &(unsigned){serv.num++});
+
+#ifdef _WIN32
+	//pipes cant be polled, a udp socket connected to itself works the same
+	int wake = socket(AF_INET, SOCK_DGRAM, 0);
+	struct sockaddr_in wake_addr = {.sin_family=AF_INET, .sin_addr.s_addr=htonl(INADDR_LOOPBACK), .sin_port=0};
+	socklen_t wake_len = sizeof(wake_addr);
+
+	if (bind(wake, (struct sockaddr*)&wake_addr, wake_len)==-1
+		|| getsockname(wake, (struct sockaddr*)&wake_addr, &wake_len)==-1
+		|| connect(wake, (struct sockaddr*)&wake_addr, wake_len)==-1)
+		perrorx("could not create wake socket");
+
+	ioctlsocket(wake, FIONBIO, &(u_long){1});
+	serv.wake[0] = serv.wake[1] = wake;
+#else
+	if (pipe(serv.wake)==-1) perrorx("could not create wake pipe");
+	fcntl(serv.wake[0], F_SETFL, fcntl(serv.wake[0], F_GETFL) | O_NONBLOCK);
+#endif
+
+	vector_pushcpy(&serv.conns, &(struct pollfd){.fd=serv.wake[0], .events=POLLIN});
+	vector_pushcpy(&serv.nums, &(unsigned){serv.num++});
 	return serv;
 }
 
+//safe from any thread, server_recv returns a null cur with num 0 soon after
+void server_wake(server_t* serv) {
+#ifdef _WIN32
+	send(serv->wake[1], "w", 1, 0);
+#else
+	write(serv->wake[1], "w", 1);
+#endif
+}
+
 cur_t server_recv(server_t* serv, unsigned* i) {
 	cur_t cur = {.err=0};
 	while (1) {
@@ -246,7 +281,20 @@ cur_t server_recv(server_t* serv, unsigned* i) {
 			if (!pfd->revents) continue;
 
 			char hup=0;
-			if (poll_iter.i==0) {
+			if (poll_iter.i==1) {
+				char buf[64]; //several wakes may have piled up
+#ifdef _WIN32
+				while (recv(pfd->fd, buf, sizeof(buf), 0)>0);
+#else
+				while (read(pfd->fd, buf, sizeof(buf))>0);
+#endif
+
+				pfd->revents = 0;
+				*i = 0;
+
+				cur.start=NULL;
+				return cur;
+			} else if (poll_iter.i==0) {
 				int new = accept(pfd->fd, NULL, NULL);
 				vector_pushcpy(&serv->conns, &(struct pollfd){.fd=new, .events=POLLIN});
 				vector_pushcpy(&serv->nums, &serv->num);
@@ -258,7 +306,7 @@ cur_t server_recv(server_t* serv, unsigned* i) {
 				hup=1;
 			} else if (pfd->revents & POLLIN) {
 				*i = *(unsigned*)vector_get(&serv->nums, poll_iter.i);
-				char* upgraded = vector_get(&serv->conn_upgrade, poll_iter.i-1);
+				char* upgraded = vector_get(&serv->conn_upgrade, poll_iter.i-SERVER_FDS);
 
 				if (serv->upgrade && !*upgraded){
 					char linebuf[HTTP_LINE_BUF];
@@ -341,7 +389,7 @@ cur_t server_recv(server_t* serv, unsigned* i) {
 					}
 				} else if (serv->upgrade) {
 					char exist=0;
-					server_msg_t* msg = vector_setget(&serv->msg, poll_iter.i-1, &exist);
+					server_msg_t* msg = vector_setget(&serv->msg, poll_iter.i-SERVER_FDS, &exist);
 					if (!exist) {
 						msg->frames = vector_new(1);
 						msg->fin = 0;
@@ -374,17 +422,17 @@ cur_t server_recv(server_t* serv, unsigned* i) {
 
 			if (hup) {
 				if (serv->upgrade) {
-					char* upgraded = vector_get(&serv->conn_upgrade, poll_iter.i-1);
+					char* upgraded = vector_get(&serv->conn_upgrade, poll_iter.i-SERVER_FDS);
 					if (*upgraded) {
 						write_frame(pfd->fd, ws_close, NULL);
 					}
 
-					vector_remove(&serv->conn_upgrade, poll_iter.i-1);
+					vector_remove(&serv->conn_upgrade, poll_iter.i-SERVER_FDS);
 
-					server_msg_t* msg = vector_get(&serv->msg, poll_iter.i-1);
+					server_msg_t* msg = vector_get(&serv->msg, poll_iter.i-SERVER_FDS);
 					if (msg) {
 						vector_free(&msg->frames);
-						vector_remove(&serv->msg, poll_iter.i-1);
+						vector_remove(&serv->msg, poll_iter.i-SERVER_FDS);
 					}
 				}
 
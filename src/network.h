@@ -85,10 +85,12 @@ typedef struct {
 	vector_t conn_upgrade;
 	vector_t msg;
 
-	vector_t conns; //0 is server
+	vector_t conns; //0 is server, 1 is wake
 	vector_t nums;
 	map_t num_conns;
 	unsigned num;
+
+	int wake[2]; //written by server_wake from other threads to interrupt poll
 } server_t;
 typedef struct {
 	char* start;
@@ -103,6 +105,9 @@ server_t start_server(int port, char upgrade);
 cur_t server_recv(server_t* serv, unsigned* i);
 #endif
 #ifndef __EMSCRIPTEN__
+void server_wake(server_t* serv);
+#endif
+#ifndef __EMSCRIPTEN__
 void server_send(server_t* serv, unsigned i, vector_t* data);
 #endif
 typedef struct {
@@ -0,0 +1,314 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "chess.h"
+#include "chessfrontend.h"
+#include "ai.h"
+
+//trains evaluation networks from replays written by termchess_selfplay -r
+//termchess_nntrain [-o dir] [-e epochs] [-r rate] [-s seed] [-k plies] files...
+//-o is where a network per variant is written, as <variant>.nn, the directory given to the server, engine and selfplay with -N
+//-e passes over the positions
+//-r learning rate of the stochastic gradient descent
+//-k plies from the start of each game that are left out, selfplay's random opening
+//
+//every position of a game is labelled with its result for each team, 1 for a win, 0.5 a draw and 0 a loss,
+//and each player's output is fit so the logistic of it over NNTRAIN_SCALE pawns is that result
+//games are replayed with the rules the web menu defaults to, same as termchess_engine
+
+#define NNTRAIN_EPOCHS 20
+#define NNTRAIN_RATE 0.01f
+#define NNTRAIN_SKIP 4
+#define NNTRAIN_SCALE 3.0f //score in pawns at which a position counts as about three quarters of a win
+#define NNTRAIN_MAXPLAYERS 4
+#define NNTRAIN_CLIP 1.0f //largest input weight, so an accumulator of 256 pieces stays in int16_t
+#define NNTRAIN_INIT 0.1f //range of the random initial weights
+
+typedef struct {
+	unsigned feature; //first in the variant's features
+	unsigned len;
+	float result[NNTRAIN_MAXPLAYERS];
+} nntrain_position_t;
+
+typedef struct {
+	uint64_t variant;
+	unsigned squares;
+	unsigned players;
+	unsigned games;
+	vector_t features; //uint32_t, (player*p_empty + type)*squares + square of each piece
+	vector_t positions; //nntrain_position_t
+
+	float* bias; //[hidden]
+	float* input; //[features][hidden]
+	float* output; //[players][hidden]
+	float output_bias[NNTRAIN_MAXPLAYERS];
+} nntrain_variant_t;
+
+typedef struct {
+	vector_t variants; //nntrain_variant_t
+	int skip;
+	unsigned skipped;
+	uint64_t rng;
+} nntrain_t;
+
+uint64_t nntrain_rand(uint64_t* rng) {
+	*rng ^= *rng << 13;
+	*rng ^= *rng >> 7;
+	*rng ^= *rng << 17;
+	return *rng;
+}
+
+float nntrain_uniform(uint64_t* rng, float range) {
+	return ((float)(nntrain_rand(rng)>>40)/(float)(1<<24)*2-1)*range;
+}
+
+nntrain_variant_t* nntrain_variant(nntrain_t* t, game_t* g) {
+	uint64_t variant = ai_variant(g);
+
+	vector_iterator v_iter = vector_iterate(&t->variants);
+	while (vector_next(&v_iter)) {
+		nntrain_variant_t* v = v_iter.x;
+		if (v->variant==variant) return v;
+	}
+
+	return vector_pushcpy(&t->variants, &(nntrain_variant_t){.variant=variant, .squares=(unsigned)(g->board_w*g->board_h),
+		.players=g->players.length, .games=0, .features=vector_new(sizeof(uint32_t)), .positions=vector_new(sizeof(nntrain_position_t))});
+}
+
+void nntrain_position(nntrain_variant_t* v, game_t* g, double* scores) {
+	nntrain_position_t pos = {.feature=v->features.length, .len=0};
+	for (unsigned i=0; i<v->players; i++) pos.result[i] = (float)scores[i];
+
+	vector_iterator p_iter = vector_iterate(&g->board);
+	while (vector_next(&p_iter)) {
+		piece_t* p = p_iter.x;
+		if (!piece_edible(p)) continue;
+
+		uint32_t feature = ((uint32_t)p->player*p_empty + p->ty)*v->squares + (uint32_t)p_iter.i;
+		vector_pushcpy(&v->features, &feature);
+		pos.len++;
+	}
+
+	vector_pushcpy(&v->positions, &pos);
+}
+
+void nntrain_replay_line(nntrain_t* t, char* line) {
+	game_t g;
+	double* scores;
+	vector_t moves = vector_new(sizeof(move_t));
+
+	if (!read_replay(line, &g, &scores, &moves, -1)) {
+		t->skipped++;
+		vector_free(&moves);
+		return;
+	}
+
+	if (g.players.length<=NNTRAIN_MAXPLAYERS) {
+		nntrain_variant_t* v = nntrain_variant(t, &g);
+		v->games++;
+
+		vector_iterator m_iter = vector_iterate(&moves);
+		while (vector_next(&m_iter)) {
+			make_move(&g, m_iter.x, 0, 1, g.player);
+			if ((int)m_iter.i>=t->skip && !g.won) nntrain_position(v, &g, scores);
+		}
+	} else {
+		t->skipped++;
+	}
+
+	vector_free(&moves);
+	game_free(&g);
+	drop(scores);
+}
+
+void nntrain_replays(nntrain_t* t, char* path) {
+	FILE* f = fopen(path, "r");
+	if (!f) {
+		fprintf(stderr, "could not read %s\n", path);
+		return;
+	}
+
+	char* line = NULL;
+	size_t line_cap = 0;
+	while (getline(&line, &line_cap, f) >= 0) nntrain_replay_line(t, line);
+
+	if (line) free(line);
+	fclose(f);
+}
+
+void nntrain_init(nntrain_t* t, nntrain_variant_t* v) {
+	size_t features = (size_t)v->players*p_empty*v->squares;
+	v->bias = heap(sizeof(float)*AI_NN_HIDDEN);
+	v->input = heap(sizeof(float)*features*AI_NN_HIDDEN);
+	v->output = heap(sizeof(float)*v->players*AI_NN_HIDDEN);
+
+	//biased into the linear part of the relu
+	for (int i=0; i<AI_NN_HIDDEN; i++) v->bias[i] = 0.5f;
+	for (size_t i=0; i<features*AI_NN_HIDDEN; i++) v->input[i] = nntrain_uniform(&t->rng, NNTRAIN_INIT);
+	for (unsigned i=0; i<v->players*AI_NN_HIDDEN; i++) v->output[i] = nntrain_uniform(&t->rng, NNTRAIN_INIT);
+	for (unsigned i=0; i<v->players; i++) v->output_bias[i] = 0;
+}
+
+//one step of gradient descent on the squared error of the win chance, returns the error
+float nntrain_step(nntrain_variant_t* v, nntrain_position_t* pos, float rate) {
+	uint32_t* features = vector_get(&v->features, pos->feature);
+
+	float acc[AI_NN_HIDDEN];
+	memcpy(acc, v->bias, sizeof(acc));
+	for (unsigned f=0; f<pos->len; f++) {
+		float* w = &v->input[features[f]*AI_NN_HIDDEN];
+		for (int i=0; i<AI_NN_HIDDEN; i++) acc[i] += w[i];
+	}
+
+	float h[AI_NN_HIDDEN];
+	for (int i=0; i<AI_NN_HIDDEN; i++) h[i] = fminf(fmaxf(acc[i], 0), 1);
+
+	float err = 0;
+	float grad_h[AI_NN_HIDDEN] = {0};
+
+	for (unsigned k=0; k<v->players; k++) {
+		float* w = &v->output[k*AI_NN_HIDDEN];
+		float out = v->output_bias[k];
+		for (int i=0; i<AI_NN_HIDDEN; i++) out += w[i]*h[i];
+
+		float p = 1/(1+expf(-out/NNTRAIN_SCALE));
+		float d = p-pos->result[k];
+		err += d*d;
+
+		float grad = 2*d*p*(1-p)/NNTRAIN_SCALE;
+		for (int i=0; i<AI_NN_HIDDEN; i++) {
+			grad_h[i] += grad*w[i];
+			w[i] -= rate*grad*h[i];
+		}
+
+		v->output_bias[k] -= rate*grad;
+	}
+
+	for (int i=0; i<AI_NN_HIDDEN; i++) {
+		if (acc[i]<=0 || acc[i]>=1) grad_h[i] = 0;
+		v->bias[i] -= rate*grad_h[i];
+	}
+
+	for (unsigned f=0; f<pos->len; f++) {
+		float* w = &v->input[features[f]*AI_NN_HIDDEN];
+		for (int i=0; i<AI_NN_HIDDEN; i++) w[i] = fminf(fmaxf(w[i] - rate*grad_h[i], -NNTRAIN_CLIP), NNTRAIN_CLIP);
+	}
+
+	return err/(float)v->players;
+}
+
+void nntrain_train(nntrain_t* t, nntrain_variant_t* v, int epochs, float rate) {
+	unsigned n = v->positions.length;
+	unsigned* order = heap(sizeof(unsigned)*n);
+	for (unsigned i=0; i<n; i++) order[i] = i;
+
+	for (int epoch=0; epoch<epochs; epoch++) {
+		for (unsigned i=n; i>1; i--) {
+			unsigned j = (unsigned)(nntrain_rand(&t->rng)%i);
+			unsigned tmp = order[i-1];
+			order[i-1] = order[j];
+			order[j] = tmp;
+		}
+
+		double err = 0;
+		for (unsigned i=0; i<n; i++) err += nntrain_step(v, vector_get(&v->positions, order[i]), rate);
+
+		printf("%016llx epoch %i: error %.5f\n", (unsigned long long)v->variant, epoch+1, err/n);
+		fflush(stdout);
+	}
+
+	drop(order);
+}
+
+int16_t nntrain_quantize(float x, float scale) {
+	return (int16_t)clamp((int)roundf(x*scale), -32767, 32767);
+}
+
+int nntrain_write(nntrain_variant_t* v, char* path) {
+	FILE* f = fopen(path, "wb");
+	if (!f) return 0;
+
+	ai_nn_header_t h = {.magic=AI_NN_MAGIC, .version=AI_NN_VERSION, .variant=v->variant,
+		.squares=v->squares, .players=v->players, .types=p_empty, .hidden=AI_NN_HIDDEN};
+	fwrite(&h, sizeof(h), 1, f);
+
+	size_t features = (size_t)v->players*p_empty*v->squares;
+	int16_t* q = heap(sizeof(int16_t)*features*AI_NN_HIDDEN);
+
+	for (int i=0; i<AI_NN_HIDDEN; i++) q[i] = nntrain_quantize(v->bias[i], AI_NN_QA);
+	fwrite(q, sizeof(int16_t), AI_NN_HIDDEN, f);
+
+	for (size_t i=0; i<features*AI_NN_HIDDEN; i++) q[i] = nntrain_quantize(v->input[i], AI_NN_QA);
+	fwrite(q, sizeof(int16_t), features*AI_NN_HIDDEN, f);
+
+	for (unsigned i=0; i<v->players*AI_NN_HIDDEN; i++) q[i] = nntrain_quantize(v->output[i], AI_NN_QB);
+	fwrite(q, sizeof(int16_t), v->players*AI_NN_HIDDEN, f);
+
+	for (unsigned i=0; i<v->players; i++) {
+		int32_t b = (int32_t)lroundf(v->output_bias[i]*AI_NN_QA*AI_NN_QB);
+		fwrite(&b, sizeof(int32_t), 1, f);
+	}
+
+	drop(q);
+	return fclose(f)==0;
+}
+
+int main(int argc, char** argv) {
+	nntrain_t t = {.variants=vector_new(sizeof(nntrain_variant_t)), .skip=NNTRAIN_SKIP, .skipped=0, .rng=1};
+	char* dir = ".";
+	int epochs = NNTRAIN_EPOCHS;
+	float rate = NNTRAIN_RATE;
+
+	vector_t files = vector_new(sizeof(char*));
+
+	for (int i=1; i<argc; i++) {
+		if (streq(argv[i], "-o") && i+1<argc) dir = argv[++i];
+		else if (streq(argv[i], "-e") && i+1<argc) epochs = atoi(argv[++i]);
+		else if (streq(argv[i], "-r") && i+1<argc) rate = (float)atof(argv[++i]);
+		else if (streq(argv[i], "-s") && i+1<argc) t.rng = strtoull(argv[++i], NULL, 10) | 1;
+		else if (streq(argv[i], "-k") && i+1<argc) t.skip = atoi(argv[++i]);
+		else vector_pushcpy(&files, &argv[i]);
+	}
+
+	if (files.length==0) {
+		fprintf(stderr, "usage: termchess_nntrain [-o dir] [-e epochs] [-r rate] [-s seed] [-k plies] files...\n");
+		return 1;
+	}
+
+	vector_iterator f_iter = vector_iterate(&files);
+	while (vector_next(&f_iter)) nntrain_replays(&t, *(char**)f_iter.x);
+
+	int ret = 0;
+
+	vector_iterator v_iter = vector_iterate(&t.variants);
+	while (vector_next(&v_iter)) {
+		nntrain_variant_t* v = v_iter.x;
+
+		if (v->positions.length>0) {
+			nntrain_init(&t, v);
+			nntrain_train(&t, v, epochs, rate);
+
+			char* path = heapstr("%s/%016llx.nn", dir, (unsigned long long)v->variant);
+			if (!nntrain_write(v, path)) {
+				fprintf(stderr, "could not write %s\n", path);
+				ret = 1;
+			} else {
+				printf("%s: %u games, %u positions\n", path, v->games, (unsigned)v->positions.length);
+			}
+
+			drop(path);
+			drop(v->bias);
+			drop(v->input);
+			drop(v->output);
+		}
+
+		vector_free(&v->features);
+		vector_free(&v->positions);
+	}
+
+	if (t.skipped) printf("%u games skipped\n", t.skipped);
+
+	vector_free(&t.variants);
+	vector_free(&files);
+	return ret;
+}
@@ -0,0 +1,391 @@
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include "threads.h"
+
+#include "chess.h"
+#include "chessfrontend.h"
+#include "ai.h"
+
+//plays two ai configurations against each other until a sequential probability ratio test decides
+//termchess_selfplay [-j jobs] [-n games] [-s seed] [-o opening plies] [-m max plies]
+//	[-e elo0,elo1] [-r replay file] [-N network dir] [-d] [-A config] [-B config] [boards...]
+//
+//-d searches deterministically, movetime is left out and every search starts from an empty table, and plays one
+//game at a time since the test stops at whichever game decides it; the same seed then plays the same games and
+//the node counts compare exactly between builds
+//
+//a config is a comma separated list of key=value, limits nodes, movetime (ms) and depth, mcts=1 for
+//monte carlo tree search instead of the beam, net=0 to leave out the networks from -N, and eval
+//parameters ally, advance, mobility, a piece name for its value or center.<piece> for its centrality;
+//params=<file> first sets them all from a file written by termchess_tune. null=0 and lmr=0 leave out
+//null moves and reductions, null.material and lmr=<moves> set where they start
+//eg. -A nodes=20000 -B nodes=20000,mobility=0.02,center.knight=0.15, -A movetime=200 -B movetime=200,mcts=1
+//or -A nodes=20000 -B nodes=20000,null=0,lmr=0
+//
+//games come in pairs from the same random opening with the sides swapped; on boards with more than
+//two teams A takes every other team. each line of the replay is
+//<game> <board> <seats, A or B per player> <score for A> <end> moves <move_str ...>
+//so the moves can be given to termchess_engine after "position board <board>"
+
+char* SELFPLAY_BOARDS[] = {"default.board", "doubleking.board", "fourplayer.board", "twovone.board", "capablanca.board", "heirchess.board", "ultimate.board"};
+#define SELFPLAY_NUM_BOARDS 7
+#define SELFPLAY_GAMES 2000
+#define SELFPLAY_OPENING 4 //random plies before the engines take over
+#define SELFPLAY_MAXPLIES 300 //adjudicated a draw past this
+#define SELFPLAY_NODES 20000 //per move unless a config sets a limit
+#define SELFPLAY_TT_BITS 18
+#define SELFPLAY_MAXPLAYERS 16
+#define SELFPLAY_ALPHA 0.05
+#define SELFPLAY_BETA 0.05
+
+typedef struct {
+	ai_eval_params_t eval;
+	unsigned long nodes;
+	double movetime;
+	int depth;
+	char mcts;
+} selfplay_config_t;
+
+typedef struct {
+	unsigned long moves;
+	unsigned long nodes;
+	double time;
+} selfplay_side_t;
+
+typedef struct {
+	selfplay_config_t configs[2];
+	vector_t boards; //char*
+	unsigned games;
+	uint64_t seed;
+	int opening;
+	int maxplies;
+	double elo0, elo1;
+	char deterministic;
+
+	atomic_uint next_pair;
+	atomic_int done; //the test decided or every game was played
+
+	mtx_t lock; //everything below
+	unsigned played;
+	unsigned wins, draws, losses; //for A
+	selfplay_side_t sides[2];
+	FILE* replay;
+} selfplay_t;
+
+uint64_t selfplay_rand(uint64_t* state) { //xorshift64*
+	*state ^= *state>>12;
+	*state ^= *state<<25;
+	*state ^= *state>>27;
+	return *state * 0x2545f4914f6cdd1dULL;
+}
+
+int selfplay_config(selfplay_config_t* cfg, char* spec) {
+	char* save;
+	for (char* kv=strtok_r(spec, ",", &save); kv; kv=strtok_r(NULL, ",", &save)) {
+		char* eq = strchr(kv, '=');
+		if (!eq) return 0;
+
+		*eq = 0;
+		char* key = kv;
+		double v = atof(eq+1);
+
+		if (streq(key, "params")) {
+			uint64_t variant;
+			if (!ai_eval_read(eq+1, &variant, &cfg->eval)) return 0;
+			continue;
+		}
+
+		float* center = NULL;
+		if (strncmp(key, "center.", 7)==0) {
+			key += 7;
+			center = cfg->eval.center;
+		}
+
+		if (streq(key, "nodes")) cfg->nodes = (unsigned long)v;
+		else if (streq(key, "movetime")) cfg->movetime = v/1000;
+		else if (streq(key, "depth")) cfg->depth = (int)v;
+		else if (streq(key, "mcts")) cfg->mcts = v!=0;
+		else if (streq(key, "net")) cfg->eval.net = v!=0;
+		else if (streq(key, "ally")) cfg->eval.ally = (float)v;
+		else if (streq(key, "advance")) cfg->eval.advance = (float)v;
+		else if (streq(key, "mobility")) cfg->eval.mobility = (float)v;
+		else if (streq(key, "null")) cfg->eval.null = (float)v;
+		else if (streq(key, "null.material")) cfg->eval.null_material = (float)v;
+		else if (streq(key, "lmr")) cfg->eval.lmr = (float)v;
+		else {
+			int ty;
+			for (ty=0; ty<p_empty; ty++) {
+				if (strncasecmp(key, PIECE_NAME[ty], strlen(key))==0) break;
+			}
+
+			if (ty==p_empty) return 0;
+			(center ? center : cfg->eval.piece)[ty] = (float)v;
+		}
+	}
+
+	return 1;
+}
+
+//each distinct team gets the next index, so sides can alternate between teams
+void selfplay_seats(game_t* g, int swap, char* seats) {
+	int team[SELFPLAY_MAXPLAYERS];
+	int teams = 0;
+
+	vector_iterator p_iter = vector_iterate(&g->players);
+	while (vector_next(&p_iter)) {
+		int t = teams;
+		for (unsigned i=0; i<p_iter.i; i++) {
+			if (is_ally((char)p_iter.i, p_iter.x, (char)i)) {
+				t = team[i];
+				break;
+			}
+		}
+
+		if (t==teams) teams++;
+		team[p_iter.i] = t;
+		seats[p_iter.i] = (char)((t+swap)%2);
+	}
+}
+
+int selfplay_random_move(game_t* g, uint64_t* rng, move_t* out) {
+	vector_t moves = vector_new(sizeof(move_t));
+
+	vector_iterator p_iter = vector_iterate(&g->board);
+	while (vector_next(&p_iter)) {
+		piece_t* p = p_iter.x;
+		if (piece_edible(p) && piece_owned(p, g->player)) piece_moves(g, p, &moves, 1);
+	}
+
+	int found = moves.length>0;
+	if (found) *out = *(move_t*)vector_get(&moves, selfplay_rand(rng)%moves.length);
+
+	vector_free(&moves);
+	return found;
+}
+
+//logistic elo of a score
+double selfplay_elo(double score) {
+	score = fmin(fmax(score, 1e-6), 1-1e-6);
+	return -400*log10(1/score - 1);
+}
+
+//generalized sprt on the trinomial results with a normal approximation
+double selfplay_llr(selfplay_t* sp) {
+	double n = sp->wins+sp->draws+sp->losses;
+	if (n==0 || sp->wins+sp->draws==0 || sp->losses+sp->draws==0) return 0;
+
+	double score = (sp->wins + sp->draws/2.0)/n;
+	double var = (sp->wins*pow(1-score, 2) + sp->draws*pow(0.5-score, 2) + sp->losses*pow(score, 2))/n;
+	if (var<=0) return 0;
+
+	double s0 = 1/(1+pow(10, -sp->elo0/400)), s1 = 1/(1+pow(10, -sp->elo1/400));
+	return n*(s1-s0)*(2*score-s0-s1)/(2*var);
+}
+
+void selfplay_game(selfplay_t* sp, unsigned game, ai_tt_t* tts, ai_mcts_t* trees) {
+	char* board = *(char**)vector_get(&sp->boards, (game/2)%sp->boards.length);
+
+	game_t g;
+	if (!parse_board_file(board, 0, &g) || g.players.length>SELFPLAY_MAXPLAYERS) {
+		fprintf(stderr, "could not read %s\n", board);
+		atomic_store(&sp->done, 1);
+		return;
+	}
+
+	char seats[SELFPLAY_MAXPLAYERS];
+	selfplay_seats(&g, (int)(game%2), seats);
+
+	ai_tt_clear(&tts[0]);
+	ai_tt_clear(&tts[1]);
+
+	selfplay_side_t sides[2] = {{0}};
+	uint64_t rng = (sp->seed + (game/2+1)*0x9e3779b97f4a7c15ULL) | 1;
+
+	char* end = "maxplies";
+	int winner = -1;
+
+	for (int ply=0; ply<sp->maxplies; ply++) {
+		if ((winner=game_winner(&g))!=-1) {
+			end = "mate";
+			break;
+		}
+
+		move_t m;
+		if (ply<sp->opening) {
+			if (!selfplay_random_move(&g, &rng, &m)) {
+				end = "nomoves";
+				break;
+			}
+		} else {
+			char side = seats[(int)g.player];
+			selfplay_config_t* cfg = &sp->configs[(int)side];
+
+			ai_stats_t stats;
+			ai_settings_t settings = {.threads=1, .tt=&tts[(int)side], .stats=&stats, .eval=&cfg->eval,
+				.nodes=cfg->nodes, .movetime=cfg->movetime, .depth=cfg->depth, .mcts=cfg->mcts, .mcts_trees=&trees[(int)side],
+				.deterministic=sp->deterministic, .seed=rng+(uint64_t)ply};
+
+			if (!ai_search(&g, &settings, &m)) {
+				end = "nomoves";
+				break;
+			}
+
+			sides[(int)side].moves++;
+			sides[(int)side].nodes += stats.nodes;
+			sides[(int)side].time += stats.time;
+		}
+
+		make_move(&g, &m, 0, 1, g.player);
+	}
+
+	if (winner==-1 && (winner=game_winner(&g))!=-1) end = "mate";
+
+	double score = winner==-1 ? 0.5 : (seats[winner]==0 ? 1 : 0);
+
+	mtx_lock(&sp->lock);
+
+	if (score==1) sp->wins++;
+	else if (score==0) sp->losses++;
+	else sp->draws++;
+
+	for (int i=0; i<2; i++) {
+		sp->sides[i].moves += sides[i].moves;
+		sp->sides[i].nodes += sides[i].nodes;
+		sp->sides[i].time += sides[i].time;
+	}
+
+	sp->played++;
+
+	double llr = selfplay_llr(sp);
+	double lower = log(SELFPLAY_BETA/(1-SELFPLAY_ALPHA)), upper = log((1-SELFPLAY_BETA)/SELFPLAY_ALPHA);
+	if (llr<=lower || llr>=upper || sp->played>=sp->games) atomic_store(&sp->done, 1);
+
+	fprintf(stderr, "\rgames %u  +%u =%u -%u  llr %.2f (%.2f, %.2f)", sp->played, sp->wins, sp->draws, sp->losses, llr, lower, upper);
+
+	if (sp->replay) {
+		fprintf(sp->replay, "%u %s ", game, board);
+		for (unsigned i=0; i<g.players.length; i++) fputc(seats[i] ? 'B' : 'A', sp->replay);
+		fprintf(sp->replay, " %g %s moves", score, end);
+
+		vector_iterator m_iter = vector_iterate(&g.moves);
+		while (vector_next(&m_iter)) {
+			char* str = move_str(&g, m_iter.x);
+			fprintf(sp->replay, " %s", str);
+			drop(str);
+		}
+
+		fprintf(sp->replay, "\n");
+		fflush(sp->replay);
+	}
+
+	mtx_unlock(&sp->lock);
+
+	game_free(&g);
+}
+
+int selfplay_worker(selfplay_t* sp) {
+	ai_tt_t tts[2] = {ai_tt_new(SELFPLAY_TT_BITS), ai_tt_new(SELFPLAY_TT_BITS)};
+	ai_mcts_t* trees = heap(sizeof(ai_mcts_t)*2);
+	trees[0] = ai_mcts_new();
+	trees[1] = ai_mcts_new();
+
+	while (!atomic_load(&sp->done)) {
+		unsigned pair = atomic_fetch_add(&sp->next_pair, 1);
+		if (pair*2>=sp->games) break;
+
+		selfplay_game(sp, pair*2, tts, trees);
+		if (!atomic_load(&sp->done)) selfplay_game(sp, pair*2+1, tts, trees);
+	}
+
+	ai_tt_free(&tts[0]);
+	ai_tt_free(&tts[1]);
+	ai_mcts_free(&trees[0]);
+	ai_mcts_free(&trees[1]);
+	drop(trees);
+	return 1;
+}
+
+int main(int argc, char** argv) {
+	selfplay_t sp = {.games=SELFPLAY_GAMES, .seed=1, .opening=SELFPLAY_OPENING, .maxplies=SELFPLAY_MAXPLIES,
+		.elo0=0, .elo1=5, .deterministic=0, .played=0, .wins=0, .draws=0, .losses=0, .replay=NULL};
+
+	for (int i=0; i<2; i++) sp.configs[i] = (selfplay_config_t){.eval=g_ai_eval, .nodes=0, .movetime=0, .depth=0, .mcts=0};
+
+	int jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	sp.boards = vector_new(sizeof(char*));
+
+	for (int i=1; i<argc; i++) {
+		if (streq(argv[i], "-j") && i+1<argc) jobs = atoi(argv[++i]);
+		else if (streq(argv[i], "-n") && i+1<argc) sp.games = (unsigned)atoi(argv[++i]);
+		else if (streq(argv[i], "-s") && i+1<argc) sp.seed = strtoull(argv[++i], NULL, 10);
+		else if (streq(argv[i], "-o") && i+1<argc) sp.opening = atoi(argv[++i]);
+		else if (streq(argv[i], "-m") && i+1<argc) sp.maxplies = atoi(argv[++i]);
+		else if (streq(argv[i], "-e") && i+1<argc) sscanf(argv[++i], "%lf,%lf", &sp.elo0, &sp.elo1);
+		else if (streq(argv[i], "-N") && i+1<argc) ai_nns_open(argv[++i]);
+		else if (streq(argv[i], "-d")) sp.deterministic = 1;
+		else if (streq(argv[i], "-r") && i+1<argc) {
+			sp.replay = fopen(argv[++i], "w");
+			if (!sp.replay) perrorx("could not open replay");
+		} else if ((streq(argv[i], "-A") || streq(argv[i], "-B")) && i+1<argc) {
+			if (!selfplay_config(&sp.configs[argv[i][1]=='B'], argv[i+1])) {
+				fprintf(stderr, "bad config %s\n", argv[i+1]);
+				return 1;
+			}
+
+			i++;
+		} else {
+			vector_pushcpy(&sp.boards, &argv[i]);
+		}
+	}
+
+	if (sp.boards.length==0) {
+		for (int i=0; i<SELFPLAY_NUM_BOARDS; i++) vector_pushcpy(&sp.boards, &SELFPLAY_BOARDS[i]);
+	}
+
+	for (int i=0; i<2; i++) {
+		selfplay_config_t* cfg = &sp.configs[i];
+		if (!cfg->nodes && (cfg->movetime<=0 || sp.deterministic) && !cfg->depth) cfg->nodes = SELFPLAY_NODES;
+	}
+
+	jobs = clamp(jobs, 1, AI_MAXTHREADS);
+	if (sp.deterministic) jobs = 1; //games finishing out of order would move where the test stops
+
+	atomic_init(&sp.next_pair, 0);
+	atomic_init(&sp.done, 0);
+	mtx_init(&sp.lock, mtx_plain);
+
+	thrd_t* thrds = heap(sizeof(thrd_t)*jobs);
+	for (int i=1; i<jobs; i++) thrd_create(&thrds[i], (int(*)(void*))selfplay_worker, &sp);
+	selfplay_worker(&sp);
+	for (int i=1; i<jobs; i++) thrd_join(thrds[i], NULL);
+	drop(thrds);
+
+	fprintf(stderr, "\n");
+
+	double n = sp.wins+sp.draws+sp.losses;
+	double score = n>0 ? (sp.wins+sp.draws/2.0)/n : 0.5;
+	double var = n>0 ? (sp.wins*pow(1-score, 2) + sp.draws*pow(0.5-score, 2) + sp.losses*pow(score, 2))/n : 0;
+	double margin = n>0 ? 1.96*sqrt(var/n) : 0;
+
+	double llr = selfplay_llr(&sp);
+	double lower = log(SELFPLAY_BETA/(1-SELFPLAY_ALPHA)), upper = log((1-SELFPLAY_BETA)/SELFPLAY_ALPHA);
+
+	printf("games %u: +%u =%u -%u, score %.1f%%\n", sp.played, sp.wins, sp.draws, sp.losses, score*100);
+	printf("elo %+.1f, 95%% [%+.1f, %+.1f]\n", selfplay_elo(score), selfplay_elo(score-margin), selfplay_elo(score+margin));
+	printf("sprt elo0 %g elo1 %g: llr %.2f (%.2f, %.2f), %s\n", sp.elo0, sp.elo1, llr, lower, upper,
+			llr>=upper ? "H1 accepted" : (llr<=lower ? "H0 accepted" : "inconclusive"));
+
+	for (int i=0; i<2; i++) {
+		selfplay_side_t* side = &sp.sides[i];
+		printf("%c: %lu moves, %lu nodes, %.3fs and %.0f nodes per move\n", i ? 'B' : 'A', side->moves, side->nodes,
+				side->moves ? side->time/side->moves : 0, side->moves ? (double)side->nodes/side->moves : 0);
+	}
+
+	if (sp.replay) fclose(sp.replay);
+	mtx_destroy(&sp.lock);
+	vector_free(&sp.boards);
+	return 0;
+}
@@ -2,6 +2,7 @@
 #include "chessfrontend.h"
 #include "network.h"
 #include "ai.h"
+#include "aipool.h"
 
 typedef struct {
 	server_t server;
@@ -9,6 +10,12 @@ typedef struct {
 	map_t num_joined;
 	vector_t num_lobby;
 
+	ai_pool_t ai; //plays the ai seats of every game
+	unsigned game_id; //also numbers analyses, so the pool can tell them apart
+
+	char* analysis_dir; //finished games are analyzed into it when set
+	vector_t analyses; //mp_analysis_t*
+
 	//filemap_t users;
 	//filemap_index_t users_ip;
 } chess_server_t;
@@ -19,8 +26,24 @@ typedef struct {
 	vector_t player_num;
 	unsigned host; //pnum
 	char full;
+
+	unsigned id; //unique, unlike the index in games
+	unsigned ai_gen; //bumped whenever the position changes, so stale ai results are dropped
+	char ai_pending; //a job for this game is in the pool
+	char ai_ponder; //the job is a ponder on ai_predicted
+	move_t ai_predicted;
+	ai_job_t* ai_pondered; //ponder that finished before the human moved
+	char analyzed;
 } mp_game_t;
 
+//ranked moves for every position of a finished game, written out as json when the last comes back
+typedef struct {
+	unsigned id;
+	vector_t moves; //move_t, as played
+	vector_t positions; //char*, ai_analysis_json of each position before its move
+	unsigned left;
+} mp_analysis_t;
+
 void broadcast(chess_server_t* cserv, vector_t* nums, vector_t* data, unsigned num_exclude) {
 	vector_iterator num_iter = vector_iterate(nums);
 	while (vector_next(&num_iter)) {
@@ -39,6 +62,208 @@ int game_in(chess_server_t* cserv, unsigned i, mp_game_t** mg, unsigned* pnum) {
 	return 1;
 }
 
+//queues a search if an ai seat is to move and none is running yet
+void game_ai(chess_server_t* cserv, mp_game_t* mg) {
+	if (mg->g.won || mg->ai_pending) return;
+
+	player_t* p = vector_get(&mg->g.players, mg->g.player);
+	if (!p->ai) return;
+
+	ai_pool_submit(&cserv->ai, mg->id, mg->ai_gen, &mg->g);
+	mg->ai_pending = 1;
+}
+
+//stops the game's search or ponder
+void game_ai_stop(chess_server_t* cserv, mp_game_t* mg) {
+	if (mg->ai_pending) ai_pool_cancel(&cserv->ai, mg->id);
+	if (mg->ai_pondered) ai_job_free(mg->ai_pondered);
+
+	mg->ai_pending = 0;
+	mg->ai_ponder = 0;
+	mg->ai_pondered = NULL;
+}
+
+//queues every position of a finished game in the pool
+void game_analyze(chess_server_t* cserv, mp_game_t* mg) {
+	mg->analyzed = 1;
+	if (mg->g.moves.length==0) return;
+
+	mp_analysis_t* an = heapcpy(sizeof(mp_analysis_t), &(mp_analysis_t){.id=cserv->game_id++,
+		.moves=vector_new(sizeof(move_t)), .positions=vector_new(sizeof(char*)), .left=mg->g.moves.length});
+
+	vector_cpy(&mg->g.moves, &an->moves);
+	vector_populate(&an->positions, mg->g.moves.length, &(char*){NULL});
+	vector_pushcpy(&cserv->analyses, &an);
+
+	for (unsigned ply=0; ply<mg->g.moves.length; ply++) {
+		game_t pos = game_replay(&mg->g, ply);
+		ai_pool_analyze(&cserv->ai, an->id, ply, &pos);
+		game_free(&pos);
+	}
+}
+
+void analysis_write(chess_server_t* cserv, mp_analysis_t* an, game_t* g) {
+	char* path = heapstr("%s/game%u.json", cserv->analysis_dir, an->id);
+	FILE* f = fopen(path, "w");
+	drop(path);
+
+	if (!f) {
+		perror("could not write analysis");
+		return;
+	}
+
+	fprintf(f, "{\"moves\":[");
+	vector_iterator m_iter = vector_iterate(&an->moves);
+	while (vector_next(&m_iter)) {
+		char* str = move_str(g, m_iter.x);
+		fprintf(f, m_iter.i ? ",\"%s\"" : "\"%s\"", str);
+		drop(str);
+	}
+
+	fprintf(f, "],\"positions\":[");
+	vector_iterator pos_iter = vector_iterate(&an->positions);
+	while (vector_next(&pos_iter)) {
+		fprintf(f, pos_iter.i ? ",%s" : "%s", *(char**)pos_iter.x);
+	}
+
+	fprintf(f, "]}\n");
+	fclose(f);
+}
+
+//stores an analyzed position, and writes the game out once it has all of them
+void game_analysis_done(chess_server_t* cserv, ai_job_t* job) {
+	mp_analysis_t* an = NULL;
+
+	vector_iterator an_iter = vector_iterate(&cserv->analyses);
+	while (vector_next(&an_iter)) {
+		mp_analysis_t* an2 = *(mp_analysis_t**)an_iter.x;
+		if (an2->id==job->game) {
+			an = an2;
+			break;
+		}
+	}
+
+	if (!an) {
+		ai_job_free(job);
+		return;
+	} else if (job->yielded) {
+		ai_pool_requeue(&cserv->ai, job);
+		return;
+	}
+
+	char** pos = vector_get(&an->positions, job->gen);
+	*pos = ai_analysis_json(&job->g, job->lines, job->lines_len);
+
+	if (--an->left==0) {
+		analysis_write(cserv, an, &job->g);
+
+		vector_iterator pos_iter = vector_iterate(&an->positions);
+		while (vector_next(&pos_iter)) drop(*(char**)pos_iter.x);
+
+		vector_free(&an->positions);
+		vector_free(&an->moves);
+		vector_remove(&cserv->analyses, an_iter.i);
+		drop(an);
+	}
+
+	ai_job_free(job);
+}
+
+void game_ai_play(chess_server_t* cserv, mp_game_t* mg, ai_job_t* job);
+
+//the position changed after m, NULL for an undo, so a search on the old one is wasted
+//unless m was predicted, then the ponder continues as the search for the reply
+void game_changed(chess_server_t* cserv, mp_game_t* mg, move_t* m) {
+	mg->ai_gen++;
+
+	if (mg->g.won && cserv->analysis_dir && !mg->analyzed) game_analyze(cserv, mg);
+
+	if (mg->ai_ponder && m && !memcmp(m->from, mg->ai_predicted.from, sizeof(m->from))
+		&& !memcmp(m->to, mg->ai_predicted.to, sizeof(m->to))) {
+		mg->ai_ponder = 0;
+
+		ai_job_t* job = mg->ai_pondered;
+		if (job) {
+			mg->ai_pondered = NULL;
+			game_ai_play(cserv, mg, job);
+			return;
+		}
+
+		if (ai_pool_ponderhit(&cserv->ai, mg->id)) return;
+	}
+
+	game_ai_stop(cserv, mg);
+	game_ai(cserv, mg);
+}
+
+//plays the move of a finished search, then ponders the reply it expects
+void game_ai_play(chess_server_t* cserv, mp_game_t* mg, ai_job_t* job) {
+	mg->ai_pending = 0;
+
+	if (job->found && make_move(&mg->g, &job->m, 1, 1, mg->g.player) == move_success) {
+		vector_t data = vector_new(1);
+		vector_pushcpy(&data, &(char){mp_move_made});
+		write_move(&data, &job->m);
+		broadcast(cserv, &mg->player_num, &data, 0);
+		vector_free(&data);
+
+		//the next seat may be an ai too
+		game_changed(cserv, mg, &job->m);
+
+		if (!mg->ai_pending && !mg->g.won && job->stats.pv_len>=2
+			&& ai_pool_ponder(&cserv->ai, mg->id, mg->ai_gen+1, &mg->g, &job->stats.pv[1])) {
+			mg->ai_pending = 1;
+			mg->ai_ponder = 1;
+			mg->ai_predicted = job->stats.pv[1];
+		}
+	}
+
+	ai_job_free(job);
+}
+
+//takes the searches the pool has finished
+void game_ai_done(chess_server_t* cserv) {
+	ai_job_t* job;
+
+	while ((job=ai_pool_done(&cserv->ai))) {
+		if (job->k) {
+			game_analysis_done(cserv, job);
+			continue;
+		}
+
+		mp_game_t* mg = NULL;
+
+		vector_iterator game_iter = vector_iterate(&cserv->games);
+		while (vector_next(&game_iter)) {
+			mp_game_t* mg2 = *(mp_game_t**)game_iter.x;
+			if (mg2->id==job->game) {
+				mg = mg2;
+				break;
+			}
+		}
+
+		//kept until the human moves
+		if (mg && job->ponder && mg->ai_ponder && job->gen==mg->ai_gen+1 && !job->yielded) {
+			mg->ai_pondered = job;
+			continue;
+		}
+
+		//cancelled, everyone left or the position changed
+		if (!mg || job->ponder || job->gen!=mg->ai_gen) {
+			//gave its thread away, the reply is searched as usual
+			if (mg && job->ponder && mg->ai_ponder && job->gen==mg->ai_gen+1) {
+				mg->ai_pending = 0;
+				mg->ai_ponder = 0;
+			}
+
+			ai_job_free(job);
+			continue;
+		}
+
+		game_ai_play(cserv, mg, job);
+	}
+}
+
 void leave_game(chess_server_t* cserv, unsigned i) {
 	if (vector_search_remove(&cserv->num_lobby, &i)) return;
 
@@ -81,6 +306,7 @@ void leave_game(chess_server_t* cserv, unsigned i) {
 		broadcast(cserv, &cserv->num_lobby, &data, 0);
 
 		vector_remove(&cserv->games, g_i);
+		game_ai_stop(cserv, mg);
 
 		game_free(&mg->g);
 		mp_extra_free(&mg->g.m);
@@ -113,16 +339,42 @@ void leave_game(chess_server_t* cserv, unsigned i) {
 	vector_free(&data);
 }
 
+//termchess_server [-a ai threads] [-A analysis directory] [-O book directory] [-T tablebase directory] [-N network directory] [-E eval directory]
+//   [-H shared table megabytes] [-P]   one transposition table for every ai game, -P backs it with huge pages
 int main(int argc, char** argv) {
-	chess_server_t cserv = {.server=start_server(MP_PORT, 1), .games=vector_new(sizeof(mp_game_t*)), .num_joined=map_new(), .num_lobby=vector_new(sizeof(unsigned))};
+	int ai_threads = 0;
+	char* analysis_dir = NULL;
+	size_t shared_mb = 0;
+	char huge = 0;
+	for (int i=1; i<argc; i++) {
+		if (streq(argv[i], "-a") && i+1<argc) ai_threads = atoi(argv[++i]);
+		else if (streq(argv[i], "-A") && i+1<argc) analysis_dir = argv[++i];
+		else if (streq(argv[i], "-O") && i+1<argc) ai_books_open(argv[++i]); //opened before the pool's threads read them
+		else if (streq(argv[i], "-T") && i+1<argc) ai_tbs_open(argv[++i]);
+		else if (streq(argv[i], "-N") && i+1<argc) ai_nns_open(argv[++i]);
+		else if (streq(argv[i], "-E") && i+1<argc) ai_evals_open(argv[++i]);
+		else if (streq(argv[i], "-H") && i+1<argc) shared_mb = strtoul(argv[++i], NULL, 10);
+		else if (streq(argv[i], "-P")) huge = 1;
+	}
+
+	chess_server_t cserv = {.server=start_server(MP_PORT, 1), .games=vector_new(sizeof(mp_game_t*)), .num_joined=map_new(), .num_lobby=vector_new(sizeof(unsigned)), .game_id=0,
+		.analysis_dir=analysis_dir, .analyses=vector_new(sizeof(mp_analysis_t*))};
 	map_configure_uint_key(&cserv.num_joined, sizeof(mp_game_t*));
 
+	if (shared_mb) ai_pool_share(&cserv.ai, shared_mb, huge);
+	ai_pool_start(&cserv.ai, &cserv.server, ai_threads);
+
 	unsigned i;
 	vector_t resp = vector_new(1);
 
 	while (1) {
 		cur_t cur = server_recv(&cserv.server, &i);
 
+		if (!cur.start && i==0) { //woken by the ai pool
+			game_ai_done(&cserv);
+			continue;
+		}
+
 		mp_client_t op = mp_leave_game;
 		if (cur.start) op = (mp_client_t)read_chr(&cur);
 
@@ -163,7 +415,7 @@ int main(int argc, char** argv) {
 					break;
 				}
 
-				mp_game_t* mg = heapcpy(sizeof(mp_game_t), &(mp_game_t){.g=g, .name=g_name, .player_num=vector_new(sizeof(unsigned)), .full=full});
+				mp_game_t* mg = heapcpy(sizeof(mp_game_t), &(mp_game_t){.g=g, .name=g_name, .player_num=vector_new(sizeof(unsigned)), .full=full, .id=cserv.game_id++, .ai_gen=0, .ai_pending=0, .ai_ponder=0, .ai_pondered=NULL, .analyzed=0});
 				mg->g.m.spectators = vector_new(sizeof(char*));
 				mg->g.m.host = (unsigned)joined;
 
@@ -182,6 +434,7 @@ int main(int argc, char** argv) {
 
 				vector_pushcpy(&resp, &(char){mp_game_made});
 
+				game_ai(&cserv, mg);
 				break;
 			}
 			case mp_join_game: {
@@ -268,26 +521,7 @@ int main(int argc, char** argv) {
 				broadcast(&cserv, &mg->player_num, &resp, i);
 				vector_clear(&resp);
 
-				break;
-			}
-			case mp_ai_move: {
-				mp_game_t* mg;
-				unsigned player;
-				move_t m = read_move(&cur);
-
-				if (!game_in(&cserv, i, &mg, &player) || cur.err) break;
-
-				player_t* p = vector_get(&mg->g.players, mg->g.player);
-				if (player!=mg->g.m.host || mg->g.won || !p->ai) break;
-
-				if (make_move(&mg->g, &m, 1, 1, (char)mg->g.player) != move_success) break;
-
-				vector_pushcpy(&resp, &(char){mp_move_made});
-				write_move(&resp, &m);
-				broadcast(&cserv, &mg->player_num, &resp, i);
-
-				vector_clear(&resp);
-
+				game_changed(&cserv, mg, &m);
 				break;
 			}
 			case mp_undo_move: {
@@ -304,6 +538,8 @@ int main(int argc, char** argv) {
 				vector_pushcpy(&resp, &(char){mp_move_undone});
 				broadcast(&cserv, &mg->player_num, &resp, i);
 				vector_clear(&resp);
+
+				game_changed(&cserv, mg, NULL);
 				break;
 			}
 			case mp_leave_game: {
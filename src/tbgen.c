@@ -0,0 +1,523 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdatomic.h>
+
+#include "threads.h"
+
+#include "chess.h"
+#include "chessfrontend.h"
+#include "ai.h"
+
+//generates endgame tablebases by retrograde analysis, on the geometry and rules of a board
+//termchess_tbgen [-j threads] [-o dir] [-m MB] board material...
+//material is the pieces of each player as in .board files, the two players separated by v, eg. KRvK or KCvKA
+//tables for every capture are generated first, each material to dir/<variant>-<material>.tb
+//and tables already there are loaded instead; termchess_server and termchess_engine read dir with -T
+//
+//every position has its legal moves counted with the engine's move generator, and the mates are the first layer
+//the positions before those of a layer are found by moving the pieces of the side that just moved backwards,
+//which without pawns are the moves they could make forwards to an empty square.
+//a position before a loss is a win, and one whose moves all lead to wins is a loss, one layer later than the last.
+//captures lead to smaller tables which are already complete, their outcomes are counted in from the start
+//
+//tables hold every placement of the pieces without any symmetry, squares^pieces for each side to move,
+//and take TBGEN_BYTES per position while generated. tables needing more than -m MB (TBGEN_MAXMB) are refused
+
+#define TBGEN_CHUNK 4096
+#define TBGEN_ILLEGAL 0xff //count of a position where the side not to move is in check, or pieces share a square
+#define TBGEN_MAXLAYER 255
+#define TBGEN_BYTES 5 //values, counts, worst, pending and the finished values
+#define TBGEN_MAXMB 4096
+
+char TBGEN_LETTERS[] = "KQRBNPACH"; //by piece_ty, as in .board files
+
+typedef struct {
+	char* material;
+	int n;
+	ai_tb_piece_t pieces[AI_TB_MAXPIECES]; //types and players in table order, squares unused
+	unsigned squares;
+	uint64_t len;
+	uint8_t* values;
+} tbgen_table_t;
+
+typedef struct {
+	game_t base; //board of the variant without its pieces
+	uint64_t variant;
+	char* dir;
+	int threads;
+	uint64_t maxbytes;
+	vector_t tables; //tbgen_table_t*, complete
+
+	//the table being generated
+	tbgen_table_t* t;
+	_Atomic uint8_t* values;
+	_Atomic uint8_t* counts; //moves not yet known to lead to a win of the opponent
+	uint8_t* worst; //highest value among the captures leading to a win of the opponent
+	uint8_t* pending; //value a position gets once its layer comes, from captures or a count reaching 0 early
+	int layer;
+	int last; //highest pending layer
+	atomic_ulong next; //chunk to take
+	atomic_ulong resolved; //in the current layer
+	mtx_t lock; //last
+} tbgen_t;
+
+typedef struct {
+	tbgen_t* gen;
+	game_t g;
+	vector_t moves;
+} tbgen_worker_t;
+
+char* tbgen_material(ai_tb_piece_t* pieces, int n) {
+	char* str = heap(n+2);
+	int len=0;
+	for (int p=0; p<n; p++) {
+		if (p>0 && pieces[p].player!=pieces[p-1].player) str[len++] = 'v';
+		str[len++] = TBGEN_LETTERS[pieces[p].ty];
+	}
+
+	if (n>0 && pieces[n-1].player==0) str[len++] = 'v';
+	str[len] = 0;
+	return str;
+}
+
+//reads a material like KRvK, returns 0 if it is not one
+int tbgen_parse_material(char* str, ai_tb_piece_t* pieces, int* n) {
+	int player=0;
+	int kings[2] = {0,0};
+	*n = 0;
+
+	for (; *str; str++) {
+		if (*str=='v') {
+			if (player++) return 0;
+			continue;
+		}
+
+		char* letter = strchr(TBGEN_LETTERS, *str);
+		if (!letter || (int)(letter-TBGEN_LETTERS)==p_pawn || *n==AI_TB_MAXPIECES) return 0;
+
+		pieces[*n] = (ai_tb_piece_t){.ty=(uint8_t)(letter-TBGEN_LETTERS), .player=(uint8_t)player, .sq=0};
+		if (pieces[*n].ty==p_king) kings[player]++;
+		(*n)++;
+	}
+
+	ai_tb_sort(pieces, *n);
+	return player==1 && kings[0]>0 && kings[1]>0;
+}
+
+tbgen_table_t* tbgen_find(tbgen_t* gen, ai_tb_piece_t* pieces, int n) {
+	vector_iterator t_iter = vector_iterate(&gen->tables);
+	while (vector_next(&t_iter)) {
+		tbgen_table_t* t = *(tbgen_table_t**)t_iter.x;
+		if (t->n!=n) continue;
+
+		int p=0;
+		while (p<n && t->pieces[p].ty==pieces[p].ty && t->pieces[p].player==pieces[p].player) p++;
+		if (p==n) return t;
+	}
+
+	return NULL;
+}
+
+char* tbgen_path(tbgen_t* gen, char* material) {
+	return heapstr("%s/%016llx-%s.tb", gen->dir, (unsigned long long)gen->variant, material);
+}
+
+//places the pieces of position i on the worker's board
+//returns 0 if two share a square or one is on a blocked square
+int tbgen_place(tbgen_worker_t* w, uint64_t i, ai_tb_piece_t* pieces, char* player) {
+	tbgen_table_t* t = w->gen->t;
+	for (int p=t->n-1; p>=0; p--) {
+		pieces[p] = t->pieces[p];
+		pieces[p].sq = (uint16_t)(i%t->squares);
+		i /= t->squares;
+	}
+
+	*player = (char)i;
+	w->g.player = *player;
+
+	memcpy(w->g.board.data, w->gen->base.board.data, w->g.board.length*w->g.board.size);
+
+	vector_iterator pl_iter = vector_iterate(&w->g.players);
+	while (vector_next(&pl_iter)) {
+		player_t* pl = pl_iter.x;
+		vector_clear(&pl->kings);
+		vector_pushcpy(&pl->kings, &(int){-1});
+		pl->check = 0;
+		pl->mate = 0;
+	}
+
+	for (int p=0; p<t->n; p++) {
+		piece_t* sq = vector_get(&w->g.board, pieces[p].sq);
+		if (sq->ty!=p_empty) return 0;
+
+		*sq = (piece_t){.ty=(piece_ty)pieces[p].ty, .flags=0, .player=(char)pieces[p].player};
+		if (pieces[p].ty==p_king) {
+			vector_insertcpy(&((player_t*)vector_get(&w->g.players, pieces[p].player))->kings, 0, &(int){pieces[p].sq});
+		}
+	}
+
+	return 1;
+}
+
+void tbgen_pending(tbgen_t* gen, uint64_t i, int v) {
+	gen->pending[i] = (uint8_t)v;
+
+	mtx_lock(&gen->lock);
+	if (v>gen->last) gen->last = v;
+	mtx_unlock(&gen->lock);
+}
+
+//counts the moves of position i and looks up its captures in the smaller tables
+void tbgen_init_position(tbgen_worker_t* w, uint64_t i) {
+	tbgen_t* gen = w->gen;
+	tbgen_table_t* t = gen->t;
+
+	ai_tb_piece_t pieces[AI_TB_MAXPIECES];
+	char player;
+	if (!tbgen_place(w, i, pieces, &player)
+			|| player_check(&w->g, (char)!player, vector_get(&w->g.players, !player))) {
+		atomic_store_explicit(&gen->counts[i], TBGEN_ILLEGAL, memory_order_relaxed);
+		return;
+	}
+
+	unsigned moves=0, count=0;
+	int win=0, worst=0;
+
+	for (int p=0; p<t->n; p++) {
+		if (pieces[p].player!=player) continue;
+
+		vector_clear(&w->moves);
+		piece_moves(&w->g, vector_get(&w->g.board, pieces[p].sq), &w->moves, 1);
+
+		vector_iterator m_iter = vector_iterate(&w->moves);
+		while (vector_next(&m_iter)) {
+			move_t* m = m_iter.x;
+			int to = pos_i(&w->g, m->to);
+			moves++;
+
+			if (board_get(&w->g, m->to)->ty==p_empty) {
+				count++;
+				continue;
+			}
+
+			//the captured piece leaves the table for a smaller one, in the same order
+			ai_tb_piece_t sub[AI_TB_MAXPIECES];
+			int sub_n=0;
+			for (int q=0; q<t->n; q++) {
+				if (pieces[q].sq==to) continue;
+				sub[sub_n] = pieces[q];
+				if (q==p) sub[sub_n].sq = (uint16_t)to;
+				sub_n++;
+			}
+
+			tbgen_table_t* sub_t = tbgen_find(gen, sub, sub_n);
+			int v = sub_t->values[ai_tb_index(sub, sub_n, t->squares, (char)!player)];
+
+			if (v%2) {
+				if (!win || v+1<win) win = v+1;
+			} else if (v>0) {
+				if (v>worst) worst = v;
+				continue;
+			}
+
+			count++;
+		}
+	}
+
+	atomic_store_explicit(&gen->counts[i], (uint8_t)count, memory_order_relaxed);
+	gen->worst[i] = (uint8_t)worst;
+
+	if (moves==0) {
+		//mated, or a stalemate which stays a draw
+		if (player_check(&w->g, player, vector_get(&w->g.players, player))) atomic_store_explicit(&gen->values[i], 1, memory_order_relaxed);
+	} else if (win) {
+		tbgen_pending(gen, i, win);
+	} else if (count==0) {
+		tbgen_pending(gen, i, worst+1);
+	}
+}
+
+void tbgen_resolve(tbgen_t* gen, uint64_t i) {
+	uint8_t zero=0;
+	if (atomic_compare_exchange_strong(&gen->values[i], &zero, (uint8_t)gen->layer)) atomic_fetch_add(&gen->resolved, 1);
+}
+
+//finds the positions before position i, which is in the last layer
+void tbgen_layer_position(tbgen_worker_t* w, uint64_t i) {
+	tbgen_t* gen = w->gen;
+	tbgen_table_t* t = gen->t;
+
+	ai_tb_piece_t pieces[AI_TB_MAXPIECES];
+	char player;
+	tbgen_place(w, i, pieces, &player);
+
+	int loss = (gen->layer-1)%2;
+
+	for (int p=0; p<t->n; p++) {
+		if (pieces[p].player==player) continue;
+
+		vector_clear(&w->moves);
+		piece_moves(&w->g, vector_get(&w->g.board, pieces[p].sq), &w->moves, 0);
+
+		uint16_t sq = pieces[p].sq;
+
+		vector_iterator m_iter = vector_iterate(&w->moves);
+		while (vector_next(&m_iter)) {
+			move_t* m = m_iter.x;
+			if (board_get(&w->g, m->to)->ty!=p_empty) continue;
+
+			pieces[p].sq = (uint16_t)pos_i(&w->g, m->to);
+			uint64_t prev = ai_tb_index(pieces, t->n, t->squares, (char)!player);
+			pieces[p].sq = sq;
+
+			uint8_t count = atomic_load_explicit(&gen->counts[prev], memory_order_relaxed);
+			if (count==TBGEN_ILLEGAL || atomic_load_explicit(&gen->values[prev], memory_order_relaxed)) continue;
+
+			if (loss) {
+				tbgen_resolve(gen, prev);
+			} else if (atomic_fetch_sub(&gen->counts[prev], 1)==1) {
+				//every move leads to a win of the opponent, the farthest decides when
+				int v = max(gen->worst[prev], gen->layer-1)+1;
+				if (v==gen->layer) tbgen_resolve(gen, prev);
+				else tbgen_pending(gen, prev, v);
+			}
+		}
+	}
+}
+
+int tbgen_thread(tbgen_worker_t* w) {
+	tbgen_t* gen = w->gen;
+	tbgen_table_t* t = gen->t;
+
+	unsigned long chunk;
+	while ((chunk=atomic_fetch_add(&gen->next, 1))*TBGEN_CHUNK < t->len) {
+		uint64_t end = min((chunk+1)*TBGEN_CHUNK, t->len);
+
+		for (uint64_t i=chunk*TBGEN_CHUNK; i<end; i++) {
+			if (gen->layer==1) {
+				tbgen_init_position(w, i);
+				continue;
+			}
+
+			uint8_t v = atomic_load_explicit(&gen->values[i], memory_order_relaxed);
+			if (v==gen->layer-1) tbgen_layer_position(w, i);
+			else if (v==0 && gen->pending[i]==gen->layer) tbgen_resolve(gen, i);
+		}
+	}
+
+	return 0;
+}
+
+//runs a pass over every position of the table on all threads
+void tbgen_pass(tbgen_t* gen) {
+	atomic_store(&gen->next, 0);
+	atomic_store(&gen->resolved, 0);
+
+	thrd_t* thrds = heap(sizeof(thrd_t)*gen->threads);
+	tbgen_worker_t* workers = heap(sizeof(tbgen_worker_t)*gen->threads);
+
+	for (int i=0; i<gen->threads; i++) {
+		workers[i] = (tbgen_worker_t){.gen=gen, .g=game_copy(&gen->base), .moves=vector_new(sizeof(move_t))};
+		thrd_create(&thrds[i], (int(*)(void*))tbgen_thread, &workers[i]);
+	}
+
+	for (int i=0; i<gen->threads; i++) {
+		thrd_join(thrds[i], NULL);
+		game_free(&workers[i].g);
+		vector_free(&workers[i].moves);
+	}
+
+	drop(thrds);
+	drop(workers);
+}
+
+//loads a table generated before, returns 0 if there is none of this material
+int tbgen_load(tbgen_t* gen, tbgen_table_t* t) {
+	char* path = tbgen_path(gen, t->material);
+	FILE* f = fopen(path, "rb");
+	drop(path);
+	if (!f) return 0;
+
+	ai_tb_header_t h;
+	int ok = fread(&h, sizeof(h), 1, f)==1 && h.magic==AI_TB_MAGIC && h.version==AI_TB_VERSION
+		&& h.variant==gen->variant && h.squares==t->squares && h.len==t->len;
+
+	if (ok) {
+		t->values = heap(t->len);
+		ok = fread(t->values, 1, t->len, f)==t->len;
+		if (!ok) drop(t->values);
+	}
+
+	fclose(f);
+	return ok;
+}
+
+int tbgen_write(tbgen_t* gen, tbgen_table_t* t) {
+	char* path = tbgen_path(gen, t->material);
+	FILE* f = fopen(path, "wb");
+	if (!f) {
+		fprintf(stderr, "could not write %s\n", path);
+		drop(path);
+		return 0;
+	}
+
+	ai_tb_header_t h = {.magic=AI_TB_MAGIC, .version=AI_TB_VERSION, .variant=gen->variant,
+		.squares=t->squares, .pieces=(uint32_t)t->n, .reserved=0, .len=t->len};
+	for (int p=0; p<AI_TB_MAXPIECES; p++) {
+		h.ty[p] = p<t->n ? t->pieces[p].ty : 0;
+		h.player[p] = p<t->n ? t->pieces[p].player : 0;
+	}
+
+	fwrite(&h, sizeof(h), 1, f);
+	fwrite(t->values, 1, t->len, f);
+	fclose(f);
+
+	drop(path);
+	return 1;
+}
+
+tbgen_table_t* tbgen_generate(tbgen_t* gen, ai_tb_piece_t* pieces, int n) {
+	tbgen_table_t* t = tbgen_find(gen, pieces, n);
+	if (t) return t;
+
+	//refused before its captures, which are smaller, take any time
+	unsigned squares = (unsigned)(gen->base.board_w*gen->base.board_h);
+	uint64_t len = 2;
+	for (int p=0; p<n && len<=UINT64_MAX/squares; p++) len *= squares;
+
+	if (len>gen->maxbytes/TBGEN_BYTES) {
+		char* material = tbgen_material(pieces, n);
+		fprintf(stderr, "%s: %u squares^%d positions need more than %llu MB to generate, try -m\n",
+			material, squares, n, (unsigned long long)(gen->maxbytes>>20));
+		drop(material);
+		return NULL;
+	}
+
+	//captures of anything but a king
+	for (int j=0; j<n; j++) {
+		if (pieces[j].ty==p_king) continue;
+
+		ai_tb_piece_t sub[AI_TB_MAXPIECES];
+		int sub_n=0;
+		for (int q=0; q<n; q++) {
+			if (q!=j) sub[sub_n++] = pieces[q];
+		}
+
+		if (!tbgen_generate(gen, sub, sub_n)) return NULL;
+	}
+
+	t = heap(sizeof(tbgen_table_t));
+	*t = (tbgen_table_t){.material=tbgen_material(pieces, n), .n=n, .squares=squares, .len=len, .values=NULL};
+	memcpy(t->pieces, pieces, sizeof(ai_tb_piece_t)*n);
+
+	if (tbgen_load(gen, t)) {
+		printf("%s: loaded\n", t->material);
+		vector_pushcpy(&gen->tables, &t);
+		return t;
+	}
+
+	double start = ai_time();
+
+	gen->t = t;
+	gen->values = heap(t->len);
+	gen->counts = heap(t->len);
+	gen->worst = heap(t->len);
+	gen->pending = heap(t->len);
+	memset((void*)gen->values, 0, t->len);
+	memset(gen->pending, 0, t->len);
+	gen->last = 0;
+
+	gen->layer = 1;
+	tbgen_pass(gen);
+
+	for (gen->layer=2; gen->layer<=TBGEN_MAXLAYER; gen->layer++) {
+		tbgen_pass(gen);
+		if (atomic_load(&gen->resolved)==0 && gen->layer>gen->last) break;
+	}
+
+	t->values = heap(t->len);
+	unsigned long wins=0, losses=0;
+	for (uint64_t i=0; i<t->len; i++) {
+		t->values[i] = atomic_load_explicit(&gen->values[i], memory_order_relaxed);
+		if (t->values[i]) t->values[i]%2 ? losses++ : wins++;
+	}
+
+	drop((void*)gen->values);
+	drop((void*)gen->counts);
+	drop(gen->worst);
+	drop(gen->pending);
+
+	printf("%s: %llu positions, %lu wins, %lu losses, longest mate %i plies, %.1fs\n", t->material,
+			(unsigned long long)t->len, wins, losses, gen->layer-2, ai_time()-start);
+
+	if (!tbgen_write(gen, t)) return NULL;
+
+	vector_pushcpy(&gen->tables, &t);
+	return t;
+}
+
+int main(int argc, char** argv) {
+	tbgen_t gen = {.dir=".", .maxbytes=(uint64_t)TBGEN_MAXMB<<20, .threads=(int)sysconf(_SC_NPROCESSORS_ONLN), .tables=vector_new(sizeof(tbgen_table_t*))};
+	char* board = NULL;
+	vector_t materials = vector_new(sizeof(char*));
+
+	for (int i=1; i<argc; i++) {
+		if (streq(argv[i], "-j") && i+1<argc) gen.threads = atoi(argv[++i]);
+		else if (streq(argv[i], "-o") && i+1<argc) gen.dir = argv[++i];
+		else if (streq(argv[i], "-m") && i+1<argc) gen.maxbytes = strtoull(argv[++i], NULL, 10)<<20;
+		else if (!board) board = argv[i];
+		else vector_pushcpy(&materials, &argv[i]);
+	}
+
+	if (!board || materials.length==0) {
+		fprintf(stderr, "usage: termchess_tbgen [-j threads] [-o dir] [-m MB] board material...\n");
+		return 1;
+	}
+
+	if (gen.threads<1) gen.threads = 1;
+
+	if (!parse_board_file(board, 0, &gen.base) || gen.base.players.length!=2) {
+		fprintf(stderr, "could not read %s, or it is not for two players\n", board);
+		return 1;
+	}
+
+	gen.variant = ai_variant(&gen.base);
+
+	vector_iterator p_iter = vector_iterate(&gen.base.board);
+	while (vector_next(&p_iter)) {
+		piece_t* p = p_iter.x;
+		if (p->ty!=p_blocked) *p = (piece_t){.ty=p_empty, .flags=0, .player=-1};
+	}
+
+	mtx_init(&gen.lock, mtx_plain);
+
+	int ret=0;
+	vector_iterator m_iter = vector_iterate(&materials);
+	while (vector_next(&m_iter)) {
+		ai_tb_piece_t pieces[AI_TB_MAXPIECES];
+		int n;
+
+		if (!tbgen_parse_material(*(char**)m_iter.x, pieces, &n)) {
+			fprintf(stderr, "%s is not a material, at most %i pieces without pawns and a king each\n", *(char**)m_iter.x, AI_TB_MAXPIECES);
+			ret = 1;
+		} else if (!tbgen_generate(&gen, pieces, n)) {
+			ret = 1;
+		}
+	}
+
+	vector_iterator t_iter = vector_iterate(&gen.tables);
+	while (vector_next(&t_iter)) {
+		tbgen_table_t* t = *(tbgen_table_t**)t_iter.x;
+		drop(t->material);
+		drop(t->values);
+		drop(t);
+	}
+
+	vector_free(&gen.tables);
+	vector_free(&materials);
+	game_free(&gen.base);
+	mtx_destroy(&gen.lock);
+	return ret;
+}
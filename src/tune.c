@@ -0,0 +1,376 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "threads.h"
+
+#include "chess.h"
+#include "chessfrontend.h"
+#include "ai.h"
+
+//fits the evaluation parameters of each variant to the results of recorded games
+//termchess_tune [-o dir] [-j threads] [-n iterations] [-r rate] [-k plies] [-g] files...
+//-o is where the parameters of each variant are written, as <variant>.eval, the directory given to the server, engine and bench with -E
+//-n steps of gradient descent, each over every position
+//-r learning rate of the adam steps
+//-k plies from the start of each game that are left out, selfplay's random opening
+//-g reads the files as games saved with write_game instead of replays from termchess_selfplay -r, unfinished games are skipped
+//
+//the material, center and advance terms and mobility are linear in the parameters, so each position is kept as the
+//difference of its terms between a team and the others; the logistic of the score over a scale fit first
+//is a team's chance to win, and the squared error from the results is minimized
+//the pawn's value is left as it is, every margin of the search is measured in it
+//games are replayed with the rules the web menu defaults to, same as termchess_engine
+
+#define TUNE_ITERATIONS 1000
+#define TUNE_RATE 0.005
+#define TUNE_SKIP 4
+#define TUNE_PARAMS (2*p_empty+2) //piece values, center terms, advance, mobility
+#define TUNE_ADVANCE (2*p_empty)
+#define TUNE_MOBILITY (2*p_empty+1)
+#define TUNE_BATCH 4096 //positions per job of a thread
+
+typedef struct {
+	float x[TUNE_PARAMS];
+	float result;
+} tune_sample_t;
+
+typedef struct {
+	uint64_t variant;
+	unsigned games;
+	vector_t samples; //tune_sample_t
+} tune_variant_t;
+
+typedef struct {
+	vector_t variants; //tune_variant_t
+	int skip;
+	unsigned skipped;
+	vector_t moves; //scratch for mobility
+} tune_t;
+
+//a thread's share of the error and its gradient
+typedef struct {
+	tune_variant_t* v;
+	double* params;
+	double scale;
+	atomic_uint* next; //batch taken by the next thread
+	char grad; //also sums the gradient
+
+	double err;
+	double gradient[TUNE_PARAMS];
+} tune_thread_t;
+
+tune_variant_t* tune_variant(tune_t* t, game_t* g) {
+	uint64_t variant = ai_variant(g);
+
+	vector_iterator v_iter = vector_iterate(&t->variants);
+	while (vector_next(&v_iter)) {
+		tune_variant_t* v = v_iter.x;
+		if (v->variant==variant) return v;
+	}
+
+	return vector_pushcpy(&t->variants, &(tune_variant_t){.variant=variant, .games=0, .samples=vector_new(sizeof(tune_sample_t))});
+}
+
+//terms of the team of player k less those of the others, as ai_eval_init and ai_eval_mobility sum them
+void tune_terms(tune_t* t, game_t* g, int k, float* x) {
+	memset(x, 0, sizeof(float)*TUNE_PARAMS);
+	player_t* player = vector_get(&g->players, k);
+
+	int pos[2] = {-1, 0};
+	while (board_pos_next(g, pos)) {
+		piece_t* p = board_get(g, pos);
+		if (!piece_edible(p)) continue;
+
+		float s = is_ally((char)k, player, p->player) ? 1 : -1;
+		x[p->ty] += s;
+		x[p_empty+p->ty] += s*ai_center(g, pos);
+		x[TUNE_ADVANCE] += s*(float)ai_progress(g, p, pos);
+
+		vector_clear(&t->moves);
+		piece_moves(g, p, &t->moves, 0);
+		x[TUNE_MOBILITY] += s*(float)t->moves.length;
+	}
+}
+
+//whether k is the first player of its team
+int tune_first(game_t* g, unsigned k) {
+	player_t* player = vector_get(&g->players, k);
+	for (unsigned j=0; j<k; j++) {
+		if (is_ally((char)k, player, (char)j)) return 0;
+	}
+
+	return 1;
+}
+
+//a sample per team; with two teams the second is the first negated, so it is left out
+void tune_position(tune_t* t, tune_variant_t* v, game_t* g, double* scores) {
+	int teams = 0;
+	for (unsigned k=0; k<g->players.length; k++) teams += tune_first(g, k);
+
+	for (unsigned k=0; k<g->players.length; k++) {
+		if (!tune_first(g, k)) continue;
+
+		tune_sample_t sample = {.result=(float)scores[k]};
+		tune_terms(t, g, (int)k, sample.x);
+		vector_pushcpy(&v->samples, &sample);
+
+		if (teams==2) break;
+	}
+}
+
+//samples every position of moves played on g, which is left at the end of the game
+void tune_add(tune_t* t, game_t* g, vector_t* moves, double* scores) {
+	tune_variant_t* v = tune_variant(t, g);
+	v->games++;
+
+	vector_iterator m_iter = vector_iterate(moves);
+	while (vector_next(&m_iter) && !g->won) {
+		make_move(g, m_iter.x, 0, 1, g->player);
+		if ((int)m_iter.i>=t->skip && !g->won) tune_position(t, v, g, scores);
+	}
+}
+
+void tune_replay_line(tune_t* t, char* line) {
+	game_t g;
+	double* scores;
+	vector_t moves = vector_new(sizeof(move_t));
+
+	if (!read_replay(line, &g, &scores, &moves, -1)) {
+		t->skipped++;
+		vector_free(&moves);
+		return;
+	}
+
+	tune_add(t, &g, &moves, scores);
+
+	vector_free(&moves);
+	game_free(&g);
+	drop(scores);
+}
+
+void tune_replays(tune_t* t, char* path) {
+	FILE* f = fopen(path, "r");
+	if (!f) {
+		fprintf(stderr, "could not read %s\n", path);
+		return;
+	}
+
+	char* line = NULL;
+	size_t line_cap = 0;
+	while (getline(&line, &line_cap, f) >= 0) tune_replay_line(t, line);
+
+	if (line) free(line);
+	fclose(f);
+}
+
+void tune_game(tune_t* t, char* path) {
+	game_t g;
+	if (!read_game_file(path, &g)) {
+		fprintf(stderr, "could not read %s\n", path);
+		return;
+	}
+
+	double* scores = game_scores(&g);
+	if (!scores) {
+		t->skipped++;
+		game_free(&g);
+		return;
+	}
+
+	game_t start = game_replay(&g, 0);
+	tune_add(t, &start, &g.moves, scores);
+
+	drop(scores);
+	game_free(&start);
+	game_free(&g);
+}
+
+void tune_get(ai_eval_params_t* e, double* params) {
+	for (int ty=0; ty<p_empty; ty++) {
+		params[ty] = e->piece[ty];
+		params[p_empty+ty] = e->center[ty];
+	}
+
+	params[TUNE_ADVANCE] = e->advance;
+	params[TUNE_MOBILITY] = e->mobility;
+}
+
+void tune_set(ai_eval_params_t* e, double* params) {
+	for (int ty=0; ty<p_empty; ty++) {
+		e->piece[ty] = (float)params[ty];
+		e->center[ty] = (float)params[p_empty+ty];
+	}
+
+	e->advance = (float)params[TUNE_ADVANCE];
+	e->mobility = (float)params[TUNE_MOBILITY];
+}
+
+int tune_thread(tune_thread_t* t) {
+	unsigned n = (unsigned)t->v->samples.length;
+	t->err = 0;
+	memset(t->gradient, 0, sizeof(t->gradient));
+
+	unsigned start;
+	while ((start=atomic_fetch_add(t->next, TUNE_BATCH)) < n) {
+		unsigned end = start+TUNE_BATCH < n ? start+TUNE_BATCH : n;
+
+		for (unsigned i=start; i<end; i++) {
+			tune_sample_t* s = vector_get(&t->v->samples, i);
+
+			double score = 0;
+			for (int j=0; j<TUNE_PARAMS; j++) score += t->params[j]*s->x[j];
+
+			double p = 1/(1+exp(-score/t->scale));
+			double d = p-s->result;
+			t->err += d*d;
+
+			if (t->grad) {
+				double g = 2*d*p*(1-p)/t->scale;
+				for (int j=0; j<TUNE_PARAMS; j++) t->gradient[j] += g*s->x[j];
+			}
+		}
+	}
+
+	return 0;
+}
+
+//mean squared error of the samples, and its gradient into gradient if it is not NULL
+double tune_error(tune_variant_t* v, double* params, double scale, int jobs, tune_thread_t* ts, double* gradient) {
+	atomic_uint next;
+	atomic_init(&next, 0);
+
+	thrd_t* threads = heap(sizeof(thrd_t)*jobs);
+	for (int i=0; i<jobs; i++) {
+		ts[i] = (tune_thread_t){.v=v, .params=params, .scale=scale, .next=&next, .grad=gradient!=NULL};
+		if (i>0) thrd_create(&threads[i], (int(*)(void*))tune_thread, &ts[i]);
+	}
+
+	tune_thread(&ts[0]);
+
+	double err = 0;
+	if (gradient) memset(gradient, 0, sizeof(double)*TUNE_PARAMS);
+
+	for (int i=0; i<jobs; i++) {
+		if (i>0) thrd_join(threads[i], NULL);
+
+		err += ts[i].err;
+		if (gradient) {
+			for (int j=0; j<TUNE_PARAMS; j++) gradient[j] += ts[i].gradient[j]/(double)v->samples.length;
+		}
+	}
+
+	drop(threads);
+	return err/(double)v->samples.length;
+}
+
+//the scale the parameters fit best with, by golden section search
+double tune_scale(tune_variant_t* v, double* params, int jobs, tune_thread_t* ts) {
+	double lo = 0.25, hi = 32;
+	double r = (sqrt(5)-1)/2;
+
+	for (int i=0; i<40; i++) {
+		double a = hi - r*(hi-lo), b = lo + r*(hi-lo);
+		if (tune_error(v, params, a, jobs, ts, NULL) < tune_error(v, params, b, jobs, ts, NULL)) hi = b;
+		else lo = a;
+	}
+
+	return (lo+hi)/2;
+}
+
+void tune_fit(tune_variant_t* v, ai_eval_params_t* e, int iterations, double rate, int jobs) {
+	tune_thread_t* ts = heap(sizeof(tune_thread_t)*jobs);
+
+	double params[TUNE_PARAMS], gradient[TUNE_PARAMS], m[TUNE_PARAMS] = {0}, s[TUNE_PARAMS] = {0};
+	tune_get(e, params);
+
+	double scale = tune_scale(v, params, jobs, ts);
+	double before = tune_error(v, params, scale, jobs, ts, NULL);
+
+	//adam
+	double beta1 = 0.9, beta2 = 0.999, b1 = 1, b2 = 1;
+	for (int it=0; it<iterations; it++) {
+		tune_error(v, params, scale, jobs, ts, gradient);
+		gradient[p_pawn] = 0;
+
+		b1 *= beta1;
+		b2 *= beta2;
+		for (int j=0; j<TUNE_PARAMS; j++) {
+			m[j] = beta1*m[j] + (1-beta1)*gradient[j];
+			s[j] = beta2*s[j] + (1-beta2)*gradient[j]*gradient[j];
+			params[j] -= rate*(m[j]/(1-b1)) / (sqrt(s[j]/(1-b2)) + 1e-12);
+		}
+	}
+
+	double after = tune_error(v, params, scale, jobs, ts, NULL);
+	printf("%016llx: %lu positions of %u games, scale %.3f, error %.5f to %.5f\n", (unsigned long long)v->variant,
+		(unsigned long)v->samples.length, v->games, scale, before, after);
+
+	tune_set(e, params);
+	drop(ts);
+}
+
+int main(int argc, char** argv) {
+	tune_t t = {.variants=vector_new(sizeof(tune_variant_t)), .skip=TUNE_SKIP, .skipped=0, .moves=vector_new(sizeof(move_t))};
+	char* dir = ".";
+	int jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	int iterations = TUNE_ITERATIONS;
+	double rate = TUNE_RATE;
+	char games = 0;
+
+	vector_t files = vector_new(sizeof(char*));
+
+	for (int i=1; i<argc; i++) {
+		if (streq(argv[i], "-o") && i+1<argc) dir = argv[++i];
+		else if (streq(argv[i], "-j") && i+1<argc) jobs = atoi(argv[++i]);
+		else if (streq(argv[i], "-n") && i+1<argc) iterations = atoi(argv[++i]);
+		else if (streq(argv[i], "-r") && i+1<argc) rate = atof(argv[++i]);
+		else if (streq(argv[i], "-k") && i+1<argc) t.skip = atoi(argv[++i]);
+		else if (streq(argv[i], "-g")) games = 1;
+		else vector_pushcpy(&files, &argv[i]);
+	}
+
+	if (files.length==0) {
+		fprintf(stderr, "usage: termchess_tune [-o dir] [-j threads] [-n iterations] [-r rate] [-k plies] [-g] files...\n");
+		return 1;
+	}
+
+	jobs = clamp(jobs, 1, AI_MAXTHREADS);
+
+	vector_iterator f_iter = vector_iterate(&files);
+	while (vector_next(&f_iter)) {
+		if (games) tune_game(&t, *(char**)f_iter.x);
+		else tune_replays(&t, *(char**)f_iter.x);
+	}
+
+	int ret = 0;
+
+	vector_iterator v_iter = vector_iterate(&t.variants);
+	while (vector_next(&v_iter)) {
+		tune_variant_t* v = v_iter.x;
+
+		if (v->samples.length>0) {
+			ai_eval_params_t e = g_ai_eval;
+			tune_fit(v, &e, iterations, rate, jobs);
+
+			char* path = heapstr("%s/%016llx.eval", dir, (unsigned long long)v->variant);
+			if (ai_eval_write(path, v->variant, &e)<0) {
+				fprintf(stderr, "could not write %s\n", path);
+				ret = 1;
+			} else {
+				printf("%s\n", path);
+			}
+
+			drop(path);
+		}
+
+		vector_free(&v->samples);
+	}
+
+	if (t.skipped) printf("%u games skipped\n", t.skipped);
+
+	vector_free(&t.variants);
+	vector_free(&t.moves);
+	vector_free(&files);
+	return ret;
+}